@@ -0,0 +1,284 @@
+#include "param.h"
+#include "global.h"
+#include "setup.h"
+#include "match.h"
+#include "mask.h"
+#include "ringswitch.h"
+#include "compress.h"
+#include "decompress.h"
+#include "kernels.h"
+#include "arena.h"
+#include "selfcheck.h"
+#include <iostream>
+#include <iomanip>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <set>
+
+using namespace lbcrypto;
+
+namespace {
+
+struct BenchStats {
+    double mean_ms;
+    double std_ms;
+    double min_ms;
+};
+
+// One untimed warm-up run, then reps timed runs
+template <typename F>
+BenchStats timeKernel(int reps, F&& kernel) {
+    using Clock = std::chrono::high_resolution_clock;
+
+    kernel();
+
+    std::vector<double> samples;
+    samples.reserve(reps);
+    for (int r = 0; r < reps; r++) {
+        auto t_start = Clock::now();
+        kernel();
+        auto t_end = Clock::now();
+        samples.push_back(std::chrono::duration<double, std::milli>(t_end - t_start).count());
+    }
+
+    BenchStats stats{0, 0, samples[0]};
+    for (double t : samples) {
+        stats.mean_ms += t;
+        stats.min_ms = std::min(stats.min_ms, t);
+    }
+    stats.mean_ms /= reps;
+    for (double t : samples) stats.std_ms += (t - stats.mean_ms) * (t - stats.mean_ms);
+    stats.std_ms = reps > 1 ? std::sqrt(stats.std_ms / (reps - 1)) : 0.0;
+    return stats;
+}
+
+void printHeader() {
+    std::cout << std::left << std::setw(26) << "kernel"
+              << std::right << std::setw(12) << "mean (ms)"
+              << std::setw(12) << "std (ms)"
+              << std::setw(12) << "min (ms)"
+              << std::setw(16) << "throughput" << "  unit" << std::endl;
+    std::cout << std::string(84, '-') << std::endl;
+}
+
+void printRow(const std::string& name, const BenchStats& stats, double items, const std::string& unit) {
+    std::cout << std::left << std::setw(26) << name << std::right << std::fixed << std::setprecision(3)
+              << std::setw(12) << stats.mean_ms
+              << std::setw(12) << stats.std_ms
+              << std::setw(12) << stats.min_ms
+              << std::setw(16) << std::setprecision(2) << items / (stats.mean_ms / 1000.0)
+              << "  " << unit << std::endl;
+}
+
+int64_t modpow(int64_t base, int64_t exp, int64_t mod) {
+    int64_t result = 1;
+    base %= mod;
+    while (exp > 0) {
+        if (exp & 1) result = result * base % mod;
+        base = base * base % mod;
+        exp >>= 1;
+    }
+    return result;
+}
+
+void benchConfig(const PDQParams& P, int reps, const std::string& only) {
+    auto selected = [&](const char* name) { return only.empty() || only == name; };
+
+    auto setup = setupPDQ(P, generateKeySeed());
+    auto& context = setup.context;
+    auto& context_trace = setup.context_trace;
+    std::string keyTag_trace = setup.keypair_trace.publicKey->GetKeyTag();
+
+    auto testData = generateTestData(P);
+    auto encryptedDB = encryptDB(P, context, setup.keypair.publicKey, testData);
+    auto plainDB = encodeDB(P, context, testData);
+    auto ctxt_query = encryptKey(P, context, setup.keypair.publicKey, testData.query_value);
+
+    // Kernel inputs (untimed)
+    auto ctxt_diff = context->EvalSub(encryptedDB.keys[0][0], ctxt_query[0]);
+    auto ctxt_index = match(encryptedDB.keys, ctxt_query);
+
+    // ringswitchCore and precomputeTwiddles are timed on the first ring switch
+    // (main -> trace, or main -> first intermediate ring of the chain)
+    size_t towers = bsgsTowers(P, context_trace);
+    bool chained = !setup.chain.contexts.empty();
+    const auto& context_next = chained ? setup.chain.contexts[0] : context_trace;
+    const auto& keyTag_next = chained ? setup.chain.keyTags[0] : keyTag_trace;
+    int dim_next = P.degree / context_next->GetRingDimension();
+    std::vector<Ciphertext<DCRTPoly>> ctxt_switched;
+    for (const auto& ctxt : ctxt_index) {
+        auto switched = context->Compress(ctxt, towers);
+        context->GetScheme()->KeySwitchInPlace(switched, setup.switch_key);
+        ctxt_switched.push_back(switched);
+    }
+
+    auto twiddles = precomputeTwiddles(P, context_next, towers, P.degree);
+    auto ctxt_trace = ringswitch(P, context_trace, keyTag_trace, setup.switch_key, ctxt_index, nullptr, setup.chain);
+
+    auto ptxts = precomputeBSGSPlaintexts(P, context_trace, towers);
+
+    // Power sums and weighted sums of the matching records, computed in the clear
+    std::vector<int64_t> w(P.num_matching, 0), e(P.num_matching, 0);
+    for (int idx : testData.matching_indices) {
+        for (int k = 0; k < P.num_matching; k++) {
+            int64_t pw = modpow(idx + 1, k + 1, P.ptxt_modulus);
+            w[k] = (w[k] + pw) % P.ptxt_modulus;
+            e[k] = (e[k] + testData.values[idx] % P.ptxt_modulus * pw) % P.ptxt_modulus;
+        }
+    }
+    std::set<int64_t> index_set(testData.matching_indices.begin(), testData.matching_indices.end());
+
+    int num_trace_ctxts = ctxt_trace.size();
+    int num_ptxts = 0;
+    for (int g_ = 0; g_ < P.g_bsgs; g_++)
+        for (int b = 0; b < P.b_bsgs; b++)
+            if ((P.g_bsgs - g_ - 1) * P.b_bsgs + b < P.digest_rows) num_ptxts += num_trace_ctxts;
+
+    printHeader();
+
+    if (selected("equalityCheck")) {
+        auto stats = timeKernel(reps, [&] { (void)equalityCheck(ctxt_diff); });
+        printRow("equalityCheck", stats, 1, "ctxt/s");
+    }
+    if (selected("mask")) {
+        auto stats = timeKernel(reps, [&] { (void)mask(encryptedDB.values, ctxt_index); });
+        printRow("mask", stats, P.num_ctxts, "ctxt/s");
+    }
+    if (selected("maskNoRelin")) {
+        auto stats = timeKernel(reps, [&] { (void)maskNoRelin(encryptedDB.values, ctxt_index); });
+        printRow("maskNoRelin", stats, P.num_ctxts, "ctxt/s");
+    }
+    if (selected("maskPlain")) {
+        auto stats = timeKernel(reps, [&] { (void)maskPlain(plainDB.values, ctxt_index); });
+        printRow("maskPlain", stats, P.num_ctxts, "ctxt/s");
+    }
+    if (selected("ringswitchCore")) {
+        auto stats = timeKernel(reps, [&] {
+            std::vector<Ciphertext<DCRTPoly>> out;
+            ringswitchCore(ctxt_switched[0], context_next, keyTag_next, twiddles, out);
+        });
+        printRow("ringswitchCore", stats, 1, "ctxt/s");
+    }
+    if (selected("precomputeTwiddles")) {
+        auto stats = timeKernel(reps, [&] { (void)precomputeTwiddles(P, context_next, towers, P.degree); });
+        printRow("precomputeTwiddles", stats, dim_next * (dim_next - 1), "poly/s");
+    }
+    if (selected("mulAddInPlace")) {
+        // One ciphertext component times one BSGS plaintext, as in evalBSGS
+        DCRTPoly acc_poly = ctxt_trace[0]->GetElements()[0];
+        const auto& pt = ptxts[0][0][0];
+        auto stats = timeKernel(reps, [&] { mulAddInPlace(acc_poly, ctxt_trace[0]->GetElements()[1], pt); });
+        printRow(std::string("mulAddInPlace (") + mulAddKernel() + ")", stats,
+                 double(P.degree_trace) * towers, "coeff/s");
+    }
+    if (selected("precomputeBSGSPlaintexts")) {
+        auto stats = timeKernel(reps, [&] { (void)precomputeBSGSPlaintexts(P, context_trace, towers); });
+        printRow("precomputeBSGSPlaintexts", stats, num_ptxts, "ptxt/s");
+    }
+    if (selected("evalBSGS")) {
+        auto stats = timeKernel(reps, [&] { (void)evalBSGS(P, ctxt_trace, ptxts); });
+        printRow("evalBSGS", stats, num_trace_ctxts, "ctxt/s");
+    }
+    if (selected("decompressIndex")) {
+        auto stats = timeKernel(reps, [&] { (void)decompressIndex(P, w); });
+        printRow("decompressIndex", stats, 1, "digest/s");
+    }
+    if (selected("reconstruct")) {
+        auto stats = timeKernel(reps, [&] { (void)reconstruct(P, e, index_set); });
+        printRow("reconstruct", stats, 1, "digest/s");
+    }
+
+    // Keys are stored process-wide; drop them and the arena's buffers before
+    // the next configuration
+    QueryArena::local().clear();
+    CryptoContextImpl<DCRTPoly>::ClearEvalMultKeys();
+    CryptoContextImpl<DCRTPoly>::ClearEvalAutomorphismKeys();
+    CryptoContextFactory<DCRTPoly>::ReleaseAllContexts();
+}
+
+void printUsage() {
+    std::cout << "Usage:" << std::endl;
+    std::cout << "  ./pdq_bench [options]          Benchmark default parameters (defined in global.h)" << std::endl;
+    std::cout << "  ./pdq_bench N s [options]      Benchmark the specified configuration" << std::endl;
+    std::cout << "  ./pdq_bench all [options]      Benchmark every configuration in param.cpp" << std::endl;
+    std::cout << "\nOptions:" << std::endl;
+    std::cout << "  --reps R         Timed repetitions per kernel (default 10)" << std::endl;
+    std::cout << "  --kernel NAME    Run only NAME: equalityCheck, mask, maskNoRelin, maskPlain, ringswitchCore," << std::endl;
+    std::cout << "                   precomputeTwiddles, mulAddInPlace, precomputeBSGSPlaintexts, evalBSGS," << std::endl;
+    std::cout << "                   decompressIndex, reconstruct" << std::endl;
+    std::cout << "  --selfcheck      Run the self-checks instead (exit status 1 on a mismatch)" << std::endl;
+}
+
+// Tower moduli of the default configuration's main context
+std::vector<uint64_t> defaultModuli() {
+    PDQParams P;
+    P.derive();
+    CCParams<CryptoContextBFVRNS> params;
+    initBFVParams(P, params);
+    auto context = GenCryptoContext(params);
+    std::vector<uint64_t> moduli;
+    for (const auto& tower : context->GetElementParams()->GetParams())
+        moduli.push_back(tower->GetModulus().ConvertToInt());
+    return moduli;
+}
+
+int runSelfChecks() {
+    bool ok = checkSchedulerInterleaving();
+    ok = checkMulAddKernels(defaultModuli()) && ok;
+    ok = checkConstModReduce() && ok;
+    std::cout << "Self-checks: " << (ok ? "PASSED" : "FAILED") << std::endl;
+    return ok ? 0 : 1;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    int reps = 10;
+    std::string only;
+    std::vector<std::string> positional;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            printUsage();
+            return 0;
+        } else if (strcmp(argv[i], "--reps") == 0 && i + 1 < argc) {
+            reps = std::max(1, std::atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--kernel") == 0 && i + 1 < argc) {
+            only = argv[++i];
+        } else if (strcmp(argv[i], "--selfcheck") == 0) {
+            return runSelfChecks();
+        } else {
+            positional.push_back(argv[i]);
+        }
+    }
+
+    std::vector<std::pair<int, int>> configs;
+    if (positional.empty()) {
+        PDQParams defaults;
+        configs.push_back({defaults.num_records, defaults.num_matching});
+    } else if (positional.size() == 1 && positional[0] == "all") {
+        configs = availableParams();
+    } else if (positional.size() == 2) {
+        configs.push_back({std::atoi(positional[0].c_str()), std::atoi(positional[1].c_str())});
+    } else {
+        std::cerr << "Error: Invalid arguments. Run './pdq_bench --help' for usage." << std::endl;
+        return 1;
+    }
+
+    for (const auto& [N, s] : configs) {
+        PDQParams P;
+        if (!positional.empty() && !selectParams(P, N, s)) {
+            std::cerr << "Error: Invalid configuration (N=" << N << ", s=" << s << "). "
+                      << "Run './pdq_bench --help' for usage." << std::endl;
+            return 1;
+        }
+        std::cout << "\n[N=" << N << ", s=" << s << ", reps=" << reps << "]" << std::endl;
+        P.derive();
+        benchConfig(P, reps, only);
+    }
+
+    return 0;
+}
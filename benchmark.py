@@ -27,6 +27,10 @@ SIZE_PATTERNS = {
     "EvalKey": r"EvalKey size:\s*([\d.]+)\s*KB",
     "RotKey": r"RotKey size:\s*([\d.]+)\s*KB",
     "SwitchKey": r"SwitchKey size:\s*([\d.]+)\s*KB",
+    "EvalKeySeeded": r"EvalKey \(seeded\) size:\s*([\d.]+)\s*KB",
+    "RotKeySeeded": r"RotKey \(seeded\) size:\s*([\d.]+)\s*KB",
+    "SwitchKeySeeded": r"SwitchKey \(seeded\) size:\s*([\d.]+)\s*KB",
+    "RelinSwitchKeySeeded": r"RelinSwitchKey \(seeded\) size:\s*([\d.]+)\s*KB",
 }
 
 
@@ -172,6 +176,29 @@ def print_comm_table(results: dict[str, BenchmarkResult], exp_names: list[str]):
               f"{fmt_mb(s.get('SwitchKey', 0))}")
 
 
+def print_seeded_key_table(results: dict[str, BenchmarkResult], exp_names: list[str]):
+    """Print seed-compressed key sizes table."""
+
+    C = 13  # config column width
+    W = 14  # data column width
+
+    def fmt_mb(val: float) -> str:
+        return f"{val / 1024:>{W}.1f}"
+
+    print()
+    print(f"{'(N, s)':<{C}} {'EvalKey (MB)':>{W}} {'RotKey (MB)':>{W}} {'SwKey (MB)':>{W}} "
+          f"{'RelinKey (MB)':>{W}}")
+    print("-" * (C + 1 + (W + 1) * 4))
+
+    for name in exp_names:
+        if name not in results:
+            continue
+        s = results[name].sizes
+        print(f"{name:<{C}} {fmt_mb(s.get('EvalKeySeeded', 0))} "
+              f"{fmt_mb(s.get('RotKeySeeded', 0))} {fmt_mb(s.get('SwitchKeySeeded', 0))} "
+              f"{fmt_mb(s.get('RelinSwitchKeySeeded', 0))}")
+
+
 def main():
     print(f"Running {len(EXPERIMENTS)} experiments with {NUM_RUNS} runs each...\n")
     results = {}
@@ -204,6 +231,16 @@ def main():
             print(f"\n[{fig_name}]")
             print_comm_table(results, relevant)
 
+    print("\n" + "=" * 78)
+    print("SEED-COMPRESSED KEYS")
+    print("=" * 78)
+
+    for fig_name, exp_names in FIGURES.items():
+        relevant = [n for n in exp_names if n in results]
+        if relevant:
+            print(f"\n[{fig_name}]")
+            print_seeded_key_table(results, relevant)
+
 
 if __name__ == "__main__":
     main()
@@ -0,0 +1,360 @@
+#include "param.h"
+#include "global.h"
+#include "setup.h"
+#include "match.h"
+#include "mask.h"
+#include "ringswitch.h"
+#include "compress.h"
+#include "decompress.h"
+#include "stream.h"
+#include "arena.h"
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace lbcrypto;
+
+// End-to-end query benchmark: one setup per (N, s), then repeated warm queries
+// with per-phase latency percentiles, CSV/JSON output and baseline comparison
+
+namespace {
+
+struct E2EOptions {
+    int queries = 20;
+    int warmup = 2;
+    bool stream = false;
+    bool plain_db = false;
+    std::string csv_path;
+    std::string json_path;
+    std::string baseline_path;
+    double threshold = 0.10;   // relative p50 slowdown counted as a regression
+};
+
+struct PhaseResult {
+    int N, s;
+    std::string mode;
+    std::string phase;
+    int queries;
+    double mean_ms, p50_ms, p95_ms, p99_ms;
+    double qps;                // queries per second at the mean latency
+};
+
+double percentile(std::vector<double> samples, double q) {
+    if (samples.empty()) return 0.0;
+    size_t k = std::min(samples.size() - 1, static_cast<size_t>(q * samples.size()));
+    std::nth_element(samples.begin(), samples.begin() + k, samples.end());
+    return samples[k];
+}
+
+std::string modeName(const E2EOptions& options) {
+    std::string mode = options.stream ? "stream" : "phased";
+    return options.plain_db ? mode + "+plaindb" : mode;
+}
+
+// Latencies (ms) per phase, in the order the phases first ran
+class PhaseTimer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    void start() { t_last = Clock::now(); }
+    void lap(const std::string& phase) {
+        auto now = Clock::now();
+        if (samples.find(phase) == samples.end()) order.push_back(phase);
+        samples[phase].push_back(std::chrono::duration<double, std::milli>(now - t_last).count());
+        t_last = now;
+    }
+    void record(const std::string& phase, double ms) {
+        if (samples.find(phase) == samples.end()) order.push_back(phase);
+        samples[phase].push_back(ms);
+    }
+
+    std::vector<std::string> order;
+    std::map<std::string, std::vector<double>> samples;
+
+private:
+    Clock::time_point t_last;
+};
+
+std::vector<PhaseResult> benchConfig(const PDQParams& P, const E2EOptions& options, int& failures) {
+    using Clock = PhaseTimer::Clock;
+
+    auto setup = setupPDQ(P, generateKeySeed());
+    auto& context = setup.context;
+    auto& context_trace = setup.context_trace;
+    std::string keyTag_trace = setup.keypair_trace.publicKey->GetKeyTag();
+
+    auto testData = generateTestData(P);
+    EncryptedDB encryptedDB;
+    PlainDB plainDB;
+    if (options.plain_db) plainDB = encodeDB(P, context, testData);
+    else encryptedDB = encryptDB(P, context, setup.keypair.publicKey, testData);
+    std::set<int64_t> true_indices(testData.matching_indices.begin(), testData.matching_indices.end());
+
+    PhaseTimer timer;
+    for (int q = 0; q < options.warmup + options.queries; q++) {
+        // Client-side query encryption is not part of the server's latency
+        auto ctxt_query = encryptKey(P, context, setup.keypair.publicKey, testData.query_value);
+
+        auto t_query = Clock::now();
+        Ciphertext<DCRTPoly> ctxt_digest;
+        PhaseTimer local;
+        local.start();
+        if (options.stream) {
+            ctxt_digest = options.plain_db
+                ? streamQuery(P, plainDB, ctxt_query, context_trace, keyTag_trace, setup.switch_key, setup.chain)
+                : streamQuery(P, encryptedDB, ctxt_query, context_trace, keyTag_trace,
+                              setup.switch_key, setup.relin_switch_key, setup.chain);
+            local.lap("stream");
+        } else {
+            auto ctxt_index = options.plain_db ? matchPlain(plainDB.keys, ctxt_query)
+                                               : match(encryptedDB.keys, ctxt_query);
+            local.lap("match");
+            auto ctxt_masked = options.plain_db ? maskPlain(plainDB.values, ctxt_index)
+                                                : maskNoRelin(encryptedDB.values, ctxt_index);
+            local.lap("mask");
+            auto index_trace = ringswitch(P, context_trace, keyTag_trace, setup.switch_key,
+                                          ctxt_index, nullptr, setup.chain);
+            auto masked_trace = ringswitch(P, context_trace, keyTag_trace, setup.switch_key,
+                                           ctxt_masked, setup.relin_switch_key, setup.chain);
+            local.lap("ringswitch");
+            ctxt_digest = compress(P, masked_trace, index_trace);
+            local.lap("compress");
+        }
+        auto recovered = recover(P, setup.keypair_trace.secretKey, ctxt_digest);
+        local.lap("decompress");
+        double total_ms = std::chrono::duration<double, std::milli>(Clock::now() - t_query).count();
+
+        if (!checkResult(recovered, testData.values, true_indices)) failures++;
+        if (q < options.warmup) continue;
+        for (const auto& phase : local.order) timer.record(phase, local.samples[phase][0]);
+        timer.record("total", total_ms);
+    }
+
+    std::vector<PhaseResult> results;
+    for (const auto& phase : timer.order) {
+        const auto& samples = timer.samples[phase];
+        double mean = 0;
+        for (double t : samples) mean += t;
+        mean /= samples.size();
+        results.push_back({P.num_records, P.num_matching, modeName(options), phase, static_cast<int>(samples.size()),
+                           mean, percentile(samples, 0.50), percentile(samples, 0.95), percentile(samples, 0.99),
+                           mean > 0 ? 1000.0 / mean : 0.0});
+    }
+
+    // Keys are stored process-wide; drop them and the arena's buffers before
+    // the next configuration
+    QueryArena::local().clear();
+    CryptoContextImpl<DCRTPoly>::ClearEvalMultKeys();
+    CryptoContextImpl<DCRTPoly>::ClearEvalAutomorphismKeys();
+    CryptoContextFactory<DCRTPoly>::ReleaseAllContexts();
+
+    return results;
+}
+
+// =============================================================================
+// Output
+// =============================================================================
+
+const char* CSV_HEADER = "N,s,mode,phase,queries,mean_ms,p50_ms,p95_ms,p99_ms,qps";
+
+void writeCSV(std::ostream& os, const std::vector<PhaseResult>& results) {
+    os << CSV_HEADER << "\n" << std::fixed << std::setprecision(3);
+    for (const auto& r : results)
+        os << r.N << "," << r.s << "," << r.mode << "," << r.phase << "," << r.queries << ","
+           << r.mean_ms << "," << r.p50_ms << "," << r.p95_ms << "," << r.p99_ms << "," << r.qps << "\n";
+}
+
+void writeJSON(std::ostream& os, const std::vector<PhaseResult>& results) {
+    os << "[" << std::fixed << std::setprecision(3);
+    for (size_t i = 0; i < results.size(); i++) {
+        const auto& r = results[i];
+        os << (i ? ",\n " : "\n ")
+           << "{\"N\": " << r.N << ", \"s\": " << r.s << ", \"mode\": \"" << r.mode
+           << "\", \"phase\": \"" << r.phase << "\", \"queries\": " << r.queries
+           << ", \"mean_ms\": " << r.mean_ms << ", \"p50_ms\": " << r.p50_ms
+           << ", \"p95_ms\": " << r.p95_ms << ", \"p99_ms\": " << r.p99_ms
+           << ", \"qps\": " << r.qps << "}";
+    }
+    os << "\n]\n";
+}
+
+void printHeader() {
+    std::cout << std::left << std::setw(12) << "phase"
+              << std::right << std::setw(12) << "mean (ms)"
+              << std::setw(12) << "p50 (ms)"
+              << std::setw(12) << "p95 (ms)"
+              << std::setw(12) << "p99 (ms)"
+              << std::setw(12) << "query/s" << std::endl;
+    std::cout << std::string(72, '-') << std::endl;
+}
+
+void printRow(const PhaseResult& r) {
+    std::cout << std::left << std::setw(12) << r.phase << std::right << std::fixed << std::setprecision(2)
+              << std::setw(12) << r.mean_ms
+              << std::setw(12) << r.p50_ms
+              << std::setw(12) << r.p95_ms
+              << std::setw(12) << r.p99_ms
+              << std::setw(12) << std::setprecision(3) << r.qps << std::endl;
+}
+
+// =============================================================================
+// Baseline comparison
+// =============================================================================
+
+std::string resultKey(int N, int s, const std::string& mode, const std::string& phase) {
+    return std::to_string(N) + "," + std::to_string(s) + "," + mode + "," + phase;
+}
+
+// p50 latencies of a CSV written by --csv, by (N, s, mode, phase)
+std::map<std::string, double> readBaseline(const std::string& path) {
+    std::ifstream is(path);
+    if (!is) throw std::runtime_error("cannot open " + path);
+
+    std::string line;
+    if (!std::getline(is, line) || line != CSV_HEADER)
+        throw std::runtime_error(path + ": not a pdq_e2e CSV file");
+
+    std::map<std::string, double> baseline;
+    while (std::getline(is, line)) {
+        std::vector<std::string> fields;
+        std::istringstream ls(line);
+        for (std::string field; std::getline(ls, field, ',');) fields.push_back(field);
+        if (fields.size() != 10) continue;
+        baseline[resultKey(std::stoi(fields[0]), std::stoi(fields[1]), fields[2], fields[3])] = std::stod(fields[6]);
+    }
+    return baseline;
+}
+
+// Prints the p50 change of every phase present in the baseline; returns the
+// number of regressions beyond the threshold
+int compareBaseline(const std::vector<PhaseResult>& results, const std::string& path, double threshold) {
+    auto baseline = readBaseline(path);
+
+    std::cout << "\n[Baseline " << path << ", threshold +" << threshold * 100 << "% on p50]" << std::endl;
+    int regressions = 0;
+    for (const auto& r : results) {
+        auto it = baseline.find(resultKey(r.N, r.s, r.mode, r.phase));
+        if (it == baseline.end() || it->second <= 0) continue;
+
+        double change = r.p50_ms / it->second - 1.0;
+        bool regressed = change > threshold;
+        regressions += regressed;
+        std::cout << "  N=" << r.N << ", s=" << r.s << " " << std::left << std::setw(12) << r.phase << std::right
+                  << std::fixed << std::setprecision(2) << std::setw(10) << it->second << " -> "
+                  << std::setw(10) << r.p50_ms << " ms  " << std::showpos << std::setprecision(1)
+                  << change * 100 << "%" << std::noshowpos << (regressed ? "  REGRESSION" : "") << std::endl;
+    }
+    return regressions;
+}
+
+void printUsage() {
+    std::cout << "Usage:" << std::endl;
+    std::cout << "  ./pdq_e2e [options]          Benchmark default parameters (defined in global.h)" << std::endl;
+    std::cout << "  ./pdq_e2e N s [options]      Benchmark the specified configuration" << std::endl;
+    std::cout << "  ./pdq_e2e all [options]      Benchmark every configuration in param.cpp" << std::endl;
+    std::cout << "\nOptions:" << std::endl;
+    std::cout << "  --queries Q        Timed queries per configuration (default 20)" << std::endl;
+    std::cout << "  --warmup W         Untimed queries before them (default 2)" << std::endl;
+    std::cout << "  --stream           Use the streaming executor (one 'stream' phase)" << std::endl;
+    std::cout << "  --plain-db         Keep the database in plaintext" << std::endl;
+    std::cout << "  --key-limbs L      Keys of L field-sized limbs" << std::endl;
+    std::cout << "  --csv FILE         Write per-phase results as CSV" << std::endl;
+    std::cout << "  --json FILE        Write per-phase results as JSON" << std::endl;
+    std::cout << "  --baseline FILE    Compare p50 latencies with a CSV from an earlier --csv run;" << std::endl;
+    std::cout << "                     exits with status 2 on a regression" << std::endl;
+    std::cout << "  --threshold PCT    Allowed p50 slowdown in percent (default 10)" << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    E2EOptions options;
+    int key_limbs = 1;
+    std::vector<std::string> positional;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            printUsage();
+            return 0;
+        } else if (strcmp(argv[i], "--queries") == 0 && i + 1 < argc) {
+            options.queries = std::max(1, std::atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc) {
+            options.warmup = std::max(0, std::atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--stream") == 0) {
+            options.stream = true;
+        } else if (strcmp(argv[i], "--plain-db") == 0) {
+            options.plain_db = true;
+        } else if (strcmp(argv[i], "--key-limbs") == 0 && i + 1 < argc) {
+            key_limbs = std::max(1, std::atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--csv") == 0 && i + 1 < argc) {
+            options.csv_path = argv[++i];
+        } else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            options.json_path = argv[++i];
+        } else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+            options.baseline_path = argv[++i];
+        } else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+            options.threshold = std::atof(argv[++i]) / 100.0;
+        } else {
+            positional.push_back(argv[i]);
+        }
+    }
+
+    std::vector<std::pair<int, int>> configs;
+    if (positional.empty()) {
+        PDQParams defaults;
+        configs.push_back({defaults.num_records, defaults.num_matching});
+    } else if (positional.size() == 1 && positional[0] == "all") {
+        configs = availableParams();
+    } else if (positional.size() == 2) {
+        configs.push_back({std::atoi(positional[0].c_str()), std::atoi(positional[1].c_str())});
+    } else {
+        std::cerr << "Error: Invalid arguments. Run './pdq_e2e --help' for usage." << std::endl;
+        return 1;
+    }
+
+    std::vector<PhaseResult> results;
+    int failures = 0;
+    for (const auto& [N, s] : configs) {
+        PDQParams P;
+        P.key_limbs = key_limbs;
+        if (!positional.empty() && !selectParams(P, N, s)) {
+            std::cerr << "Error: Invalid configuration (N=" << N << ", s=" << s << "). "
+                      << "Run './pdq_e2e --help' for usage." << std::endl;
+            return 1;
+        }
+        std::cout << "\n[N=" << N << ", s=" << s << ", " << modeName(options) << ", queries="
+                  << options.queries << ", warmup=" << options.warmup << "]" << std::endl;
+        P.derive();
+        auto config_results = benchConfig(P, options, failures);
+        printHeader();
+        for (const auto& r : config_results) printRow(r);
+        results.insert(results.end(), config_results.begin(), config_results.end());
+    }
+
+    if (!options.csv_path.empty()) {
+        std::ofstream os(options.csv_path);
+        writeCSV(os, results);
+    }
+    if (!options.json_path.empty()) {
+        std::ofstream os(options.json_path);
+        writeJSON(os, results);
+    }
+
+    if (failures > 0) {
+        std::cerr << "\nError: " << failures << " queries returned a wrong result." << std::endl;
+        return 1;
+    }
+    if (!options.baseline_path.empty() && compareBaseline(results, options.baseline_path, options.threshold) > 0)
+        return 2;
+
+    return 0;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "openfhe.h"
+#include "global.h"
+#include "setup.h"
+#include <cstdint>
+#include <vector>
+
+// What a query returns: the matching records (a digest for recover()), or the
+// number of matches or the sum of their values (a digest for recoverAggregate())
+enum class QueryKind : uint32_t { Retrieve = 0, Count = 1, Sum = 2 };
+
+// Aggregates add up slots instead of compressing them: the indicators (COUNT)
+// or masked values (SUM) of all main ciphertexts are added in the main ring,
+// ring-switched once, and the trace ciphertexts added. The ring switch only
+// permutes slots, so folding the slots with power-of-2 rotations leaves the
+// aggregate (mod p) in every slot and no partial sums. There is no BSGS
+// product and no decompression, and the count is not bounded by s.
+
+// Term of one main ciphertext: its match indicators (Count) or its masked
+// values, unrelinearized (Sum)
+lbcrypto::Ciphertext<lbcrypto::DCRTPoly> aggregateTerm(
+    QueryKind kind,
+    const EncryptedKey& ctxt_key,
+    const lbcrypto::Ciphertext<lbcrypto::DCRTPoly>& ctxt_value,
+    const EncryptedKey& ctxt_query);
+
+// Term of main ciphertext c of a plaintext database (PlainDB::keys[c], values[c])
+lbcrypto::Ciphertext<lbcrypto::DCRTPoly> aggregateTermPlain(
+    QueryKind kind,
+    const std::vector<lbcrypto::Plaintext>& ptxt_key,
+    const lbcrypto::DCRTPoly& ptxt_value,
+    const EncryptedKey& ctxt_query);
+
+// Sum of terms, filled one main ciphertext at a time. The first term added
+// becomes the sum and is added to in place, so terms must not be reused.
+struct AggregateAccumulator {
+    lbcrypto::Ciphertext<lbcrypto::DCRTPoly> sum;
+};
+
+void accumulateAggregate(AggregateAccumulator& acc, const lbcrypto::Ciphertext<lbcrypto::DCRTPoly>& term);
+
+// Ring-switch the sum, add the trace ciphertexts, fold the slots and compress
+// to one tower. Digests of disjoint shards add up like retrieval digests.
+// Throws std::invalid_argument unless P was set up with aggregates = 1.
+lbcrypto::Ciphertext<lbcrypto::DCRTPoly> finishAggregate(
+    const PDQParams& P,
+    const AggregateAccumulator& acc,
+    const lbcrypto::CryptoContext<lbcrypto::DCRTPoly>& context_trace,
+    const std::string& keyTag_trace,
+    const lbcrypto::EvalKey<lbcrypto::DCRTPoly>& switch_key,
+    const lbcrypto::EvalKey<lbcrypto::DCRTPoly>& relin_switch_key,
+    const RingSwitchChain& chain = {});
+
+// Aggregate query over an encrypted database (kind is Count or Sum)
+lbcrypto::Ciphertext<lbcrypto::DCRTPoly> aggregateQuery(
+    const PDQParams& P,
+    QueryKind kind,
+    const std::vector<EncryptedKey>& ctxt_keys,
+    const std::vector<lbcrypto::Ciphertext<lbcrypto::DCRTPoly>>& ctxt_values,
+    const EncryptedKey& ctxt_query,
+    const lbcrypto::CryptoContext<lbcrypto::DCRTPoly>& context_trace,
+    const std::string& keyTag_trace,
+    const lbcrypto::EvalKey<lbcrypto::DCRTPoly>& switch_key,
+    const lbcrypto::EvalKey<lbcrypto::DCRTPoly>& relin_switch_key,
+    const RingSwitchChain& chain = {});
+
+// Aggregate query over a plaintext database
+lbcrypto::Ciphertext<lbcrypto::DCRTPoly> aggregateQuery(
+    const PDQParams& P,
+    QueryKind kind,
+    const PlainDB& db,
+    const EncryptedKey& ctxt_query,
+    const lbcrypto::CryptoContext<lbcrypto::DCRTPoly>& context_trace,
+    const std::string& keyTag_trace,
+    const lbcrypto::EvalKey<lbcrypto::DCRTPoly>& switch_key,
+    const RingSwitchChain& chain = {});
+
+// Client side: decrypt and read the total from slot 0, mod p
+int64_t recoverAggregate(
+    const lbcrypto::PrivateKey<lbcrypto::DCRTPoly>& sk,
+    const lbcrypto::Ciphertext<lbcrypto::DCRTPoly>& ctxt_digest);
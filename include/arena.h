@@ -0,0 +1,49 @@
+#pragma once
+
+#include "openfhe.h"
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <vector>
+
+// Per-thread storage reused by the online query phase. Buffers keep their
+// shape (ring dimension and towers) between uses and are only reallocated when
+// it changes, so a worker answering queries of one parameter set stops
+// allocating polynomials in the code paths that use the arena. OpenFHE's own
+// operations (EvalMult, EvalRotate, ...) still allocate their results.
+class QueryArena {
+public:
+    using Params = lbcrypto::ILDCRTParams<lbcrypto::BigInteger>;
+
+    // The calling thread's arena
+    static QueryArena& local();
+
+    // Scratch polynomial `slot`, shaped like params and tagged with format;
+    // its contents are unspecified. Valid until the next call with that slot:
+    // taking other slots (even new ones) does not move it.
+    lbcrypto::DCRTPoly& scratch(size_t slot, const std::shared_ptr<Params>& params, lbcrypto::Format format);
+
+    // A ciphertext of context with `elements` polynomials shaped like params
+    // (contents unspecified, fresh metadata). It is recycled from an earlier
+    // call once every holder of it has dropped it; at most the reservePool()
+    // limit of ciphertexts are kept for reuse.
+    lbcrypto::Ciphertext<lbcrypto::DCRTPoly> ciphertext(
+        const lbcrypto::CryptoContext<lbcrypto::DCRTPoly>& context,
+        const std::shared_ptr<Params>& params,
+        size_t elements);
+
+    // Keep up to count ciphertexts for reuse. The limit only grows, so workers
+    // shared by databases with different parameters fit the largest of them.
+    void reservePool(size_t count);
+
+    // Drop all buffers (e.g. after a parameter change)
+    void clear();
+
+private:
+    std::deque<lbcrypto::DCRTPoly> scratch_polys;   // grows without moving earlier slots
+    std::vector<lbcrypto::Ciphertext<lbcrypto::DCRTPoly>> pool;
+    size_t pool_limit = 0;
+};
+
+// dst = src limb by limb, without reallocating dst (same shape required)
+void copyLimbs(lbcrypto::DCRTPoly& dst, const lbcrypto::DCRTPoly& src);
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+// Little helpers for the fixed-layout binary files written by PDQ
+
+inline void writeU32(std::ostream& os, uint32_t v) {
+    os.write(reinterpret_cast<const char*>(&v), sizeof(v));
+}
+
+inline uint32_t readU32(std::istream& is) {
+    uint32_t v = 0;
+    is.read(reinterpret_cast<char*>(&v), sizeof(v));
+    if (!is) throw std::runtime_error("unexpected end of stream");
+    return v;
+}
+
+inline void writeString(std::ostream& os, const std::string& s) {
+    writeU32(os, static_cast<uint32_t>(s.size()));
+    os.write(s.data(), s.size());
+}
+
+inline std::string readString(std::istream& is) {
+    std::string s(readU32(is), '\0');
+    is.read(&s[0], s.size());
+    if (!is) throw std::runtime_error("unexpected end of stream");
+    return s;
+}
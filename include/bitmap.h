@@ -0,0 +1,80 @@
+#pragma once
+
+#include "openfhe.h"
+#include "global.h"
+#include "setup.h"
+#include <cstdint>
+#include <vector>
+
+// Bitmap index of a low-cardinality key column (a status, a category): per
+// main ciphertext, one 0/1 bitmap per distinct key. The client encrypts a
+// one-hot selection over the public dictionary of keys, and the match
+// indicators are the dot product of the selection with the bitmaps: one
+// multiply per distinct key instead of the Fermat equality check, and no
+// depth beyond one level (encrypted bitmaps) or none (plaintext bitmaps).
+// The indicators feed mask() and compress() like those of match().
+
+// Distinct keys of the data, sorted: the dictionary of its bitmap index
+std::vector<uint64_t> keyDictionary(const TestData& data);
+
+// Encrypted bitmaps, bitmaps[c][v] for main ciphertext c of a DB with the
+// given records (EncryptedDB::records) and dictionary entry v
+struct EncryptedBitmapIndex {
+    std::vector<uint64_t> dictionary;
+    std::vector<std::vector<lbcrypto::Ciphertext<lbcrypto::DCRTPoly>>> bitmaps;
+};
+
+EncryptedBitmapIndex encryptBitmapIndex(
+    const PDQParams& P,
+    const lbcrypto::CryptoContext<lbcrypto::DCRTPoly>& context,
+    const lbcrypto::PublicKey<lbcrypto::DCRTPoly>& publicKey,
+    const TestData& data,
+    const std::vector<uint64_t>& dictionary,
+    const std::vector<CtxtRecords>& records);
+
+// Plaintext bitmaps as EVALUATION-form polynomials. Server-owned data need not
+// hide which keys a ciphertext holds, so only the non-empty bitmaps of each
+// main ciphertext are kept: bitmaps[c][j] belongs to entry value_ids[c][j].
+struct PlainBitmapIndex {
+    std::vector<uint64_t> dictionary;
+    std::vector<std::vector<int>> value_ids;
+    std::vector<std::vector<lbcrypto::DCRTPoly>> bitmaps;
+};
+
+PlainBitmapIndex encodeBitmapIndex(
+    const PDQParams& P,
+    const lbcrypto::CryptoContext<lbcrypto::DCRTPoly>& context,
+    const TestData& data,
+    const std::vector<uint64_t>& dictionary,
+    const std::vector<CtxtRecords>& records);
+
+// Client side: one ciphertext per dictionary entry, every slot 1 for the
+// entries in keys and 0 otherwise. Several keys give an IN-list at no extra
+// cost, since the bitmaps of distinct keys are disjoint. Throws
+// std::invalid_argument for a key that is not in the dictionary.
+std::vector<lbcrypto::Ciphertext<lbcrypto::DCRTPoly>> encryptSelection(
+    const PDQParams& P,
+    const lbcrypto::CryptoContext<lbcrypto::DCRTPoly>& context,
+    const lbcrypto::PublicKey<lbcrypto::DCRTPoly>& publicKey,
+    const std::vector<uint64_t>& dictionary,
+    const std::vector<uint64_t>& keys);
+
+// Index indicators of one main ciphertext: the tensor products are summed
+// unrelinearized and relinearized once
+lbcrypto::Ciphertext<lbcrypto::DCRTPoly> matchBitmap(
+    const std::vector<lbcrypto::Ciphertext<lbcrypto::DCRTPoly>>& ctxt_bitmaps,
+    const std::vector<lbcrypto::Ciphertext<lbcrypto::DCRTPoly>>& ctxt_selection);
+
+// Plaintext bitmaps of one main ciphertext: plaintext multiplies only
+lbcrypto::Ciphertext<lbcrypto::DCRTPoly> matchBitmapPlain(
+    const std::vector<int>& value_ids,
+    const std::vector<lbcrypto::DCRTPoly>& ptxt_bitmaps,
+    const std::vector<lbcrypto::Ciphertext<lbcrypto::DCRTPoly>>& ctxt_selection);
+
+// Indicators of all main ciphertexts, in place of match() / matchPlain()
+std::vector<lbcrypto::Ciphertext<lbcrypto::DCRTPoly>> matchBitmap(
+    const EncryptedBitmapIndex& index,
+    const std::vector<lbcrypto::Ciphertext<lbcrypto::DCRTPoly>>& ctxt_selection);
+std::vector<lbcrypto::Ciphertext<lbcrypto::DCRTPoly>> matchBitmapPlain(
+    const PlainBitmapIndex& index,
+    const std::vector<lbcrypto::Ciphertext<lbcrypto::DCRTPoly>>& ctxt_selection);
@@ -1,9 +1,89 @@
 #pragma once
 
 #include "openfhe.h"
+#include "global.h"
+#include "setup.h"
 #include <vector>
 
+// BSGS plaintexts of trace ciphertext i: column[g_][b], EVALUATION form over `towers` towers.
+// They are the diagonals of the Vandermonde matrix C[j][i] = (i+1)^(j+1) mod p,
+// j < s, i < N, generated directly per diagonal (C itself is never stored).
+using BSGSColumn = std::vector<std::vector<lbcrypto::DCRTPoly>>;
+// All columns: ptxts[i][g_][b]
+using BSGSPlaintexts = std::vector<BSGSColumn>;
+
+// Column of trace ciphertext trace_idx of a main ciphertext holding `records`.
+// Serial: the streaming executor and the query server call it from their own
+// worker threads, after the packed-encoding tables have been built.
+BSGSColumn precomputeBSGSColumn(
+    const PDQParams& P,
+    const lbcrypto::CryptoContext<lbcrypto::DCRTPoly>& context,
+    size_t towers,
+    const CtxtRecords& records,
+    int trace_idx);
+
+// Column of trace ciphertext i of the default layout
+BSGSColumn precomputeBSGSColumn(
+    const PDQParams& P,
+    const lbcrypto::CryptoContext<lbcrypto::DCRTPoly>& context,
+    size_t towers,
+    int i);
+
+// Columns of the main ciphertexts holding records[0], records[1], ... (OpenMP)
+BSGSPlaintexts precomputeBSGSPlaintexts(
+    const PDQParams& P,
+    const lbcrypto::CryptoContext<lbcrypto::DCRTPoly>& context,
+    size_t towers,
+    const std::vector<CtxtRecords>& records);
+
+BSGSPlaintexts precomputeBSGSPlaintexts(
+    const PDQParams& P,
+    const lbcrypto::CryptoContext<lbcrypto::DCRTPoly>& context,
+    size_t towers);
+
+// Giant-step sums giant[g_] of a BSGS product, filled one trace ciphertext at a time
+struct BSGSAccumulator {
+    std::vector<lbcrypto::Ciphertext<lbcrypto::DCRTPoly>> giant;
+};
+
+void accumulateBSGS(
+    const PDQParams& P,
+    BSGSAccumulator& acc,
+    const lbcrypto::Ciphertext<lbcrypto::DCRTPoly>& ctxt,
+    const BSGSColumn& column);
+
+// into += from (giant-step sums are additive over trace ciphertexts)
+void mergeBSGS(BSGSAccumulator& into, const BSGSAccumulator& from);
+
+lbcrypto::Ciphertext<lbcrypto::DCRTPoly> finishBSGS(const PDQParams& P, const BSGSAccumulator& acc);
+
+// BSGS matrix-vector multiply of ring-switched ciphertexts with C
+lbcrypto::Ciphertext<lbcrypto::DCRTPoly> evalBSGS(
+    const PDQParams& P,
+    const std::vector<lbcrypto::Ciphertext<lbcrypto::DCRTPoly>>& ctxt_v,
+    const BSGSPlaintexts& ptxts);
+
+// Mask the BSGS outputs of the values (e) and indices (w) into one digest, then
+// compress it to one tower. digest_full receives it before that compression.
+lbcrypto::Ciphertext<lbcrypto::DCRTPoly> combineDigests(
+    const PDQParams& P,
+    const lbcrypto::Ciphertext<lbcrypto::DCRTPoly>& ctxt_e,
+    const lbcrypto::Ciphertext<lbcrypto::DCRTPoly>& ctxt_w,
+    lbcrypto::Ciphertext<lbcrypto::DCRTPoly>* digest_full = nullptr);
+
 // Compress ring-switched ciphertexts into single digest with power sums and weighted sums
+// If digest_full is given, it receives the digest before the final tower compression.
+// The inputs are the trace ciphertexts of the main ciphertexts holding records[0], ...
+lbcrypto::Ciphertext<lbcrypto::DCRTPoly> compress(
+    const PDQParams& P,
+    const std::vector<CtxtRecords>& records,
+    const std::vector<lbcrypto::Ciphertext<lbcrypto::DCRTPoly>>& ctxt_masked,
+    const std::vector<lbcrypto::Ciphertext<lbcrypto::DCRTPoly>>& ctxt_index,
+    lbcrypto::Ciphertext<lbcrypto::DCRTPoly>* digest_full = nullptr);
+
+// Default layout: all P.num_ctxts main ciphertexts
 lbcrypto::Ciphertext<lbcrypto::DCRTPoly> compress(
+    const PDQParams& P,
     const std::vector<lbcrypto::Ciphertext<lbcrypto::DCRTPoly>>& ctxt_masked,
-    const std::vector<lbcrypto::Ciphertext<lbcrypto::DCRTPoly>>& ctxt_index);
+    const std::vector<lbcrypto::Ciphertext<lbcrypto::DCRTPoly>>& ctxt_index,
+    lbcrypto::Ciphertext<lbcrypto::DCRTPoly>* digest_full = nullptr);
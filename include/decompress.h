@@ -1,14 +1,34 @@
 #pragma once
 
 #include "openfhe.h"
+#include "global.h"
 #include <vector>
 #include <set>
 
-// Full decompression: decrypt and recover from combined digest
+// Recover the index set from power sums w[k] = sum (i+1)^(k+1)
+std::set<int64_t> decompressIndex(const PDQParams& P, const std::vector<int64_t>& w);
+
+// Recover values from weighted sums e and the index set (transposed Björck-Pereyra)
+std::vector<std::pair<int64_t, int64_t>> reconstruct(
+    const PDQParams& P,
+    const std::vector<int64_t>& e,
+    const std::set<int64_t>& index_set);
+
+// Full decompression: decrypt and recover from combined digest (the query of
+// slot block 0 in the replicated layout)
 std::vector<std::pair<int64_t, int64_t>> recover(
+    const PDQParams& P,
     const lbcrypto::PrivateKey<lbcrypto::DCRTPoly>& sk,
     const lbcrypto::Ciphertext<lbcrypto::DCRTPoly>& ctxt_digest);
 
+// Replicated layout: the records matching the key of each of the first
+// num_blocks slot blocks (encryptKeys()), from their digest windows
+std::vector<std::vector<std::pair<int64_t, int64_t>>> recoverBlocks(
+    const PDQParams& P,
+    const lbcrypto::PrivateKey<lbcrypto::DCRTPoly>& sk,
+    const lbcrypto::Ciphertext<lbcrypto::DCRTPoly>& ctxt_digest,
+    int num_blocks);
+
 // Verify correctness against ground truth
 bool checkResult(
     const std::vector<std::pair<int64_t, int64_t>>& recovered,
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "server.h"
+#include <atomic>
+#include <string>
+
+// Local Unix-socket front end of a QueryBackend.
+// Every message is a frame: u32 length, then the payload.
+//   request:  u32 RequestType, then (Query) u32 QueryKind, u32 number of key
+//             limbs and the query ciphertexts in raw wire format (wire.h)
+//   response: u32 QueryStatus, then the digest in raw wire format (Query), the
+//             metrics JSON (Stats) or an error message
+// Ciphertexts are sent with one gather write from their limbs and received
+// directly into preallocated polynomials.
+
+enum class RequestType : uint32_t { Query = 1, Stats = 2 };
+
+// Bounds every request is checked against before anything is allocated for
+// it; a larger frame closes the connection, more key limbs fail the query
+struct FrontendLimits {
+    uint32_t max_key_limbs = 1;          // query ciphertexts of a Query request
+    size_t max_frame_bytes = 1 << 20;    // payload of any request
+};
+
+// Limits for queries of a database with parameters P (derived) and main
+// context `context`: key_limbs ciphertexts of at most 3 polynomials over all
+// towers. For several databases take the largest of each field.
+FrontendLimits queryLimits(const PDQParams& P, const lbcrypto::CryptoContext<lbcrypto::DCRTPoly>& context);
+
+// Accept connections on path until stop is set, one thread per connection
+void serveUnixSocket(QueryBackend& backend, const std::string& path, const FrontendLimits& limits,
+                     const std::atomic<bool>& stop);
+
+// Client side; the functions throw std::runtime_error on connection errors
+int connectUnixSocket(const std::string& path);
+QueryResult remoteQuery(int fd, const EncryptedKey& ctxt_query, QueryKind kind = QueryKind::Retrieve);
+// remoteQuery in two halves, to have several requests in flight on different sockets
+void sendQuery(int fd, const EncryptedKey& ctxt_query, QueryKind kind = QueryKind::Retrieve);
+QueryResult receiveResult(int fd);
+std::string remoteStats(int fd);
@@ -1,25 +1,55 @@
 #pragma once
 
-// PDQ parameters
-extern int num_records;          // N: total records
-extern int num_matching;         // s: max matching records
-
-// BFV context parameters
-extern int ptxt_modulus;         // p: plaintext modulus
-extern int degree;               // n: ring dimension
-extern int MultiplicativeDepth;
-extern int ScalingModSize;
-extern int NumLargeDigits;
-
-// Trace context parameters
-extern int degree_trace;         // n': ring dimension after ring-switch
-extern int MultiplicativeDepth_trace;
-extern int NumLargeDigits_trace;
-
-// Derived parameters (computed at runtime)
-extern int degree_half;
-extern int degree_trace_half;
-extern int dim_trace;            // degree / degree_trace
-extern int num_ctxts;            // ceil(num_records / degree)
-extern int numrow_po2;           // next power of 2 >= num_matching
-extern int b_bsgs, g_bsgs;       // BSGS parameters for compress
+#include <memory>
+
+struct PDQCaches;  // setup.h
+
+// Parameters of one PDQ database. Every function that depends on them takes
+// the PDQParams of the database it works on, so databases with different
+// parameters can be set up and served side by side in one process.
+struct PDQParams {
+    // PDQ parameters
+    int num_records = 16384;          // N: total records
+    int num_matching = 16;            // s: max matching records
+    int key_limbs = 1;                // field-sized limbs per key (keys of key_limbs * limb_bits bits)
+    int in_keys = 1;                  // k: most candidate keys of an IN-list query
+    int replicas = 1;                 // R: copies of the DB in slot blocks of one main ciphertext (power of 2)
+    int distinct_keys = 0;            // test data: keys drawn from 0..distinct_keys-1 (0 = the whole key range)
+    int aggregates = 0;               // 1: also generate the rotation keys that fold COUNT/SUM digests
+
+    // BFV context parameters
+    int ptxt_modulus = 65537;         // p: plaintext modulus
+    int degree = 32768;               // n: ring dimension
+    int MultiplicativeDepth = 18;
+    int ScalingModSize = 60;
+    int NumLargeDigits = 4;
+
+    // Trace context parameters
+    int degree_trace = 8192;          // n': ring dimension after ring-switch
+    int MultiplicativeDepth_trace = 1;
+    int NumLargeDigits_trace = 2;
+    int towers_bsgs = 0;              // trace towers kept for compress (0 = all, -1 = minBsgsTowers())
+    int ringswitch_ratio = 0;         // ring dimension ratio per ring switch (0 = one switch by dim_trace)
+
+    // Derived parameters (computed by derive())
+    int degree_half = 0;
+    int degree_trace_half = 0;
+    int dim_trace = 0;                // degree / degree_trace
+    int num_ctxts = 0;                // ceil(num_records / degree)
+    int numrow_po2 = 0;               // next power of 2 >= num_matching
+    int block_size = 0;               // degree / replicas: slots of one DB copy
+    int digest_rows = 0;              // replicas * numrow_po2: BSGS rows, one window per block
+    int b_bsgs = 0, g_bsgs = 0;       // BSGS parameters for compress
+    int limb_bits = 0;                // bits per key limb: largest b with 2^b < ptxt_modulus
+    int limb_depth = 0;               // ceil(log2 key_limbs): levels of the limb product tree
+    int in_depth = 0;                 // ceil(log2 in_keys): levels of the candidate product tree
+
+    // Precomputations that depend on the parameters above (twiddles). Copies
+    // share them; derive() starts an empty set.
+    std::shared_ptr<PDQCaches> caches;
+
+    // Compute the derived parameters; call again after changing any of the above.
+    // Throws std::invalid_argument if the replicas or distinct_keys do not fit,
+    // or ringswitch_ratio is not a power of 2.
+    void derive();
+};
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "global.h"
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Homomorphic operations counted per phase
+enum class Op {
+    EvalMult,        // ciphertext-ciphertext multiply
+    EvalMultPlain,   // plaintext-ciphertext multiply
+    Relin,           // relinearization
+    Rotate,          // slot rotation
+    KeySwitch,       // key switch (including those inside Relin and Rotate)
+    PdqNTT,          // per-limb NTT/INTT issued by PDQ kernels only; those inside
+                     // OpenFHE's multiplies, rotations and key switches are not counted
+    Encode,          // plaintext encoding
+    Count
+};
+
+constexpr int NUM_OPS = static_cast<int>(Op::Count);
+
+const char* opName(Op op);
+
+// Count n occurrences of op (thread-safe; each thread has its own counters)
+void countOp(Op op, uint64_t n = 1);
+
+// Count one allocation of the given size. Called by the replacement allocation
+// functions of src/alloccount.cpp, linked only with -DPDQ_COUNT_ALLOCS=ON.
+void countAlloc(uint64_t bytes);
+
+// Metrics of one recorded phase
+struct PhaseMetrics {
+    std::string name;
+    uint64_t ops[NUM_OPS];
+    double wall_sec;
+    double cpu_sec;           // process CPU time (all threads)
+    uint64_t alloc_bytes;     // bytes requested from operator new (PDQ_COUNT_ALLOCS only)
+    uint64_t alloc_count;
+    uint64_t peak_rss_kb;     // process high-water mark at the end of the phase
+};
+
+// Phases may nest; each records deltas between its begin and end of the
+// counters of all threads, so concurrent phases count each other's work
+void beginPhase(const std::string& name);
+void endPhase();
+
+struct PhaseScope {
+    explicit PhaseScope(const std::string& name) { beginPhase(name); }
+    ~PhaseScope() { endPhase(); }
+    PhaseScope(const PhaseScope&) = delete;
+    PhaseScope& operator=(const PhaseScope&) = delete;
+};
+
+std::vector<PhaseMetrics> recordedPhases();
+void resetMetrics();
+
+// Export all recorded phases (and the parameters they ran with) as JSON
+void writeMetricsJSON(std::ostream& os, const PDQParams& P);
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "openfhe.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Fused modular multiply-accumulate over raw limbs:
+//   acc[k] = (acc[k] + a[k] * b[k]) mod q,  k < n
+// Inputs must be reduced mod q, and q < 2^62. The implementation is chosen once
+// per process: HEXL (when OpenFHE is built with it), AVX-512, AVX2 or scalar.
+void mulAddMod(uint64_t* acc, const uint64_t* a, const uint64_t* b, size_t n, uint64_t q);
+
+// acc += a * b tower by tower, in place and without a temporary polynomial.
+// All three must be in EVALUATION form over the same towers.
+void mulAddInPlace(lbcrypto::DCRTPoly& acc, const lbcrypto::DCRTPoly& a, const lbcrypto::DCRTPoly& b);
+
+// Name of the selected implementation. PDQ_KERNEL=scalar|avx2|avx512 forces a
+// path (if the CPU supports it), e.g. to compare them in pdq_bench.
+const char* mulAddKernel();
+
+// Implementations this build and CPU can run, best first (the selected one
+// among them), and mulAddMod through one of them by name, for self-checks
+std::vector<const char*> mulAddKernels();
+void mulAddModWith(const char* name, uint64_t* acc, const uint64_t* a, const uint64_t* b, size_t n, uint64_t q);
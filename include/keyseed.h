@@ -0,0 +1,67 @@
+#pragma once
+
+#include "openfhe.h"
+#include <array>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// 256-bit seed from which the uniform halves of evaluation keys are expanded
+using KeySeed = std::array<uint8_t, 32>;
+
+KeySeed generateKeySeed();
+
+// Seeded key generation (client-side): same keys as EvalMultKeyGen, EvalRotateKeyGen
+// and KeySwitchGen, except that the uniform a-halves are expanded from seed.
+// Relinearization keys of different rings and switch keys of different
+// ring-switch levels use different indices. Rotation keys need the context's
+// MULTIPARTY feature (enableFeatures()).
+void seededEvalMultKeyGen(
+    const lbcrypto::PrivateKey<lbcrypto::DCRTPoly>& sk,
+    const KeySeed& seed,
+    uint32_t index = 0);
+
+void seededEvalRotateKeyGen(
+    const lbcrypto::PrivateKey<lbcrypto::DCRTPoly>& sk,
+    const std::vector<int32_t>& rotIndices,
+    const KeySeed& seed);
+
+lbcrypto::EvalKey<lbcrypto::DCRTPoly> seededKeySwitchGen(
+    const lbcrypto::PrivateKey<lbcrypto::DCRTPoly>& sk_old,
+    const lbcrypto::PrivateKey<lbcrypto::DCRTPoly>& sk_new,
+    const KeySeed& seed,
+    uint32_t index = 0);
+
+// Switch key from sk_old^2 to sk_new, so that the third component of an
+// unrelinearized ciphertext can be switched together with the second
+lbcrypto::EvalKey<lbcrypto::DCRTPoly> seededRelinSwitchKeyGen(
+    const lbcrypto::PrivateKey<lbcrypto::DCRTPoly>& sk_old,
+    const lbcrypto::PrivateKey<lbcrypto::DCRTPoly>& sk_new,
+    const KeySeed& seed);
+
+// Seed-compressed serialization: only the b-halves and the seed are written
+void serializeSeededEvalMultKey(std::ostream& os, const std::string& keyTag, const KeySeed& seed);
+void serializeSeededRotKeys(std::ostream& os, const std::string& keyTag, const KeySeed& seed);
+void serializeSeededSwitchKey(std::ostream& os,
+                              const lbcrypto::EvalKey<lbcrypto::DCRTPoly>& switch_key,
+                              const KeySeed& seed);
+void serializeSeededRelinSwitchKey(std::ostream& os,
+                                   const lbcrypto::EvalKey<lbcrypto::DCRTPoly>& relin_switch_key,
+                                   const KeySeed& seed);
+
+// Server-side: regenerate the a-halves from the seed and install the keys into context.
+// The installed keys are full size (OpenFHE's key switching needs both halves);
+// the key upload and the persisted server state (store.h) hold them seeded.
+void deserializeSeededEvalMultKey(std::istream& is,
+                                  const lbcrypto::CryptoContext<lbcrypto::DCRTPoly>& context,
+                                  uint32_t index = 0);
+void deserializeSeededRotKeys(std::istream& is,
+                              const lbcrypto::CryptoContext<lbcrypto::DCRTPoly>& context_trace);
+lbcrypto::EvalKey<lbcrypto::DCRTPoly> deserializeSeededSwitchKey(
+    std::istream& is,
+    const lbcrypto::CryptoContext<lbcrypto::DCRTPoly>& context,
+    uint32_t index = 0);
+lbcrypto::EvalKey<lbcrypto::DCRTPoly> deserializeSeededRelinSwitchKey(
+    std::istream& is,
+    const lbcrypto::CryptoContext<lbcrypto::DCRTPoly>& context);
@@ -1,9 +1,48 @@
 #pragma once
 
 #include "openfhe.h"
+#include "setup.h"
 #include <vector>
 
 // Mask values with index indicators
 std::vector<lbcrypto::Ciphertext<lbcrypto::DCRTPoly>> mask(
     const std::vector<lbcrypto::Ciphertext<lbcrypto::DCRTPoly>>& ctxt_values,
     const std::vector<lbcrypto::Ciphertext<lbcrypto::DCRTPoly>>& ctxt_index);
+
+// As mask(), but the products are left unrelinearized (3 components);
+// ringswitch() relinearizes them as part of its key switch
+std::vector<lbcrypto::Ciphertext<lbcrypto::DCRTPoly>> maskNoRelin(
+    const std::vector<lbcrypto::Ciphertext<lbcrypto::DCRTPoly>>& ctxt_values,
+    const std::vector<lbcrypto::Ciphertext<lbcrypto::DCRTPoly>>& ctxt_index);
+
+// Fused match and mask of one main ciphertext; masked is unrelinearized
+struct MatchMask {
+    lbcrypto::Ciphertext<lbcrypto::DCRTPoly> index;
+    lbcrypto::Ciphertext<lbcrypto::DCRTPoly> masked;
+};
+
+MatchMask matchMask(
+    const EncryptedKey& ctxt_key,
+    const lbcrypto::Ciphertext<lbcrypto::DCRTPoly>& ctxt_value,
+    const EncryptedKey& ctxt_query);
+
+// Mask with a plaintext database (PlainDB::values): a plaintext multiply, so
+// no relinearization and no depth
+std::vector<lbcrypto::Ciphertext<lbcrypto::DCRTPoly>> maskPlain(
+    const std::vector<lbcrypto::DCRTPoly>& ptxt_values,
+    const std::vector<lbcrypto::Ciphertext<lbcrypto::DCRTPoly>>& ctxt_index);
+
+// Trace-ring masking: values_trace (EncryptedDB::values_trace) times the
+// ring-switched indicators index_trace, both at all trace towers
+// (ringswitch() with allTraceTowers(P)). The products are relinearized with the
+// trace key; they and index_trace are then dropped to bsgsTowers(P) for compress.
+std::vector<lbcrypto::Ciphertext<lbcrypto::DCRTPoly>> maskTrace(
+    const PDQParams& P,
+    const std::vector<lbcrypto::Ciphertext<lbcrypto::DCRTPoly>>& values_trace,
+    std::vector<lbcrypto::Ciphertext<lbcrypto::DCRTPoly>>& index_trace);
+
+// Fused match and mask of one main ciphertext of a plaintext database
+MatchMask matchMaskPlain(
+    const std::vector<lbcrypto::Plaintext>& ptxt_key,
+    const lbcrypto::DCRTPoly& ptxt_value,
+    const EncryptedKey& ctxt_query);
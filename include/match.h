@@ -1,9 +1,51 @@
 #pragma once
 
 #include "openfhe.h"
+#include "setup.h"
 #include <vector>
 
+// Equality indicator 1 - x^(p-1) of each slot of ctxt
+lbcrypto::Ciphertext<lbcrypto::DCRTPoly> equalityCheck(
+    const lbcrypto::Ciphertext<lbcrypto::DCRTPoly>& ctxt);
+
+// Key equality from the per-limb differences: the product of their
+// equalityCheck indicators (limb_depth extra levels)
+lbcrypto::Ciphertext<lbcrypto::DCRTPoly> keyEquality(
+    std::vector<lbcrypto::Ciphertext<lbcrypto::DCRTPoly>> diffs);
+
+// Index indicators of one main ciphertext of keys (encrypted or PlainDB::keys[c])
+lbcrypto::Ciphertext<lbcrypto::DCRTPoly> matchKey(
+    const EncryptedKey& ctxt_key,
+    const EncryptedKey& ctxt_query);
+lbcrypto::Ciphertext<lbcrypto::DCRTPoly> matchKeyPlain(
+    const std::vector<lbcrypto::Plaintext>& ptxt_key,
+    const EncryptedKey& ctxt_query);
+
 // Match query against encrypted database
 std::vector<lbcrypto::Ciphertext<lbcrypto::DCRTPoly>> match(
-    const std::vector<lbcrypto::Ciphertext<lbcrypto::DCRTPoly>>& ctxt_db,
-    const lbcrypto::Ciphertext<lbcrypto::DCRTPoly>& ctxt_query);
+    const std::vector<EncryptedKey>& ctxt_db,
+    const EncryptedKey& ctxt_query);
+
+// Match query against a plaintext database (PlainDB::keys)
+std::vector<lbcrypto::Ciphertext<lbcrypto::DCRTPoly>> matchPlain(
+    const std::vector<std::vector<lbcrypto::Plaintext>>& ptxt_db,
+    const EncryptedKey& ctxt_query);
+
+// IN-list: indicators of "key is one of the k query keys", k <= P.in_keys.
+// Single-limb keys take the product of the k differences (in_depth levels)
+// and one equality check. Wide keys need every limb of one candidate to match,
+// which a product of differences cannot express, so their k key equalities are
+// combined as 1 - prod(1 - e_j), at the same depth.
+lbcrypto::Ciphertext<lbcrypto::DCRTPoly> matchKey(
+    const EncryptedKey& ctxt_key,
+    const std::vector<EncryptedKey>& ctxt_queries);
+lbcrypto::Ciphertext<lbcrypto::DCRTPoly> matchKeyPlain(
+    const std::vector<lbcrypto::Plaintext>& ptxt_key,
+    const std::vector<EncryptedKey>& ctxt_queries);
+
+std::vector<lbcrypto::Ciphertext<lbcrypto::DCRTPoly>> match(
+    const std::vector<EncryptedKey>& ctxt_db,
+    const std::vector<EncryptedKey>& ctxt_queries);
+std::vector<lbcrypto::Ciphertext<lbcrypto::DCRTPoly>> matchPlain(
+    const std::vector<std::vector<lbcrypto::Plaintext>>& ptxt_db,
+    const std::vector<EncryptedKey>& ctxt_queries);
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+
+// Arithmetic modulo the plaintext modulus p for the hot scalar kernels. Kernels
+// are templates over a Mod policy and are entered through withPlainModulus(),
+// which instantiates them with p as a compile-time constant for the shipped
+// moduli and falls back to RuntimeMod otherwise.
+//   mod.p            the modulus
+//   mod.reduce(x)    x mod p, for x < p^2 (a product of two reduced values)
+//   mod.mul(a, b)    a * b mod p, for a, b < p
+
+// p known at compile time: the compiler turns % into a multiply and shifts
+template <uint64_t P>
+struct ConstMod {
+    static constexpr uint64_t p = P;
+    uint64_t reduce(uint64_t x) const { return x % P; }
+    uint64_t mul(uint64_t a, uint64_t b) const { return reduce(a * b); }
+};
+
+// Fermat prime p = 2^16 + 1: 2^16 = -1 (mod p), so hi * 2^16 + lo = lo - hi.
+// Two folds bring x < 2^34 below 2p.
+template <>
+struct ConstMod<65537> {
+    static constexpr uint64_t p = 65537;
+    uint64_t reduce(uint64_t x) const {
+        uint64_t r = (x & 0xffff) + 4 * p - (x >> 16);   // < 5p
+        r = (r & 0xffff) + p - (r >> 16);                // < 2p
+        return r >= p ? r - p : r;
+    }
+    uint64_t mul(uint64_t a, uint64_t b) const { return reduce(a * b); }
+};
+
+struct RuntimeMod {
+    uint64_t p;
+    uint64_t reduce(uint64_t x) const { return x % p; }
+    uint64_t mul(uint64_t a, uint64_t b) const { return reduce(a * b); }
+};
+
+template <class Mod>
+uint64_t powMod(const Mod& mod, uint64_t base, uint64_t exp) {
+    uint64_t result = 1;
+    base %= mod.p;
+    while (exp > 0) {
+        if (exp & 1) result = mod.mul(result, base);
+        base = mod.mul(base, base);
+        exp >>= 1;
+    }
+    return result;
+}
+
+// a^-1 mod p (p prime)
+template <class Mod>
+uint64_t invMod(const Mod& mod, uint64_t a) {
+    if (a % mod.p == 0) throw std::domain_error("inverse of zero mod p");
+    return powMod(mod, a, mod.p - 2);
+}
+
+// f(mod) with the Mod policy for plaintext modulus p
+template <class F>
+decltype(auto) withPlainModulus(int64_t p, F&& f) {
+    switch (p) {
+        case 65537:  return f(ConstMod<65537>{});
+        case 786433: return f(ConstMod<786433>{});
+        default:     return f(RuntimeMod{static_cast<uint64_t>(p)});
+    }
+}
+
+// Ring-switch dimension d as a compile-time constant for the shipped d = 4
+// (std::integral_constant) or a runtime value; both convert to int
+struct RuntimeDim {
+    int value;
+    constexpr operator int() const { return value; }
+};
+
+template <class F>
+decltype(auto) withSwitchDim(int dim, F&& f) {
+    switch (dim) {
+        case 4:  return f(std::integral_constant<int, 4>{});
+        default: return f(RuntimeDim{dim});
+    }
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "openfhe.h"
+#include <vector>
+
+// Noise measurement for parameter tuning. Needs the secret key, so it is only
+// meant for testing (./test --noise), never for the server.
+
+// Budget kept in reserve when recommending parameters
+constexpr int noise_margin_bits = 20;
+
+// Remaining noise budget of ct in bits (decryption fails once it reaches 0).
+// Works on ciphertexts with fewer towers than the key, and on unrelinearized ones.
+int noiseBudget(
+    const lbcrypto::PrivateKey<lbcrypto::DCRTPoly>& sk,
+    const lbcrypto::Ciphertext<lbcrypto::DCRTPoly>& ct);
+
+// Smallest budget over ctxts
+int minNoiseBudget(
+    const lbcrypto::PrivateKey<lbcrypto::DCRTPoly>& sk,
+    const std::vector<lbcrypto::Ciphertext<lbcrypto::DCRTPoly>>& ctxts);
+
+// Average modulus size of ct's towers in bits
+double bitsPerTower(const lbcrypto::Ciphertext<lbcrypto::DCRTPoly>& ct);
@@ -1,16 +1,27 @@
 #pragma once
 
+#include "global.h"
+#include <utility>
+#include <vector>
+
 // Varying num_matching (N=16384)
-void param_PDQ_16384_8();
-void param_PDQ_16384_16();
-void param_PDQ_16384_32();
-void param_PDQ_16384_64();
-void param_PDQ_16384_128();
+void param_PDQ_16384_8(PDQParams& P);
+void param_PDQ_16384_16(PDQParams& P);
+void param_PDQ_16384_32(PDQParams& P);
+void param_PDQ_16384_64(PDQParams& P);
+void param_PDQ_16384_128(PDQParams& P);
 
 // Varying num_records (s=16)
-void param_PDQ_8192_16();
-void param_PDQ_32768_16();
-void param_PDQ_65536_16();
-void param_PDQ_131072_16();
-void param_PDQ_262144_16();
-void param_PDQ_524288_16();
+void param_PDQ_8192_16(PDQParams& P);
+void param_PDQ_32768_16(PDQParams& P);
+void param_PDQ_65536_16(PDQParams& P);
+void param_PDQ_131072_16(PDQParams& P);
+void param_PDQ_262144_16(PDQParams& P);
+void param_PDQ_524288_16(PDQParams& P);
+
+// Set the configuration for (N, s) in P (other fields, such as key_limbs or
+// ringswitch_ratio, are kept); returns false if there is none. Call P.derive() once P is final.
+bool selectParams(PDQParams& P, int N, int s);
+
+// All (N, s) configurations above
+std::vector<std::pair<int, int>> availableParams();
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "global.h"
+#include "setup.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Public partitioning of the records (by date, region, ...): which partitions a
+// query touches is not secret, so the server only runs match, mask, ring switch
+// and BSGS over their main ciphertexts. The digest is the one of a DB holding
+// just those records, at their original indices.
+struct Partition {
+    std::string name;
+    int64_t first_record;
+    int64_t num_records;
+};
+
+// count partitions of consecutive records, of equal size up to the last one,
+// named "p0", "p1", ...
+std::vector<Partition> equalPartitions(const PDQParams& P, int count);
+
+// DB layout in which every partition starts a new main ciphertext, so that no
+// ciphertext holds records of two partitions (for encryptDB / encodeDB)
+std::vector<CtxtRecords> partitionedLayout(const PDQParams& P, const std::vector<Partition>& partitions);
+
+// Main ciphertexts of db holding records of the named partitions. Under
+// partitionedLayout() these are exactly the partitions' records; other layouts
+// select whole ciphertexts. The encrypted selection shares db's ciphertexts;
+// the plaintext one copies the value polynomials, so select once per set of
+// partitions rather than per query. Unknown names throw std::invalid_argument.
+EncryptedDB selectPartitions(
+    const EncryptedDB& db,
+    const std::vector<Partition>& partitions,
+    const std::vector<std::string>& names);
+
+PlainDB selectPartitions(
+    const PlainDB& db,
+    const std::vector<Partition>& partitions,
+    const std::vector<std::string>& names);
@@ -1,3 +1,28 @@
 #pragma once
 
-void pdq();
+#include "global.h"
+
+struct PDQOptions {
+    // Report the noise budget after each phase and recommend MultiplicativeDepth /
+    // towers_bsgs (uses the secret key; testing only)
+    bool measure_noise = false;
+    // Run the query through the bounded-memory streaming executor instead of
+    // phase by phase (no per-phase timings or noise report)
+    bool stream = false;
+    // Keep the database as plaintext on the server; only the query is encrypted
+    bool plain_db = false;
+    // Also run COUNT and SUM aggregate queries for the same key
+    bool aggregate = false;
+    // Lay the DB out in this many equal partitions and query only the first
+    // one (0: default layout, whole DB)
+    int partitions = 0;
+    // Match through a bitmap index of the key column (one bitmap per distinct
+    // key, low-cardinality data) instead of the equality check
+    bool bitmap = false;
+    // Ring-switch the encrypted values once, offline, and mask in the trace
+    // ring: per query only the indicators are ring-switched
+    bool trace_mask = false;
+};
+
+// Full run (setup, query, verification, sizes) with P (derived)
+void pdq(const PDQParams& P, const PDQOptions& options = {});
@@ -1,11 +1,56 @@
 #pragma once
 
 #include "openfhe.h"
+#include "setup.h"
 #include <vector>
 
-// Apply ring-switch to multiple ciphertexts
+// Key switch a main ciphertext (2 or 3 components) to the lifted trace key
+void switchToTrace(
+    lbcrypto::Ciphertext<lbcrypto::DCRTPoly>& ctxt,
+    const lbcrypto::EvalKey<lbcrypto::DCRTPoly>& switch_key,
+    const lbcrypto::EvalKey<lbcrypto::DCRTPoly>& relin_switch_key);
+
+// Twiddle factors for coefficient extraction from ring ring_from into the ring of
+// context_trace: twiddles[r][k-1], r = 0..d-1, k = 1..d-1 with d = ring_from / n'
+std::vector<std::vector<lbcrypto::DCRTPoly>> precomputeTwiddles(
+    const PDQParams& P,
+    const lbcrypto::CryptoContext<lbcrypto::DCRTPoly>& context_trace,
+    size_t towers,
+    int ring_from);
+
+// Split one key-switched ciphertext into d ciphertexts of the ring of context_trace
+// (appended to result), d = input ring / that ring.
+// Outputs keep the input's tower count; twiddles must have the same.
+void ringswitchCore(
+    const lbcrypto::Ciphertext<lbcrypto::DCRTPoly>& ciphertext,
+    const lbcrypto::CryptoContext<lbcrypto::DCRTPoly>& context_trace,
+    const std::string& keyTag,
+    const std::vector<std::vector<lbcrypto::DCRTPoly>>& twiddles,
+    std::vector<lbcrypto::Ciphertext<lbcrypto::DCRTPoly>>& result);
+
+// Apply ring-switch to multiple ciphertexts, through the intermediate rings of
+// chain if any (PDQSetup::chain). Unrelinearized inputs (maskNoRelin,
+// matchMask) need relin_switch_key.
 std::vector<lbcrypto::Ciphertext<lbcrypto::DCRTPoly>> ringswitch(
+    const PDQParams& P,
+    const lbcrypto::CryptoContext<lbcrypto::DCRTPoly>& context_trace,
+    const std::string& keyTag,
+    const lbcrypto::EvalKey<lbcrypto::DCRTPoly>& switch_key,
+    const std::vector<lbcrypto::Ciphertext<lbcrypto::DCRTPoly>>& ctxts,
+    const lbcrypto::EvalKey<lbcrypto::DCRTPoly>& relin_switch_key = nullptr,
+    const RingSwitchChain& chain = {});
+
+// P keeping every trace tower through the ring switch (towers_bsgs = 0), for
+// outputs that are multiplied in the trace ring before compress
+PDQParams allTraceTowers(const PDQParams& P);
+
+// Trace-ring masking, offline part: ring-switch db.values once into
+// db.values_trace, at all trace towers. Per query only the indicators are
+// ring-switched and multiplied with them (maskTrace, streamTraceCiphertext).
+void ringswitchValues(
+    const PDQParams& P,
+    EncryptedDB& db,
     const lbcrypto::CryptoContext<lbcrypto::DCRTPoly>& context_trace,
     const std::string& keyTag,
     const lbcrypto::EvalKey<lbcrypto::DCRTPoly>& switch_key,
-    const std::vector<lbcrypto::Ciphertext<lbcrypto::DCRTPoly>>& ctxts);
+    const RingSwitchChain& chain = {});
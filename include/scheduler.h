@@ -0,0 +1,53 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed-size thread pool with one task deque per worker and a shared FIFO.
+// Tasks submitted from outside the pool are spread over the worker deques;
+// tasks submitted by a worker (continuations, such as a query's next main
+// ciphertext) join the tail of the FIFO, behind every task already waiting
+// there, so that concurrent task chains take turns. A worker takes its own
+// newest task first, then the head of the FIFO, then steals the oldest task
+// of another worker.
+class WorkStealingPool {
+public:
+    explicit WorkStealingPool(size_t num_threads);
+    ~WorkStealingPool();  // finishes queued tasks, then joins
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    // From a worker thread the task goes to the shared FIFO, otherwise round-robin
+    // to the worker deques
+    void submit(std::function<void()> task);
+
+    size_t pending() const { return num_pending.load(std::memory_order_relaxed); }
+    size_t size() const { return threads.size(); }
+
+private:
+    struct TaskQueue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    bool tryPop(size_t self, std::function<void()>& task);
+    void run(size_t self);
+
+    std::vector<std::unique_ptr<TaskQueue>> queues;
+    TaskQueue shared;
+    std::vector<std::thread> threads;
+    std::atomic<size_t> num_pending{0};
+    std::atomic<size_t> next_queue{0};
+
+    std::mutex wake_mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+};
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Self-checks of hand-written arithmetic and scheduling, run by
+// `pdq_bench --selfcheck` (and ctest). Each prints what it checked and
+// returns false on the first mismatch.
+
+// Two task chains that requeue themselves, as QueryServer::runTask does,
+// take turns on a one-thread WorkStealingPool instead of running back to back
+bool checkSchedulerInterleaving();
+
+// Every mulAdd kernel available here (mulAddKernels(), scalar included) against
+// (acc + a * b) mod q computed in 128 bits: random operands, operands near
+// q - 1 and 0, and lengths with vector tails, for each of `moduli` and for
+// NTT-friendly primes just below 2^30, 2^50, 2^60, 2^61 and 2^62
+bool checkMulAddKernels(const std::vector<uint64_t>& moduli);
+
+// ConstMod<65537>::reduce(x) == x % 65537 for every x < 2^34, the range its
+// two folds are written for (modp.h), split over all hardware threads
+bool checkConstModReduce();
@@ -0,0 +1,133 @@
+#pragma once
+
+#include "openfhe.h"
+#include "aggregate.h"
+#include "setup.h"
+#include "compress.h"
+#include "scheduler.h"
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// In-process query server: many queries run concurrently against shared,
+// read-only contexts, keys and DB. Each query is split into one task per main
+// ciphertext (streamCiphertext) on a work-stealing pool.
+
+struct ServerConfig {
+    size_t threads = 0;                // 0 = hardware concurrency
+    size_t memory_budget_mb = 8192;    // estimated footprint of all admitted queries
+    size_t query_memory_mb = 1024;     // per query; bounds its parallel tasks
+    size_t max_queued = 64;            // queries waiting for admission before rejecting
+    size_t latency_window = 1024;      // completed queries kept for percentiles
+};
+
+enum class QueryStatus : uint32_t { OK = 0, Rejected = 1, Failed = 2 };
+
+struct QueryResult {
+    QueryStatus status;
+    lbcrypto::Ciphertext<lbcrypto::DCRTPoly> digest;
+    std::string error;
+};
+
+struct ServerMetrics {
+    size_t queued;                 // waiting for admission
+    size_t running;                // admitted and not finished
+    size_t pending_tasks;          // scheduler backlog
+    size_t reserved_mb;
+    uint64_t completed, rejected, failed;
+    double latency_p50_ms, latency_p95_ms, latency_p99_ms, latency_max_ms;  // submit to digest
+    double wait_p50_ms, wait_p99_ms;                                        // submit to admission
+};
+
+void writeServerMetricsJSON(std::ostream& os, const ServerMetrics& m);
+
+// Anything that answers queries: a QueryServer, or a coordinator of shard workers
+class QueryBackend {
+public:
+    virtual ~QueryBackend() = default;
+    virtual QueryResult run(const EncryptedKey& ctxt_query, QueryKind kind) = 0;
+    virtual std::string statsJSON() const = 0;
+};
+
+// Several databases served from one process: each query goes to the backend of
+// the main key it was encrypted under (its key tag)
+class DatabaseRouter : public QueryBackend {
+public:
+    void add(const std::string& keyTag, QueryBackend& backend);
+
+    QueryResult run(const EncryptedKey& ctxt_query, QueryKind kind) override;
+    std::string statsJSON() const override;  // every database's metrics by key tag
+
+private:
+    std::map<std::string, QueryBackend*> backends;
+};
+
+// db may be a shard or a selection of partitions (its records name the
+// Vandermonde columns); the digest is then a partial one: partial digests of
+// disjoint subsets add up to the digest of their union. Servers of
+// databases with different parameters can run side by side in one process.
+class QueryServer : public QueryBackend {
+public:
+    QueryServer(const PDQParams& params,
+                const lbcrypto::CryptoContext<lbcrypto::DCRTPoly>& context_trace,
+                const std::string& keyTag_trace,
+                const lbcrypto::EvalKey<lbcrypto::DCRTPoly>& switch_key,
+                const lbcrypto::EvalKey<lbcrypto::DCRTPoly>& relin_switch_key,
+                const RingSwitchChain& chain,
+                const EncryptedDB& db,
+                const ServerConfig& config = {});
+    ~QueryServer();  // rejects queued queries and finishes admitted ones
+
+    QueryServer(const QueryServer&) = delete;
+    QueryServer& operator=(const QueryServer&) = delete;
+
+    // done runs on a worker thread (or inline when the query is rejected)
+    void submit(const EncryptedKey& ctxt_query, QueryKind kind,
+                std::function<void(QueryResult)> done);
+
+    // Blocking form of submit
+    QueryResult run(const EncryptedKey& ctxt_query, QueryKind kind) override;
+
+    ServerMetrics metrics() const;
+    std::string statsJSON() const override;
+
+private:
+    using Clock = std::chrono::steady_clock;
+    struct Query;
+
+    void start(const std::shared_ptr<Query>& query);
+    void runTask(const std::shared_ptr<Query>& query);
+    void finish(const std::shared_ptr<Query>& query);
+
+    PDQParams params;
+    lbcrypto::CryptoContext<lbcrypto::DCRTPoly> context_trace;
+    std::string keyTag_trace;
+    lbcrypto::EvalKey<lbcrypto::DCRTPoly> switch_key;
+    lbcrypto::EvalKey<lbcrypto::DCRTPoly> relin_switch_key;
+    RingSwitchChain chain;
+    const EncryptedDB& db;
+    ServerConfig config;
+
+    // Estimated footprint (bytes) of a query besides its tasks, and of one task
+    struct Footprint { size_t base_bytes, task_bytes; };
+    Footprint retrieve_footprint, aggregate_footprint;
+
+    mutable std::mutex state_mutex;
+    std::deque<std::shared_ptr<Query>> waiting;
+    size_t running = 0;
+    size_t reserved_bytes = 0;
+    uint64_t completed = 0, rejected = 0, failed = 0;
+    std::deque<double> latencies_ms, waits_ms;
+    bool shutting_down = false;
+
+    // Last member: destroyed first, so tasks drain while the state above is alive
+    WorkStealingPool pool;
+};
@@ -1,40 +1,189 @@
 #pragma once
 
 #include "openfhe.h"
+#include "global.h"
+#include "keyseed.h"
 #include <vector>
 #include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
 
-void updateGlobal();
-void initBFVParams(lbcrypto::CCParams<lbcrypto::CryptoContextBFVRNS>& params);
-void initBFVParams_trace(lbcrypto::CCParams<lbcrypto::CryptoContextBFVRNS>& params);
+// Precomputations of one PDQParams (PDQParams::caches), shared by the queries
+// of its database
+struct PDQCaches {
+    // Ring-switch twiddles per (source ring, tower count); entries never move
+    std::mutex twiddle_mutex;
+    std::map<std::pair<int, size_t>, std::vector<std::vector<lbcrypto::DCRTPoly>>> twiddles;
+};
+
+void initBFVParams(const PDQParams& P, lbcrypto::CCParams<lbcrypto::CryptoContextBFVRNS>& params);
+// Trace parameters; ring_dim overrides degree_trace for the intermediate rings
+void initBFVParams_trace(const PDQParams& P, lbcrypto::CCParams<lbcrypto::CryptoContextBFVRNS>& params, int ring_dim = 0);
 void enableFeatures(lbcrypto::CryptoContext<lbcrypto::DCRTPoly>& context);
-std::vector<int32_t> computeRotationIndices();
+std::vector<int32_t> computeRotationIndices(const PDQParams& P);
+// Ring dimensions of the ring-switch chain: degree, degree / ringswitch_ratio,
+// ..., degree_trace (just degree and degree_trace without ringswitch_ratio)
+std::vector<int> ringSwitchChain(const PDQParams& P);
+// Smallest power-of-two ring dimension below degree that holds the e and w
+// digest windows in its half-slots (2 * digest_rows <= n' / 2) and in which the
+// trace parameters meet 128-bit security; P derived. Set it as degree_trace and
+// derive again to end the ring-switch chain there.
+int smallestTraceRing(const PDQParams& P);
+
+// RNS tower helpers
+// Element parameters restricted to their first `towers` towers
+std::shared_ptr<lbcrypto::ILDCRTParams<lbcrypto::BigInteger>> truncateParams(
+    const std::shared_ptr<lbcrypto::ILDCRTParams<lbcrypto::BigInteger>>& params,
+    size_t towers);
+// Trace towers the digest needs by an unmeasured worst-case noise bound, with
+// noise_margin_bits to spare (towers_bsgs = -1 only); P derived
+int minBsgsTowers(const PDQParams& P);
+// Trace towers kept from ring-switch through compress (towers_bsgs, minBsgsTowers()
+// for -1, or all), at most the trace context's
+size_t bsgsTowers(const PDQParams& P, const lbcrypto::CryptoContext<lbcrypto::DCRTPoly>& context_trace);
+// Packed encoding of a slot vector as a DCRTPoly in EVALUATION form over `towers` towers
+lbcrypto::DCRTPoly encodeEval(
+    const lbcrypto::CryptoContext<lbcrypto::DCRTPoly>& context,
+    const std::vector<int64_t>& slots,
+    size_t towers);
+// ct * pt on the raw polynomials (pt from encodeEval over ct's towers); no depth, no key switch
+lbcrypto::Ciphertext<lbcrypto::DCRTPoly> multPlain(
+    const lbcrypto::Ciphertext<lbcrypto::DCRTPoly>& ct,
+    const lbcrypto::DCRTPoly& pt);
+// acc += ct * pt
+void multAccPlain(
+    lbcrypto::Ciphertext<lbcrypto::DCRTPoly>& acc,
+    const lbcrypto::Ciphertext<lbcrypto::DCRTPoly>& ct,
+    const lbcrypto::DCRTPoly& pt);
 
 // Ring-switch setup
-void injectCompatibleRoot();
+// Primitive m-th root of unity mod p (m a power of two dividing p - 1). Roots
+// of one p are powers of each other, zeta_m = zeta_2m^2, whichever database
+// asks for them, so the packed-encoding roots below are shared consistently
+// by all databases of a process.
+uint64_t plainRootOfUnity(int64_t p, uint32_t m);
+// Register the packed-encoding roots of every ring of ringSwitchChain(P)
+void injectCompatibleRoot(const PDQParams& P);
+// Record that root in context's own encoding parameters, at creation, so that
+// saving the context (store.h) carries it
+void setContextRoot(const PDQParams& P, const lbcrypto::CryptoContext<lbcrypto::DCRTPoly>& context);
 lbcrypto::CryptoContext<lbcrypto::DCRTPoly> GenCryptoContextWithModuliFrom(
     const lbcrypto::CCParams<lbcrypto::CryptoContextBFVRNS>& params,
     const lbcrypto::CryptoContext<lbcrypto::DCRTPoly>& sourceContext);
+// Contexts of the intermediate rings of ringSwitchChain(), with context's moduli
+std::vector<lbcrypto::CryptoContext<lbcrypto::DCRTPoly>> genChainContexts(
+    const PDQParams& P,
+    const lbcrypto::CryptoContext<lbcrypto::DCRTPoly>& context);
+// Replace keyPair_main's secret with keyPair_trace's, embedded into the larger ring
 void liftSecretKey(lbcrypto::KeyPair<lbcrypto::DCRTPoly>& keyPair_main,
                    const lbcrypto::KeyPair<lbcrypto::DCRTPoly>& keyPair_trace);
 
+// Intermediate rings of a multi-level ring switch, largest first; empty for a
+// single switch from the main to the trace ring. Their contexts share the
+// main context's moduli, like the trace context.
+struct RingSwitchChain {
+    std::vector<lbcrypto::CryptoContext<lbcrypto::DCRTPoly>> contexts;
+    std::vector<std::string> keyTags;
+    std::vector<lbcrypto::EvalKey<lbcrypto::DCRTPoly>> switch_keys;   // contexts[k] key -> lifted key of the next ring
+};
+
+// Contexts and keys of a full PDQ run
+struct PDQSetup {
+    lbcrypto::CryptoContext<lbcrypto::DCRTPoly> context;
+    lbcrypto::CryptoContext<lbcrypto::DCRTPoly> context_trace;
+    lbcrypto::KeyPair<lbcrypto::DCRTPoly> keypair;
+    lbcrypto::KeyPair<lbcrypto::DCRTPoly> keypair_trace;
+    lbcrypto::EvalKey<lbcrypto::DCRTPoly> switch_key;         // main key -> lifted key of the next ring
+    lbcrypto::EvalKey<lbcrypto::DCRTPoly> relin_switch_key;   // main key^2 -> lifted key of the next ring
+    RingSwitchChain chain;
+    KeySeed key_seed;                                          // a-halves of all evaluation keys
+};
+
+// Create both contexts from P (derived) and generate all keys; the uniform
+// halves of the evaluation keys are expanded from key_seed
+PDQSetup setupPDQ(const PDQParams& P, const KeySeed& key_seed);
+
+// Keys are unsigned integers of up to key_limbs * limb_bits (at most 64) bits,
+// split into key_limbs limbs of limb_bits bits. Limb l is stored as limb + 1,
+// so the zero padding of the last ciphertext never matches.
+uint64_t keyMax(const PDQParams& P);
+int64_t keyLimb(const PDQParams& P, uint64_t key, int l);
+
+// A key encrypted limb by limb, every slot holding the same limb (the query),
+// or a DB key ciphertext per limb
+using EncryptedKey = std::vector<lbcrypto::Ciphertext<lbcrypto::DCRTPoly>>;
+
+EncryptedKey encryptKey(
+    const PDQParams& P,
+    const lbcrypto::CryptoContext<lbcrypto::DCRTPoly>& context,
+    const lbcrypto::PublicKey<lbcrypto::DCRTPoly>& publicKey,
+    uint64_t key);
+
+// Replicated layout: keys[r] in slot block r, so that one query ciphertext
+// looks up to P.replicas keys (recoverBlocks() separates their results)
+EncryptedKey encryptKeys(
+    const PDQParams& P,
+    const lbcrypto::CryptoContext<lbcrypto::DCRTPoly>& context,
+    const lbcrypto::PublicKey<lbcrypto::DCRTPoly>& publicKey,
+    const std::vector<uint64_t>& keys);
+
 // Test data for PDQ
 struct TestData {
-    std::vector<int64_t> keys;
+    std::vector<uint64_t> keys;
     std::vector<int64_t> values;
-    std::vector<int> matching_indices;
-    int64_t query_value;
+    std::vector<int> matching_indices;     // records whose key is one of query_values
+    uint64_t query_value;
+    std::vector<uint64_t> query_values;    // P.in_keys IN-list candidates, query_value first
+};
+
+TestData generateTestData(const PDQParams& P, int seed = 42);
+
+// Records held by one main ciphertext: slot k of every slot block holds record
+// first + k for k < count, the remaining slots are padding. The record index
+// selects the Vandermonde column of the slot, so a main ciphertext can be
+// compressed on its own, whichever ciphertexts are queried with it.
+struct CtxtRecords {
+    int64_t first;
+    int64_t count;
 };
 
-TestData generateTestData(int seed = 42);
+// Main ciphertext c of the default layout (records c * P.block_size, ...)
+CtxtRecords contiguousRecords(const PDQParams& P, int c);
+// All P.num_ctxts main ciphertexts of the default layout
+std::vector<CtxtRecords> contiguousLayout(const PDQParams& P);
 
-// Encrypted database: keys and values
+// Encrypted database: keys ([c][limb]) and values ([c]), and the records of
+// each main ciphertext. values_trace holds the values ring-switched offline
+// for trace-ring masking ([c * P.dim_trace + r], ringswitchValues()); empty
+// unless that mode is used.
 struct EncryptedDB {
-    std::vector<lbcrypto::Ciphertext<lbcrypto::DCRTPoly>> keys;
+    std::vector<EncryptedKey> keys;
     std::vector<lbcrypto::Ciphertext<lbcrypto::DCRTPoly>> values;
+    std::vector<CtxtRecords> records;
+    std::vector<lbcrypto::Ciphertext<lbcrypto::DCRTPoly>> values_trace;
 };
 
+// layout gives the records of each main ciphertext (contiguousLayout() if empty)
 EncryptedDB encryptDB(
+    const PDQParams& P,
     const lbcrypto::CryptoContext<lbcrypto::DCRTPoly>& context,
     const lbcrypto::PublicKey<lbcrypto::DCRTPoly>& publicKey,
-    const TestData& data);
+    const TestData& data,
+    const std::vector<CtxtRecords>& layout = {});
+
+// Plaintext database (server-owned data, only the query is encrypted): keys as
+// packed plaintexts for the subtraction in match, values as EVALUATION-form
+// polynomials for the plaintext multiply in mask
+struct PlainDB {
+    std::vector<std::vector<lbcrypto::Plaintext>> keys;   // [c][limb]
+    std::vector<lbcrypto::DCRTPoly> values;
+    std::vector<CtxtRecords> records;
+};
+
+PlainDB encodeDB(
+    const PDQParams& P,
+    const lbcrypto::CryptoContext<lbcrypto::DCRTPoly>& context,
+    const TestData& data,
+    const std::vector<CtxtRecords>& layout = {});
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "server.h"
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Main ciphertexts [begin, end) of shard i when P.num_ctxts is split into
+// num_shards contiguous ranges
+std::pair<size_t, size_t> shardRange(const PDQParams& P, size_t i, size_t num_shards);
+
+// Forwards each query to every shard worker (a QueryServer over one DB shard,
+// behind the Unix-socket front end) and adds up their partial digests. Partial
+// digests (retrieval or aggregate) are linear in the shards' contributions, so
+// the sum equals the digest of the whole DB.
+class ShardCoordinator : public QueryBackend {
+public:
+    explicit ShardCoordinator(const std::vector<std::string>& worker_sockets);
+
+    QueryResult run(const EncryptedKey& ctxt_query, QueryKind kind) override;
+    std::string statsJSON() const override;  // own counters plus every worker's metrics
+
+private:
+    std::vector<std::string> worker_sockets;
+
+    mutable std::mutex mutex;
+    uint64_t completed = 0, failed = 0;
+};
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "openfhe.h"
+#include "setup.h"
+#include <string>
+
+// Everything the server needs to answer queries: parameters, contexts with
+// their packed-encoding roots, public evaluation keys (installed in the
+// contexts) and the switch key
+struct ServerState {
+    PDQParams params;            // derived
+    lbcrypto::CryptoContext<lbcrypto::DCRTPoly> context;
+    lbcrypto::CryptoContext<lbcrypto::DCRTPoly> context_trace;
+    std::string keyTag;          // main key tag (relinearization keys)
+    std::string keyTag_trace;    // trace key tag (rotation keys, ring-switch output)
+    lbcrypto::EvalKey<lbcrypto::DCRTPoly> switch_key;
+    lbcrypto::EvalKey<lbcrypto::DCRTPoly> relin_switch_key;
+    RingSwitchChain chain;       // contexts are stored like the trace context
+    KeySeed key_seed;            // a-halves of the evaluation keys (setupPDQ())
+};
+
+// Persist a fully initialized server state together with its parameters. The
+// evaluation keys are written seed-compressed (keyseed.h): their b-halves and
+// key_seed, about half their in-memory size. state is only read; its contexts
+// must come from setupPDQ() or loadServerState().
+void saveServerState(const std::string& path, const ServerState& state);
+
+// Restore a server state in one step: reads and derives its parameters, restores
+// all contexts as saved (moduli and packed-encoding roots), registers their roots
+// and installs the evaluation keys, expanding their a-halves from the seed. No
+// key generation is performed.
+// States of different databases can be loaded into one process.
+ServerState loadServerState(const std::string& path);
+
+// Persist main ciphertexts [begin, end) of db with their records, for sharded
+// evaluation. The contexts must be restored (loadServerState) before loading a
+// shard; P is the restored state's params.
+void saveDBShard(const PDQParams& P, const std::string& path, const EncryptedDB& db, size_t begin, size_t end);
+EncryptedDB loadDBShard(const PDQParams& P, const std::string& path);
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "openfhe.h"
+#include "compress.h"
+#include "mask.h"
+#include "setup.h"
+#include <vector>
+
+// Ring-switch the match/mask output of the main ciphertext holding `records`
+// (matchMask or matchMaskPlain) and fold it into the BSGS giant-step sums of
+// the values (acc_e) and the indices (acc_w).
+void streamCiphertext(
+    const PDQParams& P,
+    const CtxtRecords& records,
+    const MatchMask& mm,
+    const lbcrypto::CryptoContext<lbcrypto::DCRTPoly>& context_trace,
+    const std::string& keyTag_trace,
+    const lbcrypto::EvalKey<lbcrypto::DCRTPoly>& switch_key,
+    const lbcrypto::EvalKey<lbcrypto::DCRTPoly>& relin_switch_key,
+    const RingSwitchChain& chain,
+    BSGSAccumulator& acc_e,
+    BSGSAccumulator& acc_w);
+
+// Trace-ring masking: ring-switch the indicators `index` of main ciphertext c
+// of db alone and multiply them with its offline trace values
+// (db.values_trace) before folding them into acc_e and acc_w
+void streamTraceCiphertext(
+    const PDQParams& P,
+    const EncryptedDB& db,
+    size_t c,
+    const lbcrypto::Ciphertext<lbcrypto::DCRTPoly>& index,
+    const lbcrypto::CryptoContext<lbcrypto::DCRTPoly>& context_trace,
+    const std::string& keyTag_trace,
+    const lbcrypto::EvalKey<lbcrypto::DCRTPoly>& switch_key,
+    const RingSwitchChain& chain,
+    BSGSAccumulator& acc_e,
+    BSGSAccumulator& acc_w);
+
+// Streaming query: each main ciphertext is taken through streamCiphertext
+// before the next one is touched, so a query keeps O(P.b_bsgs + P.g_bsgs)
+// ciphertexts resident regardless of N.
+// Returns the same digest as compress() on the phased pipeline. An encrypted
+// db with values_trace is masked in the trace ring.
+lbcrypto::Ciphertext<lbcrypto::DCRTPoly> streamQuery(
+    const PDQParams& P,
+    const EncryptedDB& db,
+    const EncryptedKey& ctxt_query,
+    const lbcrypto::CryptoContext<lbcrypto::DCRTPoly>& context_trace,
+    const std::string& keyTag_trace,
+    const lbcrypto::EvalKey<lbcrypto::DCRTPoly>& switch_key,
+    const lbcrypto::EvalKey<lbcrypto::DCRTPoly>& relin_switch_key,
+    const RingSwitchChain& chain = {});
+
+// Streaming query over a plaintext database
+lbcrypto::Ciphertext<lbcrypto::DCRTPoly> streamQuery(
+    const PDQParams& P,
+    const PlainDB& db,
+    const EncryptedKey& ctxt_query,
+    const lbcrypto::CryptoContext<lbcrypto::DCRTPoly>& context_trace,
+    const std::string& keyTag_trace,
+    const lbcrypto::EvalKey<lbcrypto::DCRTPoly>& switch_key,
+    const RingSwitchChain& chain = {});
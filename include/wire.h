@@ -0,0 +1,60 @@
+#pragma once
+
+#include "openfhe.h"
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+#include <sys/uio.h>
+
+// Raw ciphertext wire format for queries and digests: a fixed header, the key
+// tag, then the limbs as contiguous arrays of ring_dim words (polynomial-major,
+// then tower-major), in host byte order. Unlike OpenFHE's serialization it
+// carries no per-field metadata, is written straight from the limb storage
+// and read straight into it.
+struct WireHeader {
+    uint32_t magic;              // WIRE_MAGIC
+    uint32_t ring_dim;
+    uint64_t fingerprint;        // paramFingerprint() of the ciphertext's context
+    uint32_t elements;           // polynomials
+    uint32_t towers;             // RNS towers of each (the first towers of the context)
+    uint32_t format;             // 1 = EVALUATION, 0 = COEFFICIENT
+    uint32_t level;
+    uint32_t noise_scale_deg;
+    uint32_t tag_bytes;          // length of the key tag that follows the header
+};
+
+constexpr uint32_t WIRE_MAGIC = 0x57514450;  // "PDQW"
+constexpr uint32_t WIRE_MAX_TAG_BYTES = 4096;
+
+// Hash of the ring dimension, plaintext modulus and ciphertext moduli of a
+// context; a reader only accepts ciphertexts of a context it also has
+uint64_t paramFingerprint(const lbcrypto::CryptoContext<lbcrypto::DCRTPoly>& context);
+
+// Gather list for one writev. Headers and framing bytes are owned by the
+// batch; limbs are referenced in place, and the ciphertexts kept alive.
+class WireBatch {
+public:
+    void addBytes(const void* data, size_t len);
+    void addU32(uint32_t v) { addBytes(&v, sizeof(v)); }
+    void add(const lbcrypto::Ciphertext<lbcrypto::DCRTPoly>& ct);
+
+    size_t size() const { return total; }
+    const std::vector<iovec>& iovecs() const { return iov; }
+
+private:
+    std::deque<std::string> owned;
+    std::vector<lbcrypto::Ciphertext<lbcrypto::DCRTPoly>> held;
+    std::vector<iovec> iov;
+    size_t total = 0;
+};
+
+// Write all of iov to fd (socket or file) with gather writes, resuming after
+// partial writes. Throws std::runtime_error when fd is closed.
+void writeAll(int fd, std::vector<iovec> iov);
+
+// Read one ciphertext; read(buf, n) must fill exactly n bytes or throw. The
+// context is looked up by fingerprint among the live contexts, and the limbs
+// are read directly into the new ciphertext's polynomials.
+lbcrypto::Ciphertext<lbcrypto::DCRTPoly> readWireCiphertext(const std::function<void(char*, size_t)>& read);
@@ -1,27 +1,108 @@
 #include "pdq.h"
 #include "param.h"
 #include "global.h"
+#include "setup.h"
 #include <iostream>
+#include <algorithm>
 #include <cstring>
+#include <stdexcept>
 
 void printUsage() {
     std::cout << "Usage:" << std::endl;
-    std::cout << "  ./test              Run with default parameters (defined in global.cpp)" << std::endl;
+    std::cout << "  ./test              Run with default parameters (defined in global.h)" << std::endl;
     std::cout << "  ./test N s          Run with specified configuration" << std::endl;
     std::cout << "  ./test -h, --help   Show this help message" << std::endl;
+    std::cout << "\nOptions:" << std::endl;
+    std::cout << "  --noise             Report noise budgets and recommend MultiplicativeDepth / towers_bsgs" << std::endl;
+    std::cout << "  --stream            Run the query with bounded memory, one main ciphertext at a time" << std::endl;
+    std::cout << "  --plain-db          Keep the database in plaintext; only the query is encrypted" << std::endl;
+    std::cout << "  --aggregate         Also run COUNT and SUM queries for the same key" << std::endl;
+    std::cout << "  --key-limbs L       Keys of L field-sized limbs (L * 16 bits for p = 65537, at most 64)" << std::endl;
+    std::cout << "  --replicas R        Store R copies of a small DB per main ciphertext; one query carries R keys" << std::endl;
+    std::cout << "  --in K              IN-list query: match any of K keys in one pass (matches spread over them)" << std::endl;
+    std::cout << "  --partitions K      Lay the DB out in K partitions and query only the first one" << std::endl;
+    std::cout << "  --bitmap D          Keys of D distinct values, matched through a bitmap index" << std::endl;
+    std::cout << "  --trace-mask        Ring-switch the values offline and mask in the trace ring" << std::endl;
+    std::cout << "  --ringswitch-ratio D Ring-switch in steps dividing the ring dimension by D (power of 2)" << std::endl;
+    std::cout << "  --min-trace-ring    End the ring switch at the smallest secure ring the digest fits in" << std::endl;
     std::cout << "\nAvailable configurations:" << std::endl;
     std::cout << "  Vary num_matching (N=16384):  s = 8, 16, 32, 64, 128" << std::endl;
     std::cout << "  Vary num_records (s=16):      N = 8192, 16384, 32768, 65536, 131072, 262144, 524288" << std::endl;
 }
 
+// Derive P's parameters and run; min_trace_ring lowers degree_trace to smallestTraceRing()
+int run(PDQParams& P, const PDQOptions& options, bool min_trace_ring) {
+    try {
+        P.derive();
+        if (min_trace_ring) {
+            P.degree_trace = smallestTraceRing(P);
+            P.derive();
+        }
+        pdq(P, options);
+    } catch (const std::invalid_argument& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
 int main(int argc, char* argv[]) {
-    // No arguments: use default parameters from global.cpp
+    // Options may appear anywhere; strip them before the positional arguments
+    PDQOptions options;
+    PDQParams P;
+    bool min_trace_ring = false;
+    int argn = 1;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--noise") == 0) options.measure_noise = true;
+        else if (strcmp(argv[i], "--stream") == 0) options.stream = true;
+        else if (strcmp(argv[i], "--plain-db") == 0) options.plain_db = true;
+        else if (strcmp(argv[i], "--aggregate") == 0) options.aggregate = true;
+        else if (strcmp(argv[i], "--trace-mask") == 0) options.trace_mask = true;
+        else if (strcmp(argv[i], "--min-trace-ring") == 0) min_trace_ring = true;
+        else if (strcmp(argv[i], "--ringswitch-ratio") == 0 && i + 1 < argc) P.ringswitch_ratio = std::atoi(argv[++i]);
+        else if (strcmp(argv[i], "--key-limbs") == 0 && i + 1 < argc) P.key_limbs = std::max(1, std::atoi(argv[++i]));
+        else if (strcmp(argv[i], "--in") == 0 && i + 1 < argc) P.in_keys = std::max(1, std::atoi(argv[++i]));
+        else if (strcmp(argv[i], "--replicas") == 0 && i + 1 < argc) P.replicas = std::max(1, std::atoi(argv[++i]));
+        else if (strcmp(argv[i], "--partitions") == 0 && i + 1 < argc) options.partitions = std::max(1, std::atoi(argv[++i]));
+        else if (strcmp(argv[i], "--bitmap") == 0 && i + 1 < argc) {
+            options.bitmap = true;
+            P.distinct_keys = std::max(2, std::atoi(argv[++i]));
+        }
+        else argv[argn++] = argv[i];
+    }
+    argc = argn;
+
+    if (options.measure_noise && options.stream) {
+        std::cerr << "Error: --noise needs the phased pipeline and cannot be combined with --stream." << std::endl;
+        return 1;
+    }
+    if (P.replicas > 1 && (P.in_keys > 1 || options.aggregate)) {
+        std::cerr << "Error: --replicas cannot be combined with --in or --aggregate." << std::endl;
+        return 1;
+    }
+    if (options.trace_mask && (options.plain_db || options.measure_noise)) {
+        std::cerr << "Error: --trace-mask needs an encrypted DB and cannot be combined with --plain-db or --noise." << std::endl;
+        return 1;
+    }
+    if (options.bitmap && (options.stream || P.replicas > 1)) {
+        std::cerr << "Error: --bitmap runs on the phased pipeline with one key set per query; "
+                  << "it cannot be combined with --stream or --replicas." << std::endl;
+        return 1;
+    }
+    if (P.in_keys > 1 && options.stream) {
+        std::cerr << "Error: IN-list queries (--in) run on the phased pipeline and cannot be combined with --stream." << std::endl;
+        return 1;
+    }
+
+    // The folding rotation keys are generated only for aggregates
+    P.aggregates = options.aggregate ? 1 : 0;
+
+    // No arguments: use default parameters from global.h
     if (argc == 1) {
-        std::cout << "Using default parameters from global.cpp: N=" << num_records
-                  << ", s=" << num_matching << std::endl;
+        std::cout << "Using default parameters from global.h: N=" << P.num_records
+                  << ", s=" << P.num_matching << std::endl;
         std::cout << "Run './test --help' for usage.\n" << std::endl;
-        pdq();
-        return 0;
+        return run(P, options, min_trace_ring);
     }
 
     // Help flag
@@ -39,33 +120,11 @@ int main(int argc, char* argv[]) {
     int N = std::atoi(argv[1]);
     int s = std::atoi(argv[2]);
 
-    bool valid = false;
-    if (N == 16384) {
-        switch (s) {
-            case 8:   param_PDQ_16384_8();   valid = true; break;
-            case 16:  param_PDQ_16384_16();  valid = true; break;
-            case 32:  param_PDQ_16384_32();  valid = true; break;
-            case 64:  param_PDQ_16384_64();  valid = true; break;
-            case 128: param_PDQ_16384_128(); valid = true; break;
-        }
-    } else if (s == 16) {
-        switch (N) {
-            case 8192:   param_PDQ_8192_16();   valid = true; break;
-            case 16384:  param_PDQ_16384_16();  valid = true; break;
-            case 32768:  param_PDQ_32768_16();  valid = true; break;
-            case 65536:  param_PDQ_65536_16();  valid = true; break;
-            case 131072: param_PDQ_131072_16(); valid = true; break;
-            case 262144: param_PDQ_262144_16(); valid = true; break;
-            case 524288: param_PDQ_524288_16(); valid = true; break;
-        }
-    }
-
-    if (!valid) {
+    if (!selectParams(P, N, s)) {
         std::cerr << "Error: Invalid configuration (N=" << N << ", s=" << s << "). "
                   << "Run './test --help' for usage." << std::endl;
         return 1;
     }
 
-    pdq();
-    return 0;
+    return run(P, options, min_trace_ring);
 }
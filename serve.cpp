@@ -0,0 +1,434 @@
+#include "param.h"
+#include "global.h"
+#include "setup.h"
+#include "aggregate.h"
+#include "server.h"
+#include "frontend.h"
+#include "decompress.h"
+#include "ringswitch.h"
+#include "shard.h"
+#include "store.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace lbcrypto;
+
+namespace {
+
+std::atomic<bool> stop_requested{false};
+
+void onSignal(int) { stop_requested = true; }
+
+void printUsage() {
+    std::cout << "Usage:" << std::endl;
+    std::cout << "  ./pdq_server [N s] [options]    Serve queries on a Unix socket (default parameters: global.h)" << std::endl;
+    std::cout << "  ./pdq_server N s N s ... [options]" << std::endl;
+    std::cout << "                                  Serve one database per (N, s) from this process; queries" << std::endl;
+    std::cout << "                                  are routed by the key they are encrypted under" << std::endl;
+    std::cout << "\nOptions:" << std::endl;
+    std::cout << "  --socket PATH        Socket path (default data/pdq.sock)" << std::endl;
+    std::cout << "  --threads T          Worker threads in all (default: hardware concurrency), split" << std::endl;
+    std::cout << "                       evenly among the databases or shard workers" << std::endl;
+    std::cout << "  --budget MB          Memory budget of all admitted queries (default 8192), split" << std::endl;
+    std::cout << "                       evenly among the databases or shard workers" << std::endl;
+    std::cout << "  --query-limit MB     Memory limit per query (default 1024)" << std::endl;
+    std::cout << "  --max-queued Q       Queries waiting for admission before rejecting (default 64)" << std::endl;
+    std::cout << "  --load Q C           Instead of serving forever, send Q queries from C concurrent" << std::endl;
+    std::cout << "                       clients over the socket, verify them and report latencies" << std::endl;
+    std::cout << "  --aggregates         Also generate the rotation keys COUNT and SUM queries need" << std::endl;
+    std::cout << "  --aggregate KIND     With --load, send COUNT or SUM queries (KIND = count, sum; implies" << std::endl;
+    std::cout << "                       --aggregates)" << std::endl;
+    std::cout << "  --replicas R         Store R copies of each DB per main ciphertext; --load then packs" << std::endl;
+    std::cout << "                       R keys into every query" << std::endl;
+    std::cout << "  --key-limbs L        Keys of L field-sized limbs (as in ./test)" << std::endl;
+    std::cout << "  --trace-mask         Ring-switch the values once at startup and mask in the trace ring" << std::endl;
+    std::cout << "  --ringswitch-ratio D Ring-switch in steps dividing the ring dimension by D (as in ./test)" << std::endl;
+    std::cout << "  --min-trace-ring     End the ring switch at the smallest secure ring the digest fits in" << std::endl;
+    std::cout << "  --shards K           Split the DB over K worker processes and coordinate them (one (N, s) only)" << std::endl;
+    std::cout << "  --worker STATE SHARD Run as a shard worker (started by --shards)" << std::endl;
+}
+
+// Start a shard worker: this executable again, in --worker mode
+pid_t spawnWorker(const std::vector<std::string>& args) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        std::vector<char*> argv;
+        for (const auto& a : args) argv.push_back(const_cast<char*>(a.c_str()));
+        argv.push_back(nullptr);
+        execv("/proc/self/exe", argv.data());
+        _exit(127);
+    }
+    if (pid < 0) throw std::runtime_error("cannot start worker");
+    return pid;
+}
+
+// Workers restore their state before listening; wait until they accept
+void waitForWorker(const std::string& path) {
+    for (int attempt = 0; attempt < 1200; attempt++) {
+        try {
+            ::close(connectUnixSocket(path));
+            return;
+        } catch (const std::exception&) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+    }
+    throw std::runtime_error("worker on " + path + " did not start");
+}
+
+double percentile(std::vector<double> samples, double q) {
+    if (samples.empty()) return 0.0;
+    size_t k = std::min(samples.size() - 1, static_cast<size_t>(q * samples.size()));
+    std::nth_element(samples.begin(), samples.begin() + k, samples.end());
+    return samples[k];
+}
+
+// A hosted database: its parameters, keys and test data (the client side of
+// --load shares the keys)
+struct Database {
+    PDQParams params;
+    PDQSetup setup;
+    TestData testData;
+    EncryptedDB db;
+    std::unique_ptr<QueryServer> server;
+};
+
+// Mixed load over all databases in turn: alternate the planted query value
+// (s matches) with the keys of random records (usually a single match). With
+// replicas, each query also carries random keys in its other slot blocks.
+void runLoad(const std::string& socket_path, int num_queries, int num_clients,
+             const std::vector<Database>& databases, QueryKind kind) {
+    using Clock = std::chrono::steady_clock;
+
+    std::vector<std::vector<uint64_t>> candidates;
+    for (const auto& database : databases) {
+        const PDQParams& P = database.params;
+        const auto& keys = database.testData.keys;
+        candidates.push_back({database.testData.query_value});
+        for (int i = 0; i < P.num_records && candidates.back().size() < 64; i += std::max(1, P.num_records / 64)) {
+            if (std::count(keys.begin(), keys.end(), keys[i]) <= P.num_matching)
+                candidates.back().push_back(keys[i]);
+        }
+    }
+
+    std::atomic<int> next_query{0}, passed{0}, rejected{0}, failed{0};
+    std::mutex result_mutex;
+    std::vector<double> latencies_ms;
+
+    auto client = [&](int id) {
+        int fd = connectUnixSocket(socket_path);
+        std::mt19937 gen(id);
+        while (true) {
+            int q = next_query.fetch_add(1);
+            if (q >= num_queries) break;
+            const auto& database = databases[q % databases.size()];
+            const auto& setup = database.setup;
+            const auto& testData = database.testData;
+            const auto& values = candidates[q % databases.size()];
+            int round = q / static_cast<int>(databases.size());
+            uint64_t value = values[round % 2 == 0 ? 0 : 1 + gen() % (values.size() - 1)];
+
+            // Replicated layout: the other slot blocks look up random candidates
+            std::vector<uint64_t> block_keys{value};
+            while (static_cast<int>(block_keys.size()) < database.params.replicas)
+                block_keys.push_back(values[1 + gen() % (values.size() - 1)]);
+            auto ctxt_query = database.params.replicas > 1
+                ? encryptKeys(database.params, setup.context, setup.keypair.publicKey, block_keys)
+                : encryptKey(database.params, setup.context, setup.keypair.publicKey, value);
+
+            auto t_start = Clock::now();
+            auto result = remoteQuery(fd, ctxt_query, kind);
+            double ms = std::chrono::duration<double, std::milli>(Clock::now() - t_start).count();
+
+            if (result.status == QueryStatus::Rejected) { rejected++; continue; }
+            if (result.status == QueryStatus::Failed) { failed++; continue; }
+
+            auto truthOf = [&](uint64_t key) {
+                std::set<int64_t> truth;
+                for (int i = 0; i < database.params.num_records; i++)
+                    if (testData.keys[i] == key) truth.insert(i);
+                return truth;
+            };
+            auto truth = truthOf(value);
+
+            std::lock_guard<std::mutex> lock(result_mutex);
+            latencies_ms.push_back(ms);
+            if (kind == QueryKind::Retrieve) {
+                auto recovered = recoverBlocks(database.params, setup.keypair_trace.secretKey, result.digest,
+                                               static_cast<int>(block_keys.size()));
+                bool ok = true;
+                for (size_t r = 0; r < block_keys.size(); r++)
+                    ok = checkResult(recovered[r], testData.values, truthOf(block_keys[r])) && ok;
+                if (ok) passed++;
+            } else {
+                int64_t expected = 0;
+                for (int64_t i : truth)
+                    expected = kind == QueryKind::Count ? expected + 1
+                             : (expected + testData.values[i]) % database.params.ptxt_modulus;
+                if (recoverAggregate(setup.keypair_trace.secretKey, result.digest) == expected)
+                    passed++;
+            }
+        }
+        ::close(fd);
+    };
+
+    auto t_start = Clock::now();
+    std::vector<std::thread> clients;
+    for (int i = 0; i < num_clients; i++) clients.emplace_back(client, i);
+    for (auto& t : clients) t.join();
+    double total_sec = std::chrono::duration<double>(Clock::now() - t_start).count();
+
+    const char* kind_name = kind == QueryKind::Count ? " COUNT" : kind == QueryKind::Sum ? " SUM" : "";
+    std::cout << "\n[Load: " << num_queries << kind_name << " queries, " << num_clients << " clients]" << std::endl;
+    std::cout << "Verified: " << passed << "/" << latencies_ms.size()
+              << ", rejected: " << rejected << ", failed: " << failed << std::endl;
+    std::cout << "Throughput: " << latencies_ms.size() / total_sec << " queries/sec" << std::endl;
+    std::cout << "Latency p50/p95/p99/max: " << percentile(latencies_ms, 0.50) << " / "
+              << percentile(latencies_ms, 0.95) << " / " << percentile(latencies_ms, 0.99) << " / "
+              << (latencies_ms.empty() ? 0.0 : *std::max_element(latencies_ms.begin(), latencies_ms.end()))
+              << " ms" << std::endl;
+
+    int fd = connectUnixSocket(socket_path);
+    std::cout << "Server metrics: " << remoteStats(fd) << std::endl;
+    ::close(fd);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    ServerConfig config;
+    int key_limbs = 1;
+    int replicas = 1;
+    bool trace_mask = false;
+    int ringswitch_ratio = 0;
+    bool min_trace_ring = false;
+    bool aggregates = false;
+    std::string socket_path = "data/pdq.sock";
+    int load_queries = 0, load_clients = 0;
+    int num_shards = 0;
+    QueryKind load_kind = QueryKind::Retrieve;
+    std::string worker_state, worker_shard;
+    std::vector<std::string> positional;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            printUsage();
+            return 0;
+        } else if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc) {
+            socket_path = argv[++i];
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            config.threads = std::atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--budget") == 0 && i + 1 < argc) {
+            config.memory_budget_mb = std::atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--query-limit") == 0 && i + 1 < argc) {
+            config.query_memory_mb = std::atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--max-queued") == 0 && i + 1 < argc) {
+            config.max_queued = std::atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--load") == 0 && i + 2 < argc) {
+            load_queries = std::atoi(argv[++i]);
+            load_clients = std::max(1, std::atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--aggregates") == 0) {
+            aggregates = true;
+        } else if (strcmp(argv[i], "--aggregate") == 0 && i + 1 < argc) {
+            std::string kind = argv[++i];
+            if (kind == "count") load_kind = QueryKind::Count;
+            else if (kind == "sum") load_kind = QueryKind::Sum;
+            else {
+                std::cerr << "Error: --aggregate takes count or sum." << std::endl;
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--key-limbs") == 0 && i + 1 < argc) {
+            key_limbs = std::max(1, std::atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--replicas") == 0 && i + 1 < argc) {
+            replicas = std::max(1, std::atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--trace-mask") == 0) {
+            trace_mask = true;
+        } else if (strcmp(argv[i], "--ringswitch-ratio") == 0 && i + 1 < argc) {
+            ringswitch_ratio = std::atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--min-trace-ring") == 0) {
+            min_trace_ring = true;
+        } else if (strcmp(argv[i], "--shards") == 0 && i + 1 < argc) {
+            num_shards = std::max(1, std::atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--worker") == 0 && i + 2 < argc) {
+            worker_state = argv[++i];
+            worker_shard = argv[++i];
+        } else {
+            positional.push_back(argv[i]);
+        }
+    }
+
+    if (load_kind != QueryKind::Retrieve) aggregates = true;
+    if (replicas > 1 && aggregates) {
+        std::cerr << "Error: --aggregate(s) cannot be combined with --replicas." << std::endl;
+        return 1;
+    }
+    // Shard files hold the main-ring values only
+    if (trace_mask && num_shards > 0) {
+        std::cerr << "Error: --trace-mask cannot be combined with --shards." << std::endl;
+        return 1;
+    }
+
+    std::signal(SIGINT, onSignal);
+    std::signal(SIGTERM, onSignal);
+
+    // Shard worker: parameters, keys and DB shard all come from files
+    if (!worker_state.empty()) {
+        auto state = loadServerState(worker_state);
+        auto shard = loadDBShard(state.params, worker_shard);
+        QueryServer server(state.params, state.context_trace, state.keyTag_trace, state.switch_key, state.relin_switch_key,
+                           state.chain, shard, config);
+        serveUnixSocket(server, socket_path, queryLimits(state.params, state.context), stop_requested);
+        return 0;
+    }
+
+    // One database per (N, s); the defaults without any
+    std::vector<PDQParams> configs;
+    if (positional.size() % 2 != 0) {
+        std::cerr << "Error: Invalid arguments. Run './pdq_server --help' for usage." << std::endl;
+        return 1;
+    }
+    for (size_t k = 0; k < positional.size(); k += 2) {
+        int N = std::atoi(positional[k].c_str());
+        int s = std::atoi(positional[k + 1].c_str());
+        configs.emplace_back();
+        if (!selectParams(configs.back(), N, s)) {
+            std::cerr << "Error: Invalid configuration (N=" << N << ", s=" << s << "). "
+                      << "Run './pdq_server --help' for usage." << std::endl;
+            return 1;
+        }
+    }
+    if (configs.empty()) configs.emplace_back();
+    if (num_shards > 0 && configs.size() > 1) {
+        std::cerr << "Error: --shards serves a single database." << std::endl;
+        return 1;
+    }
+
+    // Test DBs and keys, as in ./test; the client side of --load shares them
+    std::vector<Database> databases(configs.size());
+    for (size_t k = 0; k < configs.size(); k++) {
+        auto& database = databases[k];
+        database.params = configs[k];
+        database.params.key_limbs = key_limbs;
+        database.params.replicas = replicas;
+        database.params.ringswitch_ratio = ringswitch_ratio;
+        database.params.aggregates = aggregates ? 1 : 0;
+        try {
+            database.params.derive();
+            if (min_trace_ring) {
+                database.params.degree_trace = smallestTraceRing(database.params);
+                database.params.derive();
+            }
+        } catch (const std::invalid_argument& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+        database.setup = setupPDQ(database.params, generateKeySeed());
+        database.testData = generateTestData(database.params);
+        // Shards are encrypted one at a time below
+        if (num_shards > 0) continue;
+        database.db = encryptDB(database.params, database.setup.context,
+                                database.setup.keypair.publicKey, database.testData);
+        if (trace_mask)
+            ringswitchValues(database.params, database.db, database.setup.context_trace,
+                             database.setup.keypair_trace.publicKey->GetKeyTag(), database.setup.switch_key,
+                             database.setup.chain);
+    }
+
+    std::unique_ptr<QueryBackend> backend;
+    std::vector<pid_t> workers;
+
+    // Databases and shard workers share the host: --threads and --budget are
+    // split evenly among them
+    size_t total_threads = config.threads ? config.threads : std::max(1u, std::thread::hardware_concurrency());
+
+    if (num_shards > 0) {
+        const PDQParams& P = databases[0].params;
+        const auto& setup = databases[0].setup;
+
+        // Each worker restores the shared state and its own range of main ciphertexts
+        std::filesystem::create_directories("data");
+        ServerState state{P, setup.context, setup.context_trace,
+            setup.keypair.secretKey->GetKeyTag(), setup.keypair_trace.secretKey->GetKeyTag(),
+            setup.switch_key, setup.relin_switch_key, setup.chain, setup.key_seed};
+        saveServerState("data/server.bin", state);
+
+        num_shards = std::min(num_shards, P.num_ctxts);
+        size_t worker_threads = std::max<size_t>(1, total_threads / num_shards);
+        size_t worker_budget_mb = std::max<size_t>(1, config.memory_budget_mb / num_shards);
+
+        // Each shard is encrypted, saved and released before the next, so this
+        // process never holds more than one shard of the DB
+        auto layout = contiguousLayout(P);
+        std::vector<std::string> worker_sockets;
+        for (int i = 0; i < num_shards; i++) {
+            auto [begin, end] = shardRange(P, i, num_shards);
+            std::string shard_path = "data/db_shard" + std::to_string(i) + ".bin";
+            std::string worker_socket = socket_path + "." + std::to_string(i);
+            auto shard = encryptDB(P, setup.context, setup.keypair.publicKey, databases[0].testData,
+                                   {layout.begin() + begin, layout.begin() + end});
+            saveDBShard(P, shard_path, shard, 0, shard.values.size());
+
+            workers.push_back(spawnWorker({argv[0], "--worker", "data/server.bin", shard_path,
+                "--socket", worker_socket,
+                "--threads", std::to_string(worker_threads),
+                "--budget", std::to_string(worker_budget_mb),
+                "--query-limit", std::to_string(config.query_memory_mb),
+                "--max-queued", std::to_string(config.max_queued)}));
+            worker_sockets.push_back(worker_socket);
+        }
+        for (const auto& path : worker_sockets) waitForWorker(path);
+
+        backend = std::make_unique<ShardCoordinator>(worker_sockets);
+        std::cout << "Coordinating " << num_shards << " shard workers" << std::endl;
+    } else {
+        ServerConfig database_config = config;
+        database_config.threads = std::max<size_t>(1, total_threads / databases.size());
+        database_config.memory_budget_mb = std::max<size_t>(1, config.memory_budget_mb / databases.size());
+        auto router = std::make_unique<DatabaseRouter>();
+        for (auto& database : databases) {
+            const auto& setup = database.setup;
+            database.server = std::make_unique<QueryServer>(database.params,
+                setup.context_trace, setup.keypair_trace.publicKey->GetKeyTag(),
+                setup.switch_key, setup.relin_switch_key, setup.chain, database.db, database_config);
+            router->add(setup.keypair.publicKey->GetKeyTag(), *database.server);
+        }
+        backend = std::move(router);
+    }
+
+    // Requests of any served database are accepted
+    FrontendLimits limits{0, 0};
+    for (const auto& database : databases) {
+        auto database_limits = queryLimits(database.params, database.setup.context);
+        limits.max_key_limbs = std::max(limits.max_key_limbs, database_limits.max_key_limbs);
+        limits.max_frame_bytes = std::max(limits.max_frame_bytes, database_limits.max_frame_bytes);
+    }
+    std::thread frontend([&] { serveUnixSocket(*backend, socket_path, limits, stop_requested); });
+    for (const auto& database : databases)
+        std::cout << "Serving N=" << database.params.num_records << ", s=" << database.params.num_matching
+                  << " on " << socket_path << std::endl;
+
+    if (load_queries > 0) {
+        // Wait until the socket is bound
+        while (::access(socket_path.c_str(), F_OK) != 0) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        runLoad(socket_path, load_queries, load_clients, databases, load_kind);
+        stop_requested = true;
+    }
+
+    frontend.join();
+
+    for (pid_t pid : workers) kill(pid, SIGTERM);
+    for (pid_t pid : workers) waitpid(pid, nullptr, 0);
+    return 0;
+}
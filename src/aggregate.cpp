@@ -0,0 +1,122 @@
+#include "aggregate.h"
+#include "instrument.h"
+#include "mask.h"
+#include "match.h"
+#include "ringswitch.h"
+#include <stdexcept>
+
+using namespace lbcrypto;
+
+Ciphertext<DCRTPoly> aggregateTerm(
+    QueryKind kind,
+    const EncryptedKey& ctxt_key,
+    const Ciphertext<DCRTPoly>& ctxt_value,
+    const EncryptedKey& ctxt_query) {
+
+    switch (kind) {
+        case QueryKind::Count: return matchKey(ctxt_key, ctxt_query);
+        case QueryKind::Sum:   return matchMask(ctxt_key, ctxt_value, ctxt_query).masked;
+        default: throw std::invalid_argument("aggregateTerm: not an aggregate query");
+    }
+}
+
+Ciphertext<DCRTPoly> aggregateTermPlain(
+    QueryKind kind,
+    const std::vector<Plaintext>& ptxt_key,
+    const DCRTPoly& ptxt_value,
+    const EncryptedKey& ctxt_query) {
+
+    switch (kind) {
+        case QueryKind::Count: return matchKeyPlain(ptxt_key, ctxt_query);
+        case QueryKind::Sum:   return matchMaskPlain(ptxt_key, ptxt_value, ctxt_query).masked;
+        default: throw std::invalid_argument("aggregateTermPlain: not an aggregate query");
+    }
+}
+
+void accumulateAggregate(AggregateAccumulator& acc, const Ciphertext<DCRTPoly>& term) {
+    if (!acc.sum) acc.sum = term;
+    else term->GetCryptoContext()->EvalAddInPlace(acc.sum, term);
+}
+
+Ciphertext<DCRTPoly> finishAggregate(
+    const PDQParams& P,
+    const AggregateAccumulator& acc,
+    const CryptoContext<DCRTPoly>& context_trace,
+    const std::string& keyTag_trace,
+    const EvalKey<DCRTPoly>& switch_key,
+    const EvalKey<DCRTPoly>& relin_switch_key,
+    const RingSwitchChain& chain) {
+
+    if (!acc.sum) throw std::runtime_error("finishAggregate: empty accumulator");
+    // Slot sums cannot tell the slot blocks of the replicated layout apart
+    if (P.replicas > 1) throw std::invalid_argument("finishAggregate: aggregates need replicas == 1");
+    if (!P.aggregates)
+        throw std::invalid_argument("finishAggregate: no rotation keys to fold the slots (set up with aggregates = 1)");
+
+    // One ring switch for the whole DB; Sum terms are relinearized by its key switch
+    auto traces = ringswitch(P, context_trace, keyTag_trace, switch_key, {acc.sum}, relin_switch_key, chain);
+
+    auto digest = traces[0];
+    for (size_t r = 1; r < traces.size(); r++) context_trace->EvalAddInPlace(digest, traces[r]);
+
+    // Fold all slots into each slot, so the client decrypts the total only
+    for (int j = 1; j < P.degree_trace_half; j *= 2) {
+        auto temp = context_trace->EvalRotate(digest, j);
+        context_trace->EvalAddInPlace(digest, temp);
+        countOp(Op::Rotate);
+        countOp(Op::KeySwitch);
+    }
+    auto temp = context_trace->EvalRotate(digest, P.degree_trace_half);
+    context_trace->EvalAddInPlace(digest, temp);
+    countOp(Op::Rotate);
+    countOp(Op::KeySwitch);
+
+    return context_trace->Compress(digest, 1);
+}
+
+Ciphertext<DCRTPoly> aggregateQuery(
+    const PDQParams& P,
+    QueryKind kind,
+    const std::vector<EncryptedKey>& ctxt_keys,
+    const std::vector<Ciphertext<DCRTPoly>>& ctxt_values,
+    const EncryptedKey& ctxt_query,
+    const CryptoContext<DCRTPoly>& context_trace,
+    const std::string& keyTag_trace,
+    const EvalKey<DCRTPoly>& switch_key,
+    const EvalKey<DCRTPoly>& relin_switch_key,
+    const RingSwitchChain& chain) {
+
+    AggregateAccumulator acc;
+    for (size_t c = 0; c < ctxt_keys.size(); c++)
+        accumulateAggregate(acc, aggregateTerm(kind, ctxt_keys[c], ctxt_values[c], ctxt_query));
+
+    return finishAggregate(P, acc, context_trace, keyTag_trace, switch_key, relin_switch_key, chain);
+}
+
+Ciphertext<DCRTPoly> aggregateQuery(
+    const PDQParams& P,
+    QueryKind kind,
+    const PlainDB& db,
+    const EncryptedKey& ctxt_query,
+    const CryptoContext<DCRTPoly>& context_trace,
+    const std::string& keyTag_trace,
+    const EvalKey<DCRTPoly>& switch_key,
+    const RingSwitchChain& chain) {
+
+    AggregateAccumulator acc;
+    for (size_t c = 0; c < db.keys.size(); c++)
+        accumulateAggregate(acc, aggregateTermPlain(kind, db.keys[c], db.values[c], ctxt_query));
+
+    return finishAggregate(P, acc, context_trace, keyTag_trace, switch_key, nullptr, chain);
+}
+
+int64_t recoverAggregate(const PrivateKey<DCRTPoly>& sk, const Ciphertext<DCRTPoly>& ctxt_digest) {
+    auto context = ctxt_digest->GetCryptoContext();
+    int64_t p = static_cast<int64_t>(context->GetCryptoParameters()->GetPlaintextModulus());
+
+    Plaintext ptxt;
+    context->Decrypt(sk, ctxt_digest, &ptxt);
+
+    int64_t total = ptxt->GetPackedValue()[0] % p;
+    return total < 0 ? total + p : total;
+}
@@ -0,0 +1,22 @@
+#include "instrument.h"
+#include <cstdlib>
+#include <new>
+
+// Replaces the global allocation functions to count allocations per phase.
+// Linked into the executables only with -DPDQ_COUNT_ALLOCS=ON, so the library
+// itself never replaces operator new for its users.
+
+void* operator new(std::size_t size) {
+    countAlloc(size);
+    if (void* ptr = std::malloc(size ? size : 1)) return ptr;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+    return ::operator new(size);
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { std::free(ptr); }
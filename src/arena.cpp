@@ -0,0 +1,75 @@
+#include "arena.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <stdexcept>
+
+using namespace lbcrypto;
+
+namespace {
+
+bool sameShape(const DCRTPoly& poly, const std::shared_ptr<QueryArena::Params>& params) {
+    const auto& towers = poly.GetAllElements();
+    const auto& moduli = params->GetParams();
+    if (towers.size() != moduli.size() || poly.GetRingDimension() != params->GetRingDimension()) return false;
+    for (size_t i = 0; i < towers.size(); i++)
+        if (towers[i].GetModulus() != moduli[i]->GetModulus()) return false;
+    return true;
+}
+
+}  // namespace
+
+QueryArena& QueryArena::local() {
+    thread_local QueryArena arena;
+    return arena;
+}
+
+DCRTPoly& QueryArena::scratch(size_t slot, const std::shared_ptr<Params>& params, Format format) {
+    if (slot >= scratch_polys.size()) scratch_polys.resize(slot + 1);
+    auto& poly = scratch_polys[slot];
+    if (poly.GetNumOfElements() == 0 || !sameShape(poly, params)) poly = DCRTPoly(params, format, true);
+    poly.OverrideFormat(format);
+    return poly;
+}
+
+Ciphertext<DCRTPoly> QueryArena::ciphertext(
+    const CryptoContext<DCRTPoly>& context,
+    const std::shared_ptr<Params>& params,
+    size_t elements) {
+
+    for (auto& ct : pool) {
+        if (ct.use_count() != 1 || ct->GetCryptoContext() != context) continue;
+        auto& polys = ct->GetElements();
+        if (polys.size() != elements || !sameShape(polys[0], params)) continue;
+
+        // The last holder may have dropped it on another thread
+        std::atomic_thread_fence(std::memory_order_acquire);
+        ct->SetLevel(0);
+        ct->SetNoiseScaleDeg(1);
+        return ct;
+    }
+
+    auto ct = std::make_shared<CiphertextImpl<DCRTPoly>>(context);
+    ct->SetElements(std::vector<DCRTPoly>(elements, DCRTPoly(params, Format::EVALUATION, true)));
+    if (pool.size() < pool_limit) pool.push_back(ct);
+    return ct;
+}
+
+void QueryArena::reservePool(size_t count) {
+    pool_limit = std::max(pool_limit, count);
+}
+
+void QueryArena::clear() {
+    scratch_polys.clear();
+    pool.clear();
+}
+
+void copyLimbs(DCRTPoly& dst, const DCRTPoly& src) {
+    auto& dst_towers = dst.GetAllElements();
+    const auto& src_towers = src.GetAllElements();
+    if (dst_towers.size() != src_towers.size())
+        throw std::runtime_error("copyLimbs: tower count mismatch");
+    for (size_t i = 0; i < dst_towers.size(); i++)
+        std::memcpy(&dst_towers[i][0], &src_towers[i][0], src_towers[i].GetLength() * sizeof(uint64_t));
+    dst.OverrideFormat(src.GetFormat());
+}
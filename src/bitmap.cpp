@@ -0,0 +1,168 @@
+#include "bitmap.h"
+#include "instrument.h"
+#include <algorithm>
+#include <stdexcept>
+
+using namespace lbcrypto;
+
+namespace {
+
+int dictionaryId(const std::vector<uint64_t>& dictionary, uint64_t key) {
+    auto it = std::lower_bound(dictionary.begin(), dictionary.end(), key);
+    if (it == dictionary.end() || *it != key)
+        throw std::invalid_argument("bitmap index: key " + std::to_string(key) + " is not in the dictionary");
+    return static_cast<int>(it - dictionary.begin());
+}
+
+// Slot vectors of the bitmaps of the main ciphertext holding `records`, laid
+// out like dbBatches(): record first + i in slot i of every slot block
+std::vector<std::vector<int64_t>> bitmapBatches(
+    const PDQParams& P,
+    const TestData& data,
+    const std::vector<uint64_t>& dictionary,
+    const CtxtRecords& records) {
+
+    std::vector<std::vector<int64_t>> batches(dictionary.size(), std::vector<int64_t>(P.degree, 0));
+    for (int64_t i = 0; i < records.count; i++) {
+        int v = dictionaryId(dictionary, data.keys[records.first + i]);
+        for (int r = 0; r < P.replicas; r++) batches[v][r * P.block_size + i] = 1;
+    }
+    return batches;
+}
+
+}  // namespace
+
+std::vector<uint64_t> keyDictionary(const TestData& data) {
+    std::vector<uint64_t> dictionary(data.keys);
+    std::sort(dictionary.begin(), dictionary.end());
+    dictionary.erase(std::unique(dictionary.begin(), dictionary.end()), dictionary.end());
+    return dictionary;
+}
+
+EncryptedBitmapIndex encryptBitmapIndex(
+    const PDQParams& P,
+    const CryptoContext<DCRTPoly>& context,
+    const PublicKey<DCRTPoly>& publicKey,
+    const TestData& data,
+    const std::vector<uint64_t>& dictionary,
+    const std::vector<CtxtRecords>& records) {
+
+    EncryptedBitmapIndex index;
+    index.dictionary = dictionary;
+    for (const auto& r : records) {
+        // Every bitmap is stored, empty or not: which keys a ciphertext holds stays hidden
+        std::vector<Ciphertext<DCRTPoly>> bitmaps;
+        for (const auto& batch : bitmapBatches(P, data, dictionary, r))
+            bitmaps.push_back(context->Encrypt(publicKey, context->MakePackedPlaintext(batch)));
+        index.bitmaps.push_back(std::move(bitmaps));
+    }
+    return index;
+}
+
+PlainBitmapIndex encodeBitmapIndex(
+    const PDQParams& P,
+    const CryptoContext<DCRTPoly>& context,
+    const TestData& data,
+    const std::vector<uint64_t>& dictionary,
+    const std::vector<CtxtRecords>& records) {
+
+    size_t towers = context->GetCryptoParameters()->GetElementParams()->GetParams().size();
+
+    PlainBitmapIndex index;
+    index.dictionary = dictionary;
+    for (const auto& r : records) {
+        auto batches = bitmapBatches(P, data, dictionary, r);
+        std::vector<int> ids;
+        std::vector<DCRTPoly> bitmaps;
+        for (size_t v = 0; v < batches.size(); v++) {
+            bool empty = std::none_of(batches[v].begin(), batches[v].end(), [](int64_t b) { return b != 0; });
+            // An all-padding ciphertext keeps one (zero) bitmap to multiply
+            if (empty && !(ids.empty() && v + 1 == batches.size())) continue;
+            ids.push_back(static_cast<int>(v));
+            bitmaps.push_back(encodeEval(context, batches[v], towers));
+        }
+        index.value_ids.push_back(std::move(ids));
+        index.bitmaps.push_back(std::move(bitmaps));
+    }
+    return index;
+}
+
+std::vector<Ciphertext<DCRTPoly>> encryptSelection(
+    const PDQParams& P,
+    const CryptoContext<DCRTPoly>& context,
+    const PublicKey<DCRTPoly>& publicKey,
+    const std::vector<uint64_t>& dictionary,
+    const std::vector<uint64_t>& keys) {
+
+    std::vector<bool> selected(dictionary.size(), false);
+    for (uint64_t key : keys) selected[dictionaryId(dictionary, key)] = true;
+
+    auto zeros = context->MakePackedPlaintext(std::vector<int64_t>(P.degree, 0));
+    auto ones = context->MakePackedPlaintext(std::vector<int64_t>(P.degree, 1));
+
+    std::vector<Ciphertext<DCRTPoly>> selection;
+    for (size_t v = 0; v < dictionary.size(); v++)
+        selection.push_back(context->Encrypt(publicKey, selected[v] ? ones : zeros));
+    return selection;
+}
+
+Ciphertext<DCRTPoly> matchBitmap(
+    const std::vector<Ciphertext<DCRTPoly>>& ctxt_bitmaps,
+    const std::vector<Ciphertext<DCRTPoly>>& ctxt_selection) {
+
+    if (ctxt_bitmaps.size() != ctxt_selection.size())
+        throw std::invalid_argument("matchBitmap: selection does not fit the dictionary");
+    auto context = ctxt_selection[0]->GetCryptoContext();
+
+    auto index = context->EvalMultNoRelin(ctxt_bitmaps[0], ctxt_selection[0]);
+    countOp(Op::EvalMult);
+    for (size_t v = 1; v < ctxt_bitmaps.size(); v++) {
+        context->EvalAddInPlace(index, context->EvalMultNoRelin(ctxt_bitmaps[v], ctxt_selection[v]));
+        countOp(Op::EvalMult);
+    }
+
+    context->RelinearizeInPlace(index);
+    countOp(Op::Relin);
+    countOp(Op::KeySwitch);
+    return index;
+}
+
+Ciphertext<DCRTPoly> matchBitmapPlain(
+    const std::vector<int>& value_ids,
+    const std::vector<DCRTPoly>& ptxt_bitmaps,
+    const std::vector<Ciphertext<DCRTPoly>>& ctxt_selection) {
+
+    auto index = multPlain(ctxt_selection.at(value_ids[0]), ptxt_bitmaps[0]);
+    for (size_t j = 1; j < value_ids.size(); j++)
+        multAccPlain(index, ctxt_selection.at(value_ids[j]), ptxt_bitmaps[j]);
+    return index;
+}
+
+std::vector<Ciphertext<DCRTPoly>> matchBitmap(
+    const EncryptedBitmapIndex& index,
+    const std::vector<Ciphertext<DCRTPoly>>& ctxt_selection) {
+
+    std::vector<Ciphertext<DCRTPoly>> result;
+    result.reserve(index.bitmaps.size());
+
+    for (const auto& bitmaps : index.bitmaps)
+        result.push_back(matchBitmap(bitmaps, ctxt_selection));
+
+    return result;
+}
+
+std::vector<Ciphertext<DCRTPoly>> matchBitmapPlain(
+    const PlainBitmapIndex& index,
+    const std::vector<Ciphertext<DCRTPoly>>& ctxt_selection) {
+
+    if (ctxt_selection.size() != index.dictionary.size())
+        throw std::invalid_argument("matchBitmapPlain: selection does not fit the dictionary");
+
+    std::vector<Ciphertext<DCRTPoly>> result;
+    result.reserve(index.bitmaps.size());
+
+    for (size_t c = 0; c < index.bitmaps.size(); c++)
+        result.push_back(matchBitmapPlain(index.value_ids[c], index.bitmaps[c], ctxt_selection));
+
+    return result;
+}
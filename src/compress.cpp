@@ -1,176 +1,292 @@
 #include "compress.h"
 #include "global.h"
+#include "instrument.h"
+#include "modp.h"
+#include "setup.h"
 
 using namespace lbcrypto;
 
 namespace {
 
-std::vector<std::vector<int64_t>> buildVandermondeMatrix() {
-    std::vector<std::vector<int64_t>> C(num_matching, std::vector<int64_t>(num_records));
-
-    for (int i = 0; i < num_records; i++) {
-        int64_t val = 1;
-        int64_t base = (i + 1) % ptxt_modulus;
-        for (int j = 0; j < num_matching; j++) {
-            val = (val * base) % ptxt_modulus;
-            C[j][i] = val;
+// Slot vectors of the diagonals (g_, b), g_ < g_bsgs, of trace ciphertext
+// trace_idx of a main ciphertext holding `records`.
+// After ring-switching, each main ciphertext produces dim_trace trace ciphertexts.
+// Trace ciphertext trace_idx has the following trace-slot-to-main-slot mapping:
+//   slot j:                     main slot trace_idx * degree_trace_half + j
+//   slot degree_trace_half + j: main slot degree_half + trace_idx * degree_trace_half + j
+// and main slot block * block_size + k holds db_idx = records.first + k, k < records.count
+// (a single block of all degree slots unless P.replicas > 1).
+// Diagonal slot k1 holds the Vandermonde entry C[row][db_idx] = (db_idx+1)^(row+1) mod p
+// with j = (k1 + b) % degree_trace_half and digest row (k1 - g * b_bsgs) mod digest_rows
+// = block * numrow_po2 + row; rows of other blocks' windows are 0.
+// Along g_ a slot keeps its db_idx while row advances by b_bsgs, so its entries
+// are generated by repeated multiplication with (db_idx+1)^b_bsgs; a power is
+// only recomputed where row wraps around or enters the block's window.
+template <class Mod>
+std::vector<std::vector<int64_t>> diagonalSlots(
+    const PDQParams& P, const Mod& mod, const CtxtRecords& records, int trace_idx, int b) {
+    int64_t slot_base[2] = {
+        int64_t(trace_idx) * P.degree_trace_half,
+        P.degree_half + int64_t(trace_idx) * P.degree_trace_half};
+    const int row_mask = P.digest_rows - 1;
+    const int half_mask = P.degree_trace_half - 1;
+
+    std::vector<std::vector<int64_t>> slots(P.g_bsgs, std::vector<int64_t>(P.degree_trace, 0));
+
+    for (int half = 0; half < 2; half++) {
+        for (int k1 = 0; k1 < P.degree_trace_half; k1++) {
+            int64_t slot = slot_base[half] + ((k1 + b) & half_mask);
+            if (slot % P.block_size >= records.count) continue;
+            int64_t db_idx = records.first + slot % P.block_size;
+            int window = static_cast<int>(slot / P.block_size) * P.numrow_po2;
+
+            uint64_t x = static_cast<uint64_t>(db_idx + 1) % mod.p;
+            uint64_t step = powMod(mod, x, P.b_bsgs);
+            int digest_row = (k1 - (P.g_bsgs - 1) * P.b_bsgs) & row_mask;
+            int prev = -1;    // row of pw
+            uint64_t pw = 0;
+
+            for (int g_ = 0; g_ < P.g_bsgs; g_++) {
+                int row = digest_row - window;
+                if (row >= 0 && row < P.num_matching) {
+                    pw = prev >= 0 && row == prev + P.b_bsgs ? mod.mul(pw, step) : powMod(mod, x, row + 1);
+                    prev = row;
+                    slots[g_][half * P.degree_trace_half + k1] = static_cast<int64_t>(pw);
+                }
+                digest_row = (digest_row + P.b_bsgs) & row_mask;
+            }
         }
     }
 
-    return C;
+    return slots;
 }
 
-// Precomputed BSGS plaintexts: ptxts[g_][i][b]
-using BSGSPlaintexts = std::vector<std::vector<std::vector<Plaintext>>>;
+// Encode the diagonals (g_, b) of trace ciphertext trace_idx into column
+void encodeDiagonals(
+    const PDQParams& P,
+    BSGSColumn& column,
+    const CryptoContext<DCRTPoly>& context,
+    size_t towers,
+    const CtxtRecords& records,
+    int trace_idx,
+    int b) {
+
+    auto slots = withPlainModulus(P.ptxt_modulus, [&](const auto& mod) {
+        return diagonalSlots(P, mod, records, trace_idx, b);
+    });
+    for (int g_ = 0; g_ < P.g_bsgs; g_++) {
+        int g = P.g_bsgs - g_ - 1;
+        if (g * P.b_bsgs + b >= P.digest_rows) continue;
+        column[g_][b] = encodeEval(context, slots[g_], towers);
+    }
+}
 
-// Precompute all plaintexts for BSGS matrix-vector multiply.
-// After ring-switching, each main ciphertext produces dim_trace trace ciphertexts.
-// Trace ciphertext i has the following slot-to-db_idx mapping:
-//   slot j:                     db_idx = orig_ctxt_idx * degree + trace_idx * degree_trace_half + j
-//   slot degree_trace_half + j: db_idx = orig_ctxt_idx * degree + degree_half + trace_idx * degree_trace_half + j
-BSGSPlaintexts precomputeBSGSPlaintexts(
-    const std::vector<std::vector<int64_t>>& M,
-    const CryptoContext<DCRTPoly>& context) {
+}  // namespace
 
-    int num_trace_ctxts = num_ctxts * dim_trace;
+// Precompute the BSGS plaintexts of one trace ciphertext.
+// Entries are generated per diagonal; the Vandermonde matrix is never built.
+BSGSColumn precomputeBSGSColumn(
+    const PDQParams& P,
+    const CryptoContext<DCRTPoly>& context,
+    size_t towers,
+    const CtxtRecords& records,
+    int trace_idx) {
 
-    BSGSPlaintexts ptxts(g_bsgs,
-        std::vector<std::vector<Plaintext>>(num_trace_ctxts,
-            std::vector<Plaintext>(b_bsgs)));
+    BSGSColumn column(P.g_bsgs, std::vector<DCRTPoly>(P.b_bsgs));
 
-    std::vector<int64_t> ptxt_vec(degree_trace);
+    for (int b = 0; b < P.b_bsgs; b++)
+        encodeDiagonals(P, column, context, towers, records, trace_idx, b);
 
-    for (int g_ = 0; g_ < g_bsgs; g_++) {
-        int g = g_bsgs - g_ - 1;
+    return column;
+}
 
-        for (int i = 0; i < num_trace_ctxts; i++) {
-            int orig_ctxt_idx = i / dim_trace;
-            int trace_idx = i % dim_trace;
+BSGSColumn precomputeBSGSColumn(
+    const PDQParams& P,
+    const CryptoContext<DCRTPoly>& context,
+    size_t towers,
+    int i) {
 
-            for (int b = 0; b < b_bsgs; b++) {
-                if (g * b_bsgs + b >= numrow_po2) break;
+    return precomputeBSGSColumn(P, context, towers, contiguousRecords(P, i / P.dim_trace), i % P.dim_trace);
+}
 
-                int idxr = (numrow_po2 - g * b_bsgs) % numrow_po2;
+BSGSPlaintexts precomputeBSGSPlaintexts(
+    const PDQParams& P,
+    const CryptoContext<DCRTPoly>& context,
+    size_t towers,
+    const std::vector<CtxtRecords>& records) {
 
-                for (int k1 = 0; k1 < degree_trace_half; k1++) {
-                    int j = (k1 + b) % degree_trace_half;
-                    int row = (idxr + k1) % numrow_po2;
+    int num_trace_ctxts = static_cast<int>(records.size()) * P.dim_trace;
 
-                    // First half
-                    int db_idx = orig_ctxt_idx * degree + trace_idx * degree_trace_half + j;
-                    ptxt_vec[k1] = (row < num_matching && db_idx < num_records)
-                        ? M[row][db_idx] : 0;
+    BSGSPlaintexts ptxts(num_trace_ctxts, BSGSColumn(P.g_bsgs, std::vector<DCRTPoly>(P.b_bsgs)));
 
-                    // Second half
-                    int db_idx2 = orig_ctxt_idx * degree + degree_half + trace_idx * degree_trace_half + j;
-                    ptxt_vec[degree_trace_half + k1] = (row < num_matching && db_idx2 < num_records)
-                        ? M[row][db_idx2] : 0;
-                }
+    // The packed-encoding tables are built lazily and not safe to build
+    // concurrently; build them before the parallel region
+    (void)encodeEval(context, std::vector<int64_t>(P.degree_trace, 0), towers);
 
-                ptxts[g_][i][b] = context->MakePackedPlaintext(ptxt_vec);
-            }
-        }
-    }
+    #pragma omp parallel for collapse(2) schedule(dynamic)
+    for (int i = 0; i < num_trace_ctxts; i++)
+        for (int b = 0; b < P.b_bsgs; b++)
+            encodeDiagonals(P, ptxts[i], context, towers, records[i / P.dim_trace], i % P.dim_trace, b);
 
     return ptxts;
 }
 
-// BSGS matrix-vector multiply using precomputed plaintexts.
-Ciphertext<DCRTPoly> evalBSGS(
-    const std::vector<Ciphertext<DCRTPoly>>& ctxt_v,
-    const BSGSPlaintexts& ptxts) {
+BSGSPlaintexts precomputeBSGSPlaintexts(
+    const PDQParams& P,
+    const CryptoContext<DCRTPoly>& context,
+    size_t towers) {
 
-    auto context = ctxt_v[0]->GetCryptoContext();
-    int num_trace_ctxts = ctxt_v.size();
+    return precomputeBSGSPlaintexts(P, context, towers, contiguousLayout(P));
+}
 
-    std::vector<std::vector<Ciphertext<DCRTPoly>>> rotated(num_trace_ctxts,
-        std::vector<Ciphertext<DCRTPoly>>(b_bsgs));
-    for (int i = 0; i < num_trace_ctxts; i++) {
-        rotated[i][0] = ctxt_v[i];
-        for (int b = 1; b < b_bsgs; b++) {
-            rotated[i][b] = context->EvalRotate(rotated[i][b-1], 1);
-        }
+// Baby steps of one trace ciphertext, folded into every giant-step sum.
+// Only the b_bsgs rotations of ctxt are alive at a time.
+void accumulateBSGS(
+    const PDQParams& P,
+    BSGSAccumulator& acc,
+    const Ciphertext<DCRTPoly>& ctxt,
+    const BSGSColumn& column) {
+
+    auto context = ctxt->GetCryptoContext();
+
+    // Reused across calls on this thread; emptied again below
+    thread_local std::vector<Ciphertext<DCRTPoly>> rotated;
+    rotated.resize(P.b_bsgs);
+    rotated[0] = ctxt;
+    for (int b = 1; b < P.b_bsgs; b++) {
+        rotated[b] = context->EvalRotate(rotated[b-1], 1);
+        countOp(Op::Rotate);
+        countOp(Op::KeySwitch);
     }
 
-    std::vector<Ciphertext<DCRTPoly>> giant(num_trace_ctxts);
-    Ciphertext<DCRTPoly> digest;
+    if (acc.giant.empty()) acc.giant.resize(P.g_bsgs);
 
-    for (int g_ = 0; g_ < g_bsgs; g_++) {
-        int g = g_bsgs - g_ - 1;
+    for (int g_ = 0; g_ < P.g_bsgs; g_++) {
+        int g = P.g_bsgs - g_ - 1;
 
-        for (int i = 0; i < num_trace_ctxts; i++) {
-            for (int b = 0; b < b_bsgs; b++) {
-                if (g * b_bsgs + b >= numrow_po2) break;
+        for (int b = 0; b < P.b_bsgs; b++) {
+            if (g * P.b_bsgs + b >= P.digest_rows) break;
 
-                if (b == 0) {
-                    giant[i] = context->EvalMult(rotated[i][b], ptxts[g_][i][b]);
-                } else {
-                    context->EvalAddInPlace(giant[i],
-                        context->EvalMult(rotated[i][b], ptxts[g_][i][b]));
-                }
+            if (!acc.giant[g_]) {
+                acc.giant[g_] = multPlain(rotated[b], column[g_][b]);
+            } else {
+                multAccPlain(acc.giant[g_], rotated[b], column[g_][b]);
             }
         }
+    }
+    rotated.clear();
+}
 
-        Ciphertext<DCRTPoly> sum = giant[0];
-        for (int i = 1; i < num_trace_ctxts; i++) {
-            context->EvalAddInPlace(sum, giant[i]);
-        }
+void mergeBSGS(BSGSAccumulator& into, const BSGSAccumulator& from) {
+    if (from.giant.empty()) return;
+    if (into.giant.empty()) {
+        for (const auto& ct : from.giant) into.giant.push_back(ct->Clone());
+        return;
+    }
+    auto context = from.giant[0]->GetCryptoContext();
+    for (size_t g_ = 0; g_ < from.giant.size(); g_++) context->EvalAddInPlace(into.giant[g_], from.giant[g_]);
+}
 
-        if (g_ == 0) {
-            digest = sum;
-        } else {
-            digest = context->EvalRotate(digest, b_bsgs);
-            context->EvalAddInPlace(digest, sum);
-        }
+// Giant steps (Horner over g) and the final slot folding
+Ciphertext<DCRTPoly> finishBSGS(const PDQParams& P, const BSGSAccumulator& acc) {
+    auto context = acc.giant[0]->GetCryptoContext();
+
+    Ciphertext<DCRTPoly> digest = acc.giant[0];
+    for (int g_ = 1; g_ < P.g_bsgs; g_++) {
+        digest = context->EvalRotate(digest, P.b_bsgs);
+        countOp(Op::Rotate);
+        countOp(Op::KeySwitch);
+        context->EvalAddInPlace(digest, acc.giant[g_]);
     }
 
-    for (int j = 1; j < degree_trace_half / numrow_po2; j *= 2) {
-        auto temp = context->EvalRotate(digest, numrow_po2 * j);
+    for (int j = 1; j < P.degree_trace_half / P.digest_rows; j *= 2) {
+        auto temp = context->EvalRotate(digest, P.digest_rows * j);
         context->EvalAddInPlace(digest, temp);
+        countOp(Op::Rotate);
+        countOp(Op::KeySwitch);
     }
-    auto temp = context->EvalRotate(digest, degree_trace_half);
+    auto temp = context->EvalRotate(digest, P.degree_trace_half);
     context->EvalAddInPlace(digest, temp);
+    countOp(Op::Rotate);
+    countOp(Op::KeySwitch);
 
     return digest;
 }
 
-}  // namespace
+// BSGS matrix-vector multiply using precomputed plaintexts.
+Ciphertext<DCRTPoly> evalBSGS(
+    const PDQParams& P,
+    const std::vector<Ciphertext<DCRTPoly>>& ctxt_v,
+    const BSGSPlaintexts& ptxts) {
 
-Ciphertext<DCRTPoly> compress(
-    const std::vector<Ciphertext<DCRTPoly>>& ctxt_masked,
-    const std::vector<Ciphertext<DCRTPoly>>& ctxt_index) {
+    BSGSAccumulator acc;
+    for (size_t i = 0; i < ctxt_v.size(); i++)
+        accumulateBSGS(P, acc, ctxt_v[i], ptxts[i]);
 
-    auto context = ctxt_masked[0]->GetCryptoContext();
+    return finishBSGS(P, acc);
+}
 
-    static auto C = buildVandermondeMatrix();
+Ciphertext<DCRTPoly> combineDigests(
+    const PDQParams& P,
+    const Ciphertext<DCRTPoly>& ctxt_e,
+    const Ciphertext<DCRTPoly>& ctxt_w,
+    Ciphertext<DCRTPoly>* digest_full) {
 
-    auto ptxts = precomputeBSGSPlaintexts(C, context);
-    auto ctxt_e = evalBSGS(ctxt_masked, ptxts);
-    auto ctxt_w = evalBSGS(ctxt_index, ptxts);
+    auto context = ctxt_e->GetCryptoContext();
+    size_t towers = ctxt_e->GetElements()[0].GetNumOfElements();
 
-    // Build masks to isolate different repetitions
-    // mask_e: 1s in first repetition [0, numrow_po2), 0s elsewhere
-    // mask_w: 1s in second repetition [numrow_po2, 2*numrow_po2), 0s elsewhere
-    std::vector<int64_t> mask_e_vec(degree_trace, 0);
-    std::vector<int64_t> mask_w_vec(degree_trace, 0);
+    // Build masks to isolate different repetitions (of all block windows)
+    // mask_e: 1s in first repetition [0, digest_rows), 0s elsewhere
+    // mask_w: 1s in second repetition [digest_rows, 2*digest_rows), 0s elsewhere
+    std::vector<int64_t> mask_e_vec(P.degree_trace, 0);
+    std::vector<int64_t> mask_w_vec(P.degree_trace, 0);
 
-    for (int j = 0; j < numrow_po2; j++) {
+    for (int j = 0; j < P.digest_rows; j++) {
         mask_e_vec[j] = 1;
-        mask_e_vec[degree_trace_half + j] = 1;
-        mask_w_vec[numrow_po2 + j] = 1;
-        mask_w_vec[degree_trace_half + numrow_po2 + j] = 1;
+        mask_e_vec[P.degree_trace_half + j] = 1;
+        mask_w_vec[P.digest_rows + j] = 1;
+        mask_w_vec[P.degree_trace_half + P.digest_rows + j] = 1;
     }
 
-    auto mask_e = context->MakePackedPlaintext(mask_e_vec);
-    auto mask_w = context->MakePackedPlaintext(mask_w_vec);
+    auto mask_e = encodeEval(context, mask_e_vec, towers);
+    auto mask_w = encodeEval(context, mask_w_vec, towers);
 
     // Mask and combine into single ciphertext
-    auto ctxt_e_masked = context->EvalMult(ctxt_e, mask_e);
-    auto ctxt_w_masked = context->EvalMult(ctxt_w, mask_w);
+    auto ctxt_e_masked = multPlain(ctxt_e, mask_e);
+    auto ctxt_w_masked = multPlain(ctxt_w, mask_w);
     auto digest = context->EvalAdd(ctxt_e_masked, ctxt_w_masked);
+    if (digest_full) *digest_full = digest;
 
     // Compress to reduce number of limbs
     digest = context->Compress(digest, 1);
 
     return digest;
 }
+
+Ciphertext<DCRTPoly> compress(
+    const PDQParams& P,
+    const std::vector<CtxtRecords>& records,
+    const std::vector<Ciphertext<DCRTPoly>>& ctxt_masked,
+    const std::vector<Ciphertext<DCRTPoly>>& ctxt_index,
+    Ciphertext<DCRTPoly>* digest_full) {
+
+    auto context = ctxt_masked[0]->GetCryptoContext();
+
+    // Ring-switched inputs may already be trimmed below the trace context's towers
+    size_t towers = ctxt_masked[0]->GetElements()[0].GetNumOfElements();
+
+    auto ptxts = precomputeBSGSPlaintexts(P, context, towers, records);
+    auto ctxt_e = evalBSGS(P, ctxt_masked, ptxts);
+    auto ctxt_w = evalBSGS(P, ctxt_index, ptxts);
+
+    return combineDigests(P, ctxt_e, ctxt_w, digest_full);
+}
+
+Ciphertext<DCRTPoly> compress(
+    const PDQParams& P,
+    const std::vector<Ciphertext<DCRTPoly>>& ctxt_masked,
+    const std::vector<Ciphertext<DCRTPoly>>& ctxt_index,
+    Ciphertext<DCRTPoly>* digest_full) {
+
+    return compress(P, contiguousLayout(P), ctxt_masked, ctxt_index, digest_full);
+}
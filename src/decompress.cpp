@@ -1,5 +1,6 @@
 #include "decompress.h"
 #include "global.h"
+#include "modp.h"
 
 #include <NTL/ZZ_pXFactoring.h>
 #include <iostream>
@@ -8,39 +9,96 @@ using namespace lbcrypto;
 
 namespace {
 
-// Reconstruct index set from power sums using Newton's identity + root-finding
-std::set<int64_t> decompressIndex(const std::vector<int64_t>& w) {
-    // Algorithm 1: ReconstIdx - recover index set from power sums
-    // w[k] = sum of i^(k+1) for all matching indices i (0-indexed)
-    int s = w.size();
-    std::set<int64_t> result;
+template <class Mod>
+uint64_t addMod(const Mod& mod, uint64_t a, uint64_t b) {
+    uint64_t r = a + b;
+    return r >= mod.p ? r - mod.p : r;
+}
 
-    // Set NTL modulus
-    NTL::ZZ_p::init(NTL::ZZ(ptxt_modulus));
+template <class Mod>
+uint64_t subMod(const Mod& mod, uint64_t a, uint64_t b) {
+    return a >= b ? a - b : a + mod.p - b;
+}
 
-    // Step 1: Compute elementary symmetric polynomials using Newton's identity
-    // a_k = (1/k) * sum_{i=1}^{k} (-1)^{i-1} * a_{k-i} * w_{i-1}
-    std::vector<NTL::ZZ_p> a(s + 1);
-    a[0] = NTL::ZZ_p(1);
+// Elementary symmetric polynomials a_0..a_s of the roots from the power sums w
+// (Newton's identity): a_k = (1/k) * sum_{i=1}^{k} (-1)^{i-1} * a_{k-i} * w_{i-1}
+template <class Mod>
+std::vector<uint64_t> elementarySymmetric(const Mod& mod, const std::vector<int64_t>& w_in) {
+    int s = w_in.size();
+    std::vector<uint64_t> w(s);
+    for (int i = 0; i < s; i++) w[i] = static_cast<uint64_t>(w_in[i]) % mod.p;
+
+    std::vector<uint64_t> a(s + 1);
+    a[0] = 1;
 
     for (int k = 1; k <= s; k++) {
-        NTL::ZZ_p sum(0);
+        uint64_t sum = 0;
         for (int i = 1; i <= k; i++) {
-            NTL::ZZ_p term = a[k - i] * NTL::ZZ_p(w[i - 1]);
-            if (i % 2 == 1) {
-                sum += term;
-            } else {
-                sum -= term;
-            }
+            uint64_t term = mod.mul(a[k - i], w[i - 1]);
+            sum = (i % 2 == 1) ? addMod(mod, sum, term) : subMod(mod, sum, term);
         }
-        a[k] = sum * NTL::inv(NTL::ZZ_p(k));
+        a[k] = mod.mul(sum, invMod(mod, k));
     }
+    return a;
+}
+
+// Solve C * d = e for d, where C[j][k] = x_k^{j+1}, x_k = indices[k] + 1
+template <class Mod>
+std::vector<uint64_t> solveVandermonde(
+    const Mod& mod,
+    const std::vector<int64_t>& indices,
+    const std::vector<int64_t>& e) {
+
+    int ell = indices.size();
+
+    // Nodes: x_k = indices[k] + 1 (1-based)
+    std::vector<uint64_t> x(ell);
+    for (int k = 0; k < ell; k++)
+        x[k] = static_cast<uint64_t>(indices[k] + 1) % mod.p;
+
+    // Substituting d'_k = x_k * d_k gives the transposed Vandermonde:
+    //   W * d' = e  where W[j][k] = x_k^j
+    std::vector<uint64_t> w(ell);
+    for (int j = 0; j < ell; j++)
+        w[j] = static_cast<uint64_t>(e[j]) % mod.p;
+
+    // Phase 1: Forward elimination
+    for (int i = 0; i < ell - 1; i++)
+        for (int j = ell - 1; j >= i + 1; j--)
+            w[j] = subMod(mod, w[j], mod.mul(x[i], w[j-1]));
+
+    // Phase 2: Divided differences + back substitution
+    for (int i = ell - 2; i >= 0; i--) {
+        for (int j = i + 1; j < ell; j++)
+            w[j] = mod.mul(w[j], invMod(mod, subMod(mod, x[j], x[j-i-1])));
+        for (int j = i; j < ell - 1; j++)
+            w[j] = subMod(mod, w[j], w[j+1]);
+    }
+
+    // w[k] = d'_k = x_k * d_k, so d_k = w[k] / x_k
+    for (int k = 0; k < ell; k++)
+        w[k] = mod.mul(w[k], invMod(mod, x[k]));
+    return w;
+}
+
+}  // namespace
+
+// Reconstruct index set from power sums using Newton's identity + root-finding
+std::set<int64_t> decompressIndex(const PDQParams& P, const std::vector<int64_t>& w) {
+    // Algorithm 1: ReconstIdx - recover index set from power sums
+    // w[k] = sum of i^(k+1) for all matching indices i (0-indexed)
+    int s = w.size();
+    std::set<int64_t> result;
+
+    // Step 1: Compute elementary symmetric polynomials using Newton's identity
+    auto a = withPlainModulus(P.ptxt_modulus, [&](const auto& mod) { return elementarySymmetric(mod, w); });
 
     // Step 2: Build polynomial f(X) = sum_{k=0}^{s} (-1)^k * a_k * X^{s-k}
     // f(X) = X^s - a_1*X^{s-1} + a_2*X^{s-2} - ... + (-1)^s * a_s
+    NTL::ZZ_p::init(NTL::ZZ(P.ptxt_modulus));
     NTL::ZZ_pX f;
     for (int k = 0; k <= s; k++) {
-        NTL::ZZ_p coeff = a[k];
+        NTL::ZZ_p coeff(static_cast<long>(a[k]));
         if (k % 2 == 1) {
             coeff = -coeff;
         }
@@ -57,7 +115,7 @@ std::set<int64_t> decompressIndex(const std::vector<int64_t>& w) {
             // Linear factor (X - root) -> root = -constant/leading
             NTL::ZZ_p root = -NTL::ConstTerm(factors[i].a) / NTL::LeadCoeff(factors[i].a);
             long root_val = NTL::conv<long>(NTL::rep(root));
-            if (root_val > 0 && root_val <= num_records) {
+            if (root_val > 0 && root_val <= P.num_records) {
                 // Convert from 1-based index to 0-based
                 result.insert(root_val - 1);
             }
@@ -70,6 +128,7 @@ std::set<int64_t> decompressIndex(const std::vector<int64_t>& w) {
 // Reconstruct data values from compressed data and index set
 // Uses transposed Björck-Pereyra algorithm for Vandermonde systems (O(s²))
 std::vector<std::pair<int64_t, int64_t>> reconstruct(
+    const PDQParams& P,
     const std::vector<int64_t>& e,
     const std::set<int64_t>& index_set) {
 
@@ -78,74 +137,60 @@ std::vector<std::pair<int64_t, int64_t>> reconstruct(
 
     if (ell == 0) return result;
 
-    NTL::ZZ_p::init(NTL::ZZ(ptxt_modulus));
-
     std::vector<int64_t> indices(index_set.begin(), index_set.end());
+    auto values = withPlainModulus(P.ptxt_modulus, [&](const auto& mod) { return solveVandermonde(mod, indices, e); });
 
-    // Nodes: x_k = indices[k] + 1 (1-based)
-    std::vector<NTL::ZZ_p> x(ell);
     for (int k = 0; k < ell; k++)
-        x[k] = NTL::ZZ_p((indices[k] + 1) % ptxt_modulus);
-
-    // The system is C * d = e where C[j][k] = x_k^{j+1}.
-    // Substituting d'_k = x_k * d_k gives the transposed Vandermonde:
-    //   W * d' = e  where W[j][k] = x_k^j
-    std::vector<NTL::ZZ_p> w(ell);
-    for (int j = 0; j < ell; j++)
-        w[j] = NTL::ZZ_p(e[j]);
-
-    // Phase 1: Forward elimination
-    for (int i = 0; i < ell - 1; i++)
-        for (int j = ell - 1; j >= i + 1; j--)
-            w[j] = w[j] - x[i] * w[j-1];
-
-    // Phase 2: Divided differences + back substitution
-    for (int i = ell - 2; i >= 0; i--) {
-        for (int j = i + 1; j < ell; j++)
-            w[j] = w[j] / (x[j] - x[j-i-1]);
-        for (int j = i; j < ell - 1; j++)
-            w[j] = w[j] - w[j+1];
-    }
-
-    // w[k] = d'_k = x_k * d_k, so d_k = w[k] / x_k
-    for (int k = 0; k < ell; k++) {
-        int64_t idx = indices[k];
-        int64_t val = NTL::conv<long>(NTL::rep(w[k] / x[k]));
-        result.push_back({idx, val});
-    }
+        result.push_back({indices[k], static_cast<int64_t>(values[k])});
 
     return result;
 }
 
-}  // namespace
-
-std::vector<std::pair<int64_t, int64_t>> recover(
+std::vector<std::vector<std::pair<int64_t, int64_t>>> recoverBlocks(
+    const PDQParams& P,
     const PrivateKey<DCRTPoly>& sk,
-    const Ciphertext<DCRTPoly>& ctxt_digest) {
+    const Ciphertext<DCRTPoly>& ctxt_digest,
+    int num_blocks) {
 
     auto context = ctxt_digest->GetCryptoContext();
 
     // Decrypt combined digest
     Plaintext ptxt;
     context->Decrypt(sk, ctxt_digest, &ptxt);
-    ptxt->SetLength(numrow_po2 + num_matching);
+    ptxt->SetLength(2 * P.digest_rows);
     auto vals = ptxt->GetPackedValue();
 
-    // Extract e from first repetition [0, num_matching)
-    // Extract w from second repetition [numrow_po2, numrow_po2 + num_matching)
-    std::vector<int64_t> e(num_matching);
-    std::vector<int64_t> w(num_matching);
+    std::vector<std::vector<std::pair<int64_t, int64_t>>> result;
+    int64_t p = P.ptxt_modulus;
+
+    for (int block = 0; block < num_blocks; block++) {
+        // Extract e from the block's window of the first repetition [0, digest_rows)
+        // Extract w from its window of the second repetition [digest_rows, 2*digest_rows)
+        int window = block * P.numrow_po2;
+        std::vector<int64_t> e(P.num_matching);
+        std::vector<int64_t> w(P.num_matching);
 
-    for (int j = 0; j < num_matching; j++) {
-        e[j] = ((vals[j] % ptxt_modulus) + ptxt_modulus) % ptxt_modulus;
-        w[j] = ((vals[numrow_po2 + j] % ptxt_modulus) + ptxt_modulus) % ptxt_modulus;
+        for (int j = 0; j < P.num_matching; j++) {
+            e[j] = ((vals[window + j] % p) + p) % p;
+            w[j] = ((vals[P.digest_rows + window + j] % p) + p) % p;
+        }
+
+        // Reconstruct index set from power sums w
+        auto index_set = decompressIndex(P, w);
+
+        // Reconstruct data from e and index set
+        result.push_back(reconstruct(P, e, index_set));
     }
 
-    // Reconstruct index set from power sums w
-    auto index_set = decompressIndex(w);
+    return result;
+}
+
+std::vector<std::pair<int64_t, int64_t>> recover(
+    const PDQParams& P,
+    const PrivateKey<DCRTPoly>& sk,
+    const Ciphertext<DCRTPoly>& ctxt_digest) {
 
-    // Reconstruct data from e and index set
-    return reconstruct(e, index_set);
+    return recoverBlocks(P, sk, ctxt_digest, 1)[0];
 }
 
 bool checkResult(
@@ -0,0 +1,260 @@
+#include "frontend.h"
+#include "binio.h"
+#include "wire.h"
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace lbcrypto;
+
+namespace {
+
+void sendAll(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = ::send(fd, data, len, MSG_NOSIGNAL);
+        if (n <= 0) throw std::runtime_error("connection closed");
+        data += n;
+        len -= n;
+    }
+}
+
+// False on a clean end of stream before the first byte
+bool recvAll(int fd, char* data, size_t len) {
+    size_t total = 0;
+    while (total < len) {
+        ssize_t n = ::recv(fd, data + total, len - total, 0);
+        if (n <= 0) {
+            if (total == 0 && n == 0) return false;
+            throw std::runtime_error("connection closed");
+        }
+        total += n;
+    }
+    return true;
+}
+
+void sendFrame(int fd, const std::string& payload) {
+    uint32_t len = static_cast<uint32_t>(payload.size());
+    sendAll(fd, reinterpret_cast<const char*>(&len), sizeof(len));
+    sendAll(fd, payload.data(), payload.size());
+}
+
+// Frame whose payload holds raw ciphertexts: one gather write, limbs sent in place
+void sendFrame(int fd, const WireBatch& payload) {
+    uint32_t len = static_cast<uint32_t>(payload.size());
+    std::vector<iovec> iov{{&len, sizeof(len)}};
+    iov.insert(iov.end(), payload.iovecs().begin(), payload.iovecs().end());
+    writeAll(fd, std::move(iov));
+}
+
+// Incremental reader of one frame's payload, straight from the socket
+struct FrameReader {
+    int fd;
+    size_t remaining;
+
+    void read(char* data, size_t len) {
+        if (len > remaining) throw std::runtime_error("truncated frame");
+        if (len > 0 && !recvAll(fd, data, len)) throw std::runtime_error("connection closed");
+        remaining -= len;
+    }
+    uint32_t readU32() {
+        uint32_t v = 0;
+        read(reinterpret_cast<char*>(&v), sizeof(v));
+        return v;
+    }
+    std::string readRest() {
+        std::string s(remaining, '\0');
+        read(&s[0], s.size());
+        return s;
+    }
+    // Discard the rest of the payload without holding it
+    void skipRest() {
+        char buf[4096];
+        while (remaining > 0) read(buf, std::min(remaining, sizeof(buf)));
+    }
+    Ciphertext<DCRTPoly> readCiphertext() {
+        return readWireCiphertext([this](char* data, size_t len) { read(data, len); });
+    }
+};
+
+// False on a clean end of stream before the frame
+bool beginFrame(int fd, FrameReader& frame, size_t max_bytes = SIZE_MAX) {
+    uint32_t len = 0;
+    if (!recvAll(fd, reinterpret_cast<char*>(&len), sizeof(len))) return false;
+    if (len > max_bytes) throw std::runtime_error("frame too large");
+    frame = {fd, len};
+    return true;
+}
+
+std::string response(QueryStatus status, const std::string& body) {
+    std::ostringstream os;
+    writeU32(os, static_cast<uint32_t>(status));
+    os << body;
+    return os.str();
+}
+
+// Connections still open, so that shutdown can unblock their (detached)
+// threads and wait for them
+struct LiveConnections {
+    std::mutex mutex;
+    std::condition_variable closed;
+    std::set<int> fds;
+};
+
+void handleConnection(QueryBackend& backend, int fd, const FrontendLimits& limits, LiveConnections& live) {
+    try {
+        FrameReader request;
+        while (beginFrame(fd, request, limits.max_frame_bytes)) {
+            auto type = static_cast<RequestType>(request.readU32());
+
+            if (type == RequestType::Stats) {
+                sendFrame(fd, response(QueryStatus::OK, backend.statsJSON()));
+            } else if (type == RequestType::Query) {
+                auto kind = static_cast<QueryKind>(request.readU32());
+                uint32_t limbs = request.readU32();
+                if (limbs > limits.max_key_limbs) {
+                    request.skipRest();
+                    sendFrame(fd, response(QueryStatus::Failed, "query has " + std::to_string(limbs) +
+                                           " key limbs, at most " + std::to_string(limits.max_key_limbs)));
+                    continue;
+                }
+                EncryptedKey ctxt_query(limbs);
+                for (auto& ct : ctxt_query) ct = request.readCiphertext();
+                if (request.remaining != 0) throw std::runtime_error("trailing bytes in request");
+
+                auto result = kind <= QueryKind::Sum ? backend.run(ctxt_query, kind)
+                    : QueryResult{QueryStatus::Failed, nullptr, "unknown query kind"};
+                if (result.status == QueryStatus::OK) {
+                    WireBatch reply;
+                    reply.addU32(static_cast<uint32_t>(result.status));
+                    reply.add(result.digest);
+                    sendFrame(fd, reply);
+                } else {
+                    sendFrame(fd, response(result.status, result.error));
+                }
+            } else {
+                request.skipRest();
+                sendFrame(fd, response(QueryStatus::Failed, "unknown request type"));
+            }
+        }
+    } catch (const std::exception&) {
+        // Broken connection; drop it
+    }
+    std::lock_guard<std::mutex> lock(live.mutex);
+    live.fds.erase(fd);
+    ::close(fd);
+    live.closed.notify_all();
+}
+
+}  // namespace
+
+FrontendLimits queryLimits(const PDQParams& P, const CryptoContext<DCRTPoly>& context) {
+    size_t towers = context->GetElementParams()->GetParams().size();
+    size_t ciphertext_bytes = sizeof(WireHeader) + WIRE_MAX_TAG_BYTES + 3 * towers * P.degree * sizeof(uint64_t);
+    return {static_cast<uint32_t>(P.key_limbs), 3 * sizeof(uint32_t) + P.key_limbs * ciphertext_bytes};
+}
+
+void serveUnixSocket(QueryBackend& backend, const std::string& path, const FrontendLimits& limits,
+                     const std::atomic<bool>& stop) {
+    int listen_fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0) throw std::runtime_error("cannot create socket");
+
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) throw std::runtime_error("socket path too long: " + path);
+    std::copy(path.begin(), path.end(), addr.sun_path);
+    ::unlink(path.c_str());
+
+    if (::bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 ||
+        ::listen(listen_fd, 64) < 0) {
+        ::close(listen_fd);
+        throw std::runtime_error("cannot listen on " + path);
+    }
+
+    LiveConnections live;
+    while (!stop.load()) {
+        pollfd pfd{listen_fd, POLLIN, 0};
+        if (::poll(&pfd, 1, 200) <= 0) continue;
+        int fd = ::accept(listen_fd, nullptr, nullptr);
+        if (fd < 0) continue;
+        {
+            std::lock_guard<std::mutex> lock(live.mutex);
+            live.fds.insert(fd);
+        }
+        // Detached: a connection's thread ends with it, and only the open ones are waited for
+        std::thread(handleConnection, std::ref(backend), fd, std::cref(limits), std::ref(live)).detach();
+    }
+
+    // Unblock connection threads waiting for their next request, then wait
+    // until every one has closed its connection
+    {
+        std::unique_lock<std::mutex> lock(live.mutex);
+        for (int fd : live.fds) ::shutdown(fd, SHUT_RDWR);
+        live.closed.wait(lock, [&] { return live.fds.empty(); });
+    }
+    ::close(listen_fd);
+    ::unlink(path.c_str());
+}
+
+int connectUnixSocket(const std::string& path) {
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) throw std::runtime_error("cannot create socket");
+
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) throw std::runtime_error("socket path too long: " + path);
+    std::copy(path.begin(), path.end(), addr.sun_path);
+
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+        ::close(fd);
+        throw std::runtime_error("cannot connect to " + path);
+    }
+    return fd;
+}
+
+void sendQuery(int fd, const EncryptedKey& ctxt_query, QueryKind kind) {
+    WireBatch request;
+    request.addU32(static_cast<uint32_t>(RequestType::Query));
+    request.addU32(static_cast<uint32_t>(kind));
+    request.addU32(static_cast<uint32_t>(ctxt_query.size()));
+    for (const auto& ct : ctxt_query) request.add(ct);
+    sendFrame(fd, request);
+}
+
+QueryResult receiveResult(int fd) {
+    FrameReader reply;
+    if (!beginFrame(fd, reply)) throw std::runtime_error("connection closed");
+    auto status = static_cast<QueryStatus>(reply.readU32());
+
+    if (status == QueryStatus::OK) {
+        auto digest = reply.readCiphertext();
+        if (reply.remaining != 0) throw std::runtime_error("trailing bytes in reply");
+        return {status, digest, ""};
+    }
+    return {status, nullptr, reply.readRest()};
+}
+
+QueryResult remoteQuery(int fd, const EncryptedKey& ctxt_query, QueryKind kind) {
+    sendQuery(fd, ctxt_query, kind);
+    return receiveResult(fd);
+}
+
+std::string remoteStats(int fd) {
+    std::ostringstream os;
+    writeU32(os, static_cast<uint32_t>(RequestType::Stats));
+    sendFrame(fd, os.str());
+
+    FrameReader reply;
+    if (!beginFrame(fd, reply)) throw std::runtime_error("connection closed");
+    reply.readU32();
+    return reply.readRest();
+}
@@ -0,0 +1,165 @@
+#include "instrument.h"
+#include "global.h"
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <mutex>
+#include <sys/resource.h>
+
+namespace {
+
+// Counters live in per-thread slots, summed at phase boundaries, so counting
+// from many threads does not contend on one cache line. Threads beyond
+// COUNTER_SLOTS share slots, which is why the slots stay atomic.
+constexpr int COUNTER_SLOTS = 256;
+
+struct alignas(64) ThreadCounters {
+    std::atomic<uint64_t> ops[NUM_OPS];
+    std::atomic<uint64_t> alloc_bytes;
+    std::atomic<uint64_t> alloc_count;
+};
+
+ThreadCounters counter_slots[COUNTER_SLOTS];
+std::atomic<int> next_slot{0};
+// Constant-initialized, so the first use from operator new does not allocate
+thread_local int thread_slot = -1;
+
+ThreadCounters& threadCounters() {
+    if (thread_slot < 0) thread_slot = next_slot.fetch_add(1, std::memory_order_relaxed) % COUNTER_SLOTS;
+    return counter_slots[thread_slot];
+}
+
+struct CounterTotals {
+    uint64_t ops[NUM_OPS] = {};
+    uint64_t alloc_bytes = 0;
+    uint64_t alloc_count = 0;
+};
+
+CounterTotals counterTotals() {
+    CounterTotals t;
+    for (const auto& slot : counter_slots) {
+        for (int i = 0; i < NUM_OPS; i++) t.ops[i] += slot.ops[i].load(std::memory_order_relaxed);
+        t.alloc_bytes += slot.alloc_bytes.load(std::memory_order_relaxed);
+        t.alloc_count += slot.alloc_count.load(std::memory_order_relaxed);
+    }
+    return t;
+}
+
+struct PhaseStart {
+    std::string name;
+    CounterTotals counters;
+    std::chrono::steady_clock::time_point wall;
+    double cpu;
+};
+
+thread_local std::vector<PhaseStart> phase_stack;
+
+std::mutex phases_mutex;
+std::vector<PhaseMetrics> phases;
+
+double processCPUSeconds() {
+    timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+uint64_t peakRSSKB() {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return static_cast<uint64_t>(usage.ru_maxrss);
+}
+
+}  // namespace
+
+// =============================================================================
+// Counters and phases
+// =============================================================================
+
+const char* opName(Op op) {
+    switch (op) {
+        case Op::EvalMult:      return "EvalMult";
+        case Op::EvalMultPlain: return "EvalMultPlain";
+        case Op::Relin:         return "Relin";
+        case Op::Rotate:        return "Rotate";
+        case Op::KeySwitch:     return "KeySwitch";
+        case Op::PdqNTT:        return "pdq_ntt";
+        case Op::Encode:        return "Encode";
+        default:                return "Unknown";
+    }
+}
+
+void countOp(Op op, uint64_t n) {
+    threadCounters().ops[static_cast<int>(op)].fetch_add(n, std::memory_order_relaxed);
+}
+
+void countAlloc(uint64_t bytes) {
+    ThreadCounters& counters = threadCounters();
+    counters.alloc_bytes.fetch_add(bytes, std::memory_order_relaxed);
+    counters.alloc_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+void beginPhase(const std::string& name) {
+    PhaseStart start;
+    start.name = name;
+    start.counters = counterTotals();
+    start.cpu = processCPUSeconds();
+    start.wall = std::chrono::steady_clock::now();
+    phase_stack.push_back(std::move(start));
+}
+
+void endPhase() {
+    auto wall = std::chrono::steady_clock::now();
+    double cpu = processCPUSeconds();
+    CounterTotals end = counterTotals();
+
+    const PhaseStart& start = phase_stack.back();
+    PhaseMetrics m;
+    m.name = start.name;
+    for (int i = 0; i < NUM_OPS; i++) m.ops[i] = end.ops[i] - start.counters.ops[i];
+    m.wall_sec = std::chrono::duration<double>(wall - start.wall).count();
+    m.cpu_sec = cpu - start.cpu;
+    m.alloc_bytes = end.alloc_bytes - start.counters.alloc_bytes;
+    m.alloc_count = end.alloc_count - start.counters.alloc_count;
+    m.peak_rss_kb = peakRSSKB();
+    phase_stack.pop_back();
+
+    std::lock_guard<std::mutex> lock(phases_mutex);
+    phases.push_back(std::move(m));
+}
+
+std::vector<PhaseMetrics> recordedPhases() {
+    std::lock_guard<std::mutex> lock(phases_mutex);
+    return phases;
+}
+
+void resetMetrics() {
+    std::lock_guard<std::mutex> lock(phases_mutex);
+    phases.clear();
+}
+
+void writeMetricsJSON(std::ostream& os, const PDQParams& P) {
+    auto recorded = recordedPhases();
+
+    os << "{\n";
+    os << "  \"params\": {\"N\": " << P.num_records << ", \"s\": " << P.num_matching
+       << ", \"p\": " << P.ptxt_modulus << ", \"n\": " << P.degree
+       << ", \"n_trace\": " << P.degree_trace << "},\n";
+    os << "  \"phases\": [";
+    for (size_t i = 0; i < recorded.size(); i++) {
+        const auto& m = recorded[i];
+        os << (i ? "," : "") << "\n    {\"name\": \"" << m.name << "\""
+           << ", \"wall_sec\": " << m.wall_sec
+           << ", \"cpu_sec\": " << m.cpu_sec;
+#ifdef PDQ_COUNT_ALLOCS
+        os << ", \"alloc_bytes\": " << m.alloc_bytes
+           << ", \"alloc_count\": " << m.alloc_count;
+#endif
+        os << ", \"peak_rss_kb\": " << m.peak_rss_kb
+           << ", \"ops\": {";
+        for (int j = 0; j < NUM_OPS; j++) {
+            os << (j ? ", " : "") << "\"" << opName(static_cast<Op>(j)) << "\": " << m.ops[j];
+        }
+        os << "}}";
+    }
+    os << "\n  ]\n}\n";
+}
@@ -0,0 +1,276 @@
+#include "kernels.h"
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+// GCC flags _mm512_undefined_epi32() inside its own AVX-512 headers
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#include <immintrin.h>
+#define PDQ_X86_KERNELS 1
+#endif
+
+#ifdef PDQ_WITH_HEXL
+#include "hexl/hexl.hpp"
+#endif
+
+using namespace lbcrypto;
+
+namespace {
+
+// Barrett reduction of x < q^2 + q with q of s bits (s <= 62):
+//   mu = floor(2^(2s) / q),  t = ((x >> (s-1)) * mu) >> (s+1),  x - t*q < 3q
+struct Barrett {
+    uint64_t q;
+    uint64_t mu;
+    int s;
+
+    explicit Barrett(uint64_t q) : q(q), s(64 - __builtin_clzll(q)) {
+        mu = static_cast<uint64_t>((static_cast<unsigned __int128>(1) << (2 * s)) / q);
+    }
+};
+
+// =============================================================================
+// Scalar
+// =============================================================================
+
+void mulAddScalar(uint64_t* acc, const uint64_t* a, const uint64_t* b, size_t n, const Barrett& br) {
+    for (size_t k = 0; k < n; k++) {
+        unsigned __int128 x = static_cast<unsigned __int128>(a[k]) * b[k] + acc[k];
+        uint64_t q1 = static_cast<uint64_t>(x >> (br.s - 1));
+        uint64_t t = static_cast<uint64_t>((static_cast<unsigned __int128>(q1) * br.mu) >> (br.s + 1));
+        uint64_t r = static_cast<uint64_t>(x) - t * br.q;
+        if (r >= br.q) r -= br.q;
+        if (r >= br.q) r -= br.q;
+        acc[k] = r;
+    }
+}
+
+#ifdef PDQ_X86_KERNELS
+
+// =============================================================================
+// AVX2: 4 lanes; 64x64 -> 128 products from 32-bit partial products
+// =============================================================================
+
+__attribute__((target("avx2")))
+inline void mul128Avx2(__m256i a, __m256i b, __m256i& hi, __m256i& lo) {
+    const __m256i low32 = _mm256_set1_epi64x(0xffffffff);
+    __m256i a1 = _mm256_srli_epi64(a, 32);
+    __m256i b1 = _mm256_srli_epi64(b, 32);
+    __m256i p00 = _mm256_mul_epu32(a, b);
+    __m256i p01 = _mm256_mul_epu32(a, b1);
+    __m256i p10 = _mm256_mul_epu32(a1, b);
+    __m256i p11 = _mm256_mul_epu32(a1, b1);
+    __m256i mid = _mm256_add_epi64(_mm256_srli_epi64(p00, 32),
+                  _mm256_add_epi64(_mm256_and_si256(p01, low32), _mm256_and_si256(p10, low32)));
+    lo = _mm256_or_si256(_mm256_and_si256(p00, low32), _mm256_slli_epi64(mid, 32));
+    hi = _mm256_add_epi64(_mm256_add_epi64(p11, _mm256_srli_epi64(mid, 32)),
+         _mm256_add_epi64(_mm256_srli_epi64(p01, 32), _mm256_srli_epi64(p10, 32)));
+}
+
+// x - q if x >= q (unsigned compare through the sign bit)
+__attribute__((target("avx2")))
+inline __m256i reduceOnceAvx2(__m256i x, __m256i q, __m256i sign) {
+    __m256i lt = _mm256_cmpgt_epi64(_mm256_xor_si256(q, sign), _mm256_xor_si256(x, sign));
+    return _mm256_sub_epi64(x, _mm256_andnot_si256(lt, q));
+}
+
+__attribute__((target("avx2")))
+void mulAddAvx2(uint64_t* acc, const uint64_t* a, const uint64_t* b, size_t n, const Barrett& br) {
+    const __m256i q = _mm256_set1_epi64x(static_cast<long long>(br.q));
+    const __m256i mu = _mm256_set1_epi64x(static_cast<long long>(br.mu));
+    const __m256i sign = _mm256_set1_epi64x(static_cast<long long>(1ULL << 63));
+    const __m128i sh_q1_lo = _mm_cvtsi32_si128(br.s - 1);
+    const __m128i sh_q1_hi = _mm_cvtsi32_si128(65 - br.s);
+    const __m128i sh_t_lo = _mm_cvtsi32_si128(br.s + 1);
+    const __m128i sh_t_hi = _mm_cvtsi32_si128(63 - br.s);
+
+    size_t k = 0;
+    for (; k + 4 <= n; k += 4) {
+        __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + k));
+        __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + k));
+        __m256i vc = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(acc + k));
+
+        __m256i hi, lo;
+        mul128Avx2(va, vb, hi, lo);
+        __m256i sum = _mm256_add_epi64(lo, vc);
+        // carry when sum < c (unsigned compare through the sign bit)
+        __m256i carry = _mm256_cmpgt_epi64(_mm256_xor_si256(vc, sign), _mm256_xor_si256(sum, sign));
+        hi = _mm256_sub_epi64(hi, carry);
+
+        __m256i q1 = _mm256_or_si256(_mm256_srl_epi64(sum, sh_q1_lo), _mm256_sll_epi64(hi, sh_q1_hi));
+        __m256i thi, tlo;
+        mul128Avx2(q1, mu, thi, tlo);
+        __m256i t = _mm256_or_si256(_mm256_srl_epi64(tlo, sh_t_lo), _mm256_sll_epi64(thi, sh_t_hi));
+
+        __m256i tq_hi, tq_lo;
+        mul128Avx2(t, q, tq_hi, tq_lo);
+        __m256i r = _mm256_sub_epi64(sum, tq_lo);
+        r = reduceOnceAvx2(r, q, sign);
+        r = reduceOnceAvx2(r, q, sign);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(acc + k), r);
+    }
+    mulAddScalar(acc + k, a + k, b + k, n - k, br);
+}
+
+// =============================================================================
+// AVX-512 (F + DQ): 8 lanes
+// =============================================================================
+
+__attribute__((target("avx512f,avx512dq")))
+inline void mul128Avx512(__m512i a, __m512i b, __m512i& hi, __m512i& lo) {
+    const __m512i low32 = _mm512_set1_epi64(0xffffffff);
+    __m512i a1 = _mm512_srli_epi64(a, 32);
+    __m512i b1 = _mm512_srli_epi64(b, 32);
+    __m512i p00 = _mm512_mul_epu32(a, b);
+    __m512i p01 = _mm512_mul_epu32(a, b1);
+    __m512i p10 = _mm512_mul_epu32(a1, b);
+    __m512i p11 = _mm512_mul_epu32(a1, b1);
+    __m512i mid = _mm512_add_epi64(_mm512_srli_epi64(p00, 32),
+                  _mm512_add_epi64(_mm512_and_si512(p01, low32), _mm512_and_si512(p10, low32)));
+    lo = _mm512_mullo_epi64(a, b);
+    hi = _mm512_add_epi64(_mm512_add_epi64(p11, _mm512_srli_epi64(mid, 32)),
+         _mm512_add_epi64(_mm512_srli_epi64(p01, 32), _mm512_srli_epi64(p10, 32)));
+}
+
+__attribute__((target("avx512f,avx512dq")))
+void mulAddAvx512(uint64_t* acc, const uint64_t* a, const uint64_t* b, size_t n, const Barrett& br) {
+    const __m512i q = _mm512_set1_epi64(static_cast<long long>(br.q));
+    const __m512i mu = _mm512_set1_epi64(static_cast<long long>(br.mu));
+    const __m512i one = _mm512_set1_epi64(1);
+    const __m128i sh_q1_lo = _mm_cvtsi32_si128(br.s - 1);
+    const __m128i sh_q1_hi = _mm_cvtsi32_si128(65 - br.s);
+    const __m128i sh_t_lo = _mm_cvtsi32_si128(br.s + 1);
+    const __m128i sh_t_hi = _mm_cvtsi32_si128(63 - br.s);
+
+    size_t k = 0;
+    for (; k + 8 <= n; k += 8) {
+        __m512i va = _mm512_loadu_si512(a + k);
+        __m512i vb = _mm512_loadu_si512(b + k);
+        __m512i vc = _mm512_loadu_si512(acc + k);
+
+        __m512i hi, lo;
+        mul128Avx512(va, vb, hi, lo);
+        __m512i sum = _mm512_add_epi64(lo, vc);
+        hi = _mm512_mask_add_epi64(hi, _mm512_cmplt_epu64_mask(sum, vc), hi, one);
+
+        __m512i q1 = _mm512_or_si512(_mm512_srl_epi64(sum, sh_q1_lo), _mm512_sll_epi64(hi, sh_q1_hi));
+        __m512i thi, tlo;
+        mul128Avx512(q1, mu, thi, tlo);
+        __m512i t = _mm512_or_si512(_mm512_srl_epi64(tlo, sh_t_lo), _mm512_sll_epi64(thi, sh_t_hi));
+
+        __m512i r = _mm512_sub_epi64(sum, _mm512_mullo_epi64(t, q));
+        r = _mm512_min_epu64(r, _mm512_sub_epi64(r, q));
+        r = _mm512_min_epu64(r, _mm512_sub_epi64(r, q));
+        _mm512_storeu_si512(acc + k, r);
+    }
+    mulAddScalar(acc + k, a + k, b + k, n - k, br);
+}
+
+#pragma GCC diagnostic pop
+#endif  // PDQ_X86_KERNELS
+
+#ifdef PDQ_WITH_HEXL
+
+// HEXL has no vector-vector fused multiply-add; multiply into a per-thread
+// scratch buffer, then add in place (both passes vectorized by HEXL)
+void mulAddHexl(uint64_t* acc, const uint64_t* a, const uint64_t* b, size_t n, const Barrett& br) {
+    thread_local std::vector<uint64_t> product;
+    product.resize(n);
+    intel::hexl::EltwiseMultMod(product.data(), a, b, n, br.q, 1);
+    intel::hexl::EltwiseAddMod(acc, acc, product.data(), n, br.q);
+}
+
+#endif  // PDQ_WITH_HEXL
+
+// =============================================================================
+// Dispatch
+// =============================================================================
+
+using MulAddFn = void (*)(uint64_t*, const uint64_t*, const uint64_t*, size_t, const Barrett&);
+
+struct Kernel {
+    const char* name;
+    MulAddFn fn;
+};
+
+// Best first; scalar is always last
+std::vector<Kernel> availableKernels() {
+    std::vector<Kernel> kernels;
+#ifdef PDQ_WITH_HEXL
+    kernels.push_back({"hexl", mulAddHexl});
+#endif
+#ifdef PDQ_X86_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq"))
+        kernels.push_back({"avx512", mulAddAvx512});
+    if (__builtin_cpu_supports("avx2"))
+        kernels.push_back({"avx2", mulAddAvx2});
+#endif
+    kernels.push_back({"scalar", mulAddScalar});
+    return kernels;
+}
+
+Kernel selectKernel() {
+    const char* forced = std::getenv("PDQ_KERNEL");
+    auto kernels = availableKernels();
+    for (const auto& k : kernels)
+        if (!forced || std::strcmp(forced, k.name) == 0) return k;
+    return kernels.back();
+}
+
+const Kernel& kernel() {
+    static const Kernel selected = selectKernel();
+    return selected;
+}
+
+// Raw limb storage: OpenFHE's native integers wrap a single uint64_t
+static_assert(sizeof(NativeInteger) == sizeof(uint64_t), "NativeInteger is not a bare 64-bit word");
+
+}  // namespace
+
+void mulAddMod(uint64_t* acc, const uint64_t* a, const uint64_t* b, size_t n, uint64_t q) {
+    kernel().fn(acc, a, b, n, Barrett(q));
+}
+
+void mulAddInPlace(DCRTPoly& acc, const DCRTPoly& a, const DCRTPoly& b) {
+    auto& towers = acc.GetAllElements();
+    if (a.GetNumOfElements() != towers.size() || b.GetNumOfElements() != towers.size() ||
+        a.GetFormat() != Format::EVALUATION || b.GetFormat() != Format::EVALUATION ||
+        acc.GetFormat() != Format::EVALUATION)
+        throw std::runtime_error("mulAddInPlace: operands must be EVALUATION form over the same towers");
+
+    const auto& fn = kernel().fn;
+    for (size_t i = 0; i < towers.size(); i++) {
+        auto& limb = towers[i];
+        const auto& limb_a = a.GetElementAtIndex(i);
+        const auto& limb_b = b.GetElementAtIndex(i);
+        fn(reinterpret_cast<uint64_t*>(&limb[0]),
+           reinterpret_cast<const uint64_t*>(&limb_a[0]),
+           reinterpret_cast<const uint64_t*>(&limb_b[0]),
+           limb.GetLength(),
+           Barrett(limb.GetModulus().ConvertToInt()));
+    }
+}
+
+const char* mulAddKernel() {
+    return kernel().name;
+}
+
+std::vector<const char*> mulAddKernels() {
+    std::vector<const char*> names;
+    for (const auto& k : availableKernels()) names.push_back(k.name);
+    return names;
+}
+
+void mulAddModWith(const char* name, uint64_t* acc, const uint64_t* a, const uint64_t* b, size_t n, uint64_t q) {
+    for (const auto& k : availableKernels()) {
+        if (std::strcmp(k.name, name) == 0) {
+            k.fn(acc, a, b, n, Barrett(q));
+            return;
+        }
+    }
+    throw std::invalid_argument(std::string("mulAddModWith: no kernel ") + name);
+}
@@ -0,0 +1,312 @@
+#include "keyseed.h"
+#include "binio.h"
+#include "ciphertext-ser.h"
+#include "scheme/bfvrns/bfvrns-ser.h"
+#include "key/key-ser.h"
+#include <random>
+#include <stdexcept>
+
+using namespace lbcrypto;
+
+namespace {
+
+constexpr uint32_t SEEDED_KEY_MAGIC = 0x4b514450;  // "PDQK"
+
+// Domain separation between the a-halves of different keys
+enum SeedDomain : uint32_t {
+    DOMAIN_MULT = 1,
+    DOMAIN_ROT = 2,
+    DOMAIN_SWITCH = 3,
+    DOMAIN_RELIN_SWITCH = 4,
+};
+
+// =============================================================================
+// Seed expansion (ChaCha20 keystream)
+// =============================================================================
+
+inline uint32_t rotl32(uint32_t x, int r) {
+    return (x << r) | (x >> (32 - r));
+}
+
+inline void quarterRound(uint32_t* x, int a, int b, int c, int d) {
+    x[a] += x[b]; x[d] = rotl32(x[d] ^ x[a], 16);
+    x[c] += x[d]; x[b] = rotl32(x[b] ^ x[c], 12);
+    x[a] += x[b]; x[d] = rotl32(x[d] ^ x[a], 8);
+    x[c] += x[d]; x[b] = rotl32(x[b] ^ x[c], 7);
+}
+
+// Deterministic stream of 64-bit words keyed by the seed; the nonce selects
+// an independent stream per (domain, index, part, tower).
+class SeedStream {
+public:
+    SeedStream(const KeySeed& seed, uint32_t domain, uint32_t index, uint32_t part, uint32_t tower) {
+        state[0] = 0x61707865; state[1] = 0x3320646e;
+        state[2] = 0x79622d32; state[3] = 0x6b206574;
+        for (int i = 0; i < 8; i++) {
+            state[4 + i] = static_cast<uint32_t>(seed[4*i]) |
+                           static_cast<uint32_t>(seed[4*i + 1]) << 8 |
+                           static_cast<uint32_t>(seed[4*i + 2]) << 16 |
+                           static_cast<uint32_t>(seed[4*i + 3]) << 24;
+        }
+        state[12] = 0;
+        state[13] = domain;
+        state[14] = index;
+        state[15] = (part << 16) | tower;
+    }
+
+    uint64_t next64() {
+        if (pos == 16) refill();
+        uint64_t lo = block[pos++];
+        uint64_t hi = block[pos++];
+        return lo | (hi << 32);
+    }
+
+    // Uniform sample in [0, q) by rejection
+    uint64_t uniform(uint64_t q, uint64_t mask) {
+        uint64_t v;
+        do { v = next64() & mask; } while (v >= q);
+        return v;
+    }
+
+private:
+    void refill() {
+        uint32_t x[16];
+        for (int i = 0; i < 16; i++) x[i] = state[i];
+        for (int round = 0; round < 10; round++) {
+            quarterRound(x, 0, 4, 8, 12);
+            quarterRound(x, 1, 5, 9, 13);
+            quarterRound(x, 2, 6, 10, 14);
+            quarterRound(x, 3, 7, 11, 15);
+            quarterRound(x, 0, 5, 10, 15);
+            quarterRound(x, 1, 6, 11, 12);
+            quarterRound(x, 2, 7, 8, 13);
+            quarterRound(x, 3, 4, 9, 14);
+        }
+        for (int i = 0; i < 16; i++) block[i] = x[i] + state[i];
+        state[12]++;
+        pos = 0;
+    }
+
+    uint32_t state[16];
+    uint32_t block[16];
+    int pos = 16;
+};
+
+// Expand the a-halves of one hybrid key-switching key: one uniform DCRTPoly
+// over the extended basis QP per digit, sampled directly in EVALUATION form.
+std::vector<DCRTPoly> expandAVector(
+    const CryptoContext<DCRTPoly>& context,
+    const KeySeed& seed, uint32_t domain, uint32_t index) {
+
+    auto cryptoParams = std::dynamic_pointer_cast<CryptoParametersRNS>(context->GetCryptoParameters());
+    auto paramsQP = cryptoParams->GetParamsQP();
+    uint32_t numPartQ = cryptoParams->GetNumPartQ();
+    uint32_t ringDim = paramsQP->GetRingDimension();
+
+    std::vector<DCRTPoly> av(numPartQ);
+    for (uint32_t part = 0; part < numPartQ; part++) {
+        DCRTPoly a(paramsQP, Format::EVALUATION, true);
+        for (size_t tower = 0; tower < a.GetNumOfElements(); tower++) {
+            auto limb = a.GetElementAtIndex(tower);
+            uint64_t q = limb.GetModulus().ConvertToInt();
+            uint32_t bits = limb.GetModulus().GetMSB();
+            uint64_t mask = (bits >= 64) ? ~uint64_t(0) : ((uint64_t(1) << bits) - 1);
+
+            SeedStream stream(seed, domain, index, part, static_cast<uint32_t>(tower));
+            for (uint32_t k = 0; k < ringDim; k++) {
+                limb[k] = NativeInteger(stream.uniform(q, mask));
+            }
+            a.SetElementAtIndex(tower, std::move(limb));
+        }
+        av[part] = std::move(a);
+    }
+    return av;
+}
+
+// Empty key-switching key carrying only seeded a-halves, used as the
+// "previous key" input of KeySwitchGen so that the new key reuses them
+EvalKey<DCRTPoly> seededTemplate(
+    const CryptoContext<DCRTPoly>& context,
+    const KeySeed& seed, uint32_t domain, uint32_t index) {
+
+    auto ek = std::make_shared<EvalKeyRelinImpl<DCRTPoly>>(context);
+    ek->SetAVector(expandAVector(context, seed, domain, index));
+    return ek;
+}
+
+EvalKey<DCRTPoly> assembleKey(
+    const CryptoContext<DCRTPoly>& context,
+    const KeySeed& seed, uint32_t domain, uint32_t index,
+    std::vector<DCRTPoly>&& bv, const std::string& keyTag) {
+
+    auto ek = std::make_shared<EvalKeyRelinImpl<DCRTPoly>>(context);
+    ek->SetAVector(expandAVector(context, seed, domain, index));
+    ek->SetBVector(std::move(bv));
+    ek->SetKeyTag(keyTag);
+    return ek;
+}
+
+// =============================================================================
+// Seeded key file layout
+// =============================================================================
+
+void writeHeader(std::ostream& os, uint32_t domain, const KeySeed& seed, const std::string& keyTag) {
+    writeU32(os, SEEDED_KEY_MAGIC);
+    writeU32(os, domain);
+    os.write(reinterpret_cast<const char*>(seed.data()), seed.size());
+    writeString(os, keyTag);
+}
+
+std::string readHeader(std::istream& is, uint32_t domain, KeySeed& seed) {
+    if (readU32(is) != SEEDED_KEY_MAGIC || readU32(is) != domain)
+        throw std::runtime_error("seeded key: bad header");
+    is.read(reinterpret_cast<char*>(seed.data()), seed.size());
+    return readString(is);
+}
+
+void writeBVector(std::ostream& os, const EvalKey<DCRTPoly>& ek) {
+    std::vector<DCRTPoly> bv = ek->GetBVector();
+    Serial::Serialize(bv, os, SerType::BINARY);
+}
+
+std::vector<DCRTPoly> readBVector(std::istream& is) {
+    std::vector<DCRTPoly> bv;
+    Serial::Deserialize(bv, is, SerType::BINARY);
+    return bv;
+}
+
+}  // namespace
+
+KeySeed generateKeySeed() {
+    std::random_device rd;
+    KeySeed seed;
+    for (auto& byte : seed) byte = static_cast<uint8_t>(rd());
+    return seed;
+}
+
+// =============================================================================
+// Seeded key generation
+// =============================================================================
+
+void seededEvalMultKeyGen(const PrivateKey<DCRTPoly>& sk, const KeySeed& seed, uint32_t index) {
+    auto context = sk->GetCryptoContext();
+
+    // Relinearization key: switch from s^2 to s
+    auto sk_squared = std::make_shared<PrivateKeyImpl<DCRTPoly>>(context);
+    const auto& s = sk->GetPrivateElement();
+    sk_squared->SetPrivateElement(s * s);
+
+    auto ek = context->GetScheme()->KeySwitchGen(
+        sk_squared, sk, seededTemplate(context, seed, DOMAIN_MULT, index));
+    ek->SetKeyTag(sk->GetKeyTag());
+    CryptoContextImpl<DCRTPoly>::InsertEvalMultKey({ek}, sk->GetKeyTag());
+}
+
+void seededEvalRotateKeyGen(
+    const PrivateKey<DCRTPoly>& sk,
+    const std::vector<int32_t>& rotIndices,
+    const KeySeed& seed) {
+
+    // Automorphism keys with prescribed a-halves go through the multiparty API
+    auto context = sk->GetCryptoContext();
+    std::vector<uint32_t> autoIndices = context->FindAutomorphismIndices(rotIndices);
+    auto templates = std::make_shared<std::map<uint32_t, EvalKey<DCRTPoly>>>();
+    for (uint32_t k : autoIndices) {
+        (*templates)[k] = seededTemplate(context, seed, DOMAIN_ROT, k);
+    }
+
+    auto keys = context->MultiEvalAutomorphismKeyGen(sk, templates, autoIndices, sk->GetKeyTag());
+    for (auto& [k, ek] : *keys) ek->SetKeyTag(sk->GetKeyTag());
+    CryptoContextImpl<DCRTPoly>::InsertEvalAutomorphismKey(keys, sk->GetKeyTag());
+}
+
+EvalKey<DCRTPoly> seededKeySwitchGen(
+    const PrivateKey<DCRTPoly>& sk_old,
+    const PrivateKey<DCRTPoly>& sk_new,
+    const KeySeed& seed,
+    uint32_t index) {
+
+    auto context = sk_old->GetCryptoContext();
+    return context->GetScheme()->KeySwitchGen(
+        sk_old, sk_new, seededTemplate(context, seed, DOMAIN_SWITCH, index));
+}
+
+EvalKey<DCRTPoly> seededRelinSwitchKeyGen(
+    const PrivateKey<DCRTPoly>& sk_old,
+    const PrivateKey<DCRTPoly>& sk_new,
+    const KeySeed& seed) {
+
+    auto context = sk_old->GetCryptoContext();
+
+    // s^2 as a private key (the element is in EVALUATION form, so pointwise)
+    const auto& s = sk_old->GetPrivateElement();
+    auto sk_sq = std::make_shared<PrivateKeyImpl<DCRTPoly>>(context);
+    sk_sq->SetPrivateElement(s * s);
+    sk_sq->SetKeyTag(sk_old->GetKeyTag());
+
+    return context->GetScheme()->KeySwitchGen(
+        sk_sq, sk_new, seededTemplate(context, seed, DOMAIN_RELIN_SWITCH, 0));
+}
+
+// =============================================================================
+// Seed-compressed serialization
+// =============================================================================
+
+void serializeSeededEvalMultKey(std::ostream& os, const std::string& keyTag, const KeySeed& seed) {
+    const auto& keys = CryptoContextImpl<DCRTPoly>::GetEvalMultKeyVector(keyTag);
+    writeHeader(os, DOMAIN_MULT, seed, keyTag);
+    writeBVector(os, keys[0]);
+}
+
+void serializeSeededRotKeys(std::ostream& os, const std::string& keyTag, const KeySeed& seed) {
+    const auto& keys = CryptoContextImpl<DCRTPoly>::GetEvalAutomorphismKeyMap(keyTag);
+    writeHeader(os, DOMAIN_ROT, seed, keyTag);
+    writeU32(os, static_cast<uint32_t>(keys.size()));
+    for (const auto& [k, ek] : keys) {
+        writeU32(os, k);
+        writeBVector(os, ek);
+    }
+}
+
+void serializeSeededSwitchKey(std::ostream& os, const EvalKey<DCRTPoly>& switch_key, const KeySeed& seed) {
+    writeHeader(os, DOMAIN_SWITCH, seed, switch_key->GetKeyTag());
+    writeBVector(os, switch_key);
+}
+
+void serializeSeededRelinSwitchKey(std::ostream& os, const EvalKey<DCRTPoly>& relin_switch_key, const KeySeed& seed) {
+    writeHeader(os, DOMAIN_RELIN_SWITCH, seed, relin_switch_key->GetKeyTag());
+    writeBVector(os, relin_switch_key);
+}
+
+void deserializeSeededEvalMultKey(std::istream& is, const CryptoContext<DCRTPoly>& context, uint32_t index) {
+    KeySeed seed;
+    auto keyTag = readHeader(is, DOMAIN_MULT, seed);
+    auto ek = assembleKey(context, seed, DOMAIN_MULT, index, readBVector(is), keyTag);
+    CryptoContextImpl<DCRTPoly>::InsertEvalMultKey({ek}, keyTag);
+}
+
+void deserializeSeededRotKeys(std::istream& is, const CryptoContext<DCRTPoly>& context_trace) {
+    KeySeed seed;
+    auto keyTag = readHeader(is, DOMAIN_ROT, seed);
+    uint32_t count = readU32(is);
+
+    auto keys = std::make_shared<std::map<uint32_t, EvalKey<DCRTPoly>>>();
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t k = readU32(is);
+        (*keys)[k] = assembleKey(context_trace, seed, DOMAIN_ROT, k, readBVector(is), keyTag);
+    }
+    CryptoContextImpl<DCRTPoly>::InsertEvalAutomorphismKey(keys, keyTag);
+}
+
+EvalKey<DCRTPoly> deserializeSeededSwitchKey(std::istream& is, const CryptoContext<DCRTPoly>& context,
+                                             uint32_t index) {
+    KeySeed seed;
+    auto keyTag = readHeader(is, DOMAIN_SWITCH, seed);
+    return assembleKey(context, seed, DOMAIN_SWITCH, index, readBVector(is), keyTag);
+}
+
+EvalKey<DCRTPoly> deserializeSeededRelinSwitchKey(std::istream& is, const CryptoContext<DCRTPoly>& context) {
+    KeySeed seed;
+    auto keyTag = readHeader(is, DOMAIN_RELIN_SWITCH, seed);
+    return assembleKey(context, seed, DOMAIN_RELIN_SWITCH, 0, readBVector(is), keyTag);
+}
@@ -1,5 +1,9 @@
 #include "mask.h"
 #include "global.h"
+#include "instrument.h"
+#include "match.h"
+#include "setup.h"
+#include <stdexcept>
 
 using namespace lbcrypto;
 
@@ -14,7 +18,91 @@ std::vector<Ciphertext<DCRTPoly>> mask(
 
     for (size_t i = 0; i < ctxt_values.size(); i++) {
         result.push_back(context->EvalMult(ctxt_values[i], ctxt_index[i]));
+        countOp(Op::EvalMult);
+        countOp(Op::Relin);
+        countOp(Op::KeySwitch);
     }
 
     return result;
 }
+
+std::vector<Ciphertext<DCRTPoly>> maskNoRelin(
+    const std::vector<Ciphertext<DCRTPoly>>& ctxt_values,
+    const std::vector<Ciphertext<DCRTPoly>>& ctxt_index) {
+
+    auto context = ctxt_values[0]->GetCryptoContext();
+
+    std::vector<Ciphertext<DCRTPoly>> result;
+    result.reserve(ctxt_values.size());
+
+    for (size_t i = 0; i < ctxt_values.size(); i++) {
+        result.push_back(context->EvalMultNoRelin(ctxt_values[i], ctxt_index[i]));
+        countOp(Op::EvalMult);
+    }
+
+    return result;
+}
+
+MatchMask matchMask(
+    const EncryptedKey& ctxt_key,
+    const Ciphertext<DCRTPoly>& ctxt_value,
+    const EncryptedKey& ctxt_query) {
+
+    auto context = ctxt_value->GetCryptoContext();
+
+    MatchMask result;
+    result.index = matchKey(ctxt_key, ctxt_query);
+    result.masked = context->EvalMultNoRelin(ctxt_value, result.index);
+    countOp(Op::EvalMult);
+    return result;
+}
+
+std::vector<Ciphertext<DCRTPoly>> maskPlain(
+    const std::vector<DCRTPoly>& ptxt_values,
+    const std::vector<Ciphertext<DCRTPoly>>& ctxt_index) {
+
+    std::vector<Ciphertext<DCRTPoly>> result;
+    result.reserve(ptxt_values.size());
+
+    for (size_t i = 0; i < ptxt_values.size(); i++)
+        result.push_back(multPlain(ctxt_index[i], ptxt_values[i]));
+
+    return result;
+}
+
+std::vector<Ciphertext<DCRTPoly>> maskTrace(
+    const PDQParams& P,
+    const std::vector<Ciphertext<DCRTPoly>>& values_trace,
+    std::vector<Ciphertext<DCRTPoly>>& index_trace) {
+
+    if (values_trace.size() != index_trace.size())
+        throw std::invalid_argument("maskTrace: values and indicators differ in count");
+
+    auto context_trace = index_trace[0]->GetCryptoContext();
+    size_t towers = bsgsTowers(P, context_trace);
+
+    std::vector<Ciphertext<DCRTPoly>> result;
+    result.reserve(values_trace.size());
+
+    for (size_t i = 0; i < values_trace.size(); i++) {
+        auto masked = context_trace->EvalMult(values_trace[i], index_trace[i]);
+        countOp(Op::EvalMult);
+        countOp(Op::Relin);
+        countOp(Op::KeySwitch);
+        result.push_back(context_trace->Compress(masked, towers));
+        index_trace[i] = context_trace->Compress(index_trace[i], towers);
+    }
+
+    return result;
+}
+
+MatchMask matchMaskPlain(
+    const std::vector<Plaintext>& ptxt_key,
+    const DCRTPoly& ptxt_value,
+    const EncryptedKey& ctxt_query) {
+
+    MatchMask result;
+    result.index = matchKeyPlain(ptxt_key, ctxt_query);
+    result.masked = multPlain(result.index, ptxt_value);
+    return result;
+}
@@ -1,13 +1,61 @@
 #include "match.h"
-#include "global.h"
+#include "instrument.h"
 
 using namespace lbcrypto;
 
 namespace {
 
+// 1 - x in every slot
+Ciphertext<DCRTPoly> oneMinus(const Ciphertext<DCRTPoly>& ctxt) {
+    auto context = ctxt->GetCryptoContext();
+    std::vector<int64_t> ones(context->GetRingDimension(), 1);
+    Plaintext ptxt_one = context->MakePackedPlaintext(ones);
+    countOp(Op::Encode);
+    return context->EvalSub(ptxt_one, ctxt);
+}
+
+// Product of n factors as a balanced tree: ceil(log2 n) levels
+Ciphertext<DCRTPoly> productTree(std::vector<Ciphertext<DCRTPoly>> factors) {
+    auto context = factors[0]->GetCryptoContext();
+
+    while (factors.size() > 1) {
+        size_t half = (factors.size() + 1) / 2;
+        for (size_t i = 0; i + half < factors.size(); i++) {
+            factors[i] = context->EvalMult(factors[i], factors[i + half]);
+            countOp(Op::EvalMult);
+            countOp(Op::Relin);
+            countOp(Op::KeySwitch);
+        }
+        factors.resize(half);
+    }
+
+    return factors[0];
+}
+
+// Indicator of "key is one of the candidates" from diffs[j][l], the difference
+// of limb l of the key and of candidate j
+Ciphertext<DCRTPoly> keyIn(std::vector<std::vector<Ciphertext<DCRTPoly>>> diffs) {
+    if (diffs.size() == 1) return keyEquality(std::move(diffs[0]));
+
+    // One limb: the product of the differences is 0 exactly when one of them
+    // is (p is prime), so a single equality check covers all candidates
+    if (diffs[0].size() == 1) {
+        std::vector<Ciphertext<DCRTPoly>> factors;
+        for (auto& diff : diffs) factors.push_back(std::move(diff[0]));
+        return equalityCheck(productTree(std::move(factors)));
+    }
+
+    // Several limbs: OR of the candidates' key equalities
+    std::vector<Ciphertext<DCRTPoly>> misses;
+    for (auto& diff : diffs) misses.push_back(oneMinus(keyEquality(std::move(diff))));
+    return oneMinus(productTree(std::move(misses)));
+}
+
+}  // namespace
+
 // Equality check using Fermat's Little Theorem
 // Returns 1 if x == 0, 0 otherwise
-// Computes: 1 - x^(p-1) where p = ptxt_modulus
+// Computes: 1 - x^(p-1) where p is the context's plaintext modulus
 Ciphertext<DCRTPoly> equalityCheck(const Ciphertext<DCRTPoly>& ctxt) {
     auto context = ctxt->GetCryptoContext();
 
@@ -15,13 +63,16 @@ Ciphertext<DCRTPoly> equalityCheck(const Ciphertext<DCRTPoly>& ctxt) {
     Ciphertext<DCRTPoly> result;
     Ciphertext<DCRTPoly> curr = ctxt;
 
-    int64_t exp = ptxt_modulus - 1;
+    int64_t exp = static_cast<int64_t>(context->GetCryptoParameters()->GetPlaintextModulus()) - 1;
     bool first = true;
 
     while (exp > 0) {
         if (exp % 2 == 0) {
             exp /= 2;
             context->EvalSquareInPlace(curr);
+            countOp(Op::EvalMult);
+            countOp(Op::Relin);
+            countOp(Op::KeySwitch);
         } else {
             exp -= 1;
             if (first) {
@@ -29,32 +80,117 @@ Ciphertext<DCRTPoly> equalityCheck(const Ciphertext<DCRTPoly>& ctxt) {
                 first = false;
             } else {
                 result = context->EvalMult(result, curr);
+                countOp(Op::EvalMult);
+                countOp(Op::Relin);
+                countOp(Op::KeySwitch);
             }
         }
     }
 
     // Return 1 - x^(p-1)
-    std::vector<int64_t> ones(degree, 1);
-    Plaintext ptxt_one = context->MakePackedPlaintext(ones);
-    return context->EvalSub(ptxt_one, result);
+    return oneMinus(result);
 }
 
-}  // namespace
+// Product of the per-limb indicators, as a balanced tree so that key_limbs
+// limbs cost limb_depth levels
+Ciphertext<DCRTPoly> keyEquality(std::vector<Ciphertext<DCRTPoly>> diffs) {
+    for (auto& diff : diffs) diff = equalityCheck(diff);
+    return productTree(std::move(diffs));
+}
 
-std::vector<Ciphertext<DCRTPoly>> match(
-    const std::vector<Ciphertext<DCRTPoly>>& ctxt_db,
-    const Ciphertext<DCRTPoly>& ctxt_query) {
+Ciphertext<DCRTPoly> matchKey(const EncryptedKey& ctxt_key, const EncryptedKey& ctxt_query) {
+    auto context = ctxt_query[0]->GetCryptoContext();
+
+    std::vector<Ciphertext<DCRTPoly>> diffs;
+    for (size_t l = 0; l < ctxt_query.size(); l++)
+        diffs.push_back(context->EvalSub(ctxt_key[l], ctxt_query[l]));
+    return keyEquality(std::move(diffs));
+}
+
+Ciphertext<DCRTPoly> matchKeyPlain(const std::vector<Plaintext>& ptxt_key, const EncryptedKey& ctxt_query) {
+    auto context = ctxt_query[0]->GetCryptoContext();
 
-    auto context = ctxt_query->GetCryptoContext();
+    // query - key: the sign does not matter to x^(p-1)
+    std::vector<Ciphertext<DCRTPoly>> diffs;
+    for (size_t l = 0; l < ctxt_query.size(); l++)
+        diffs.push_back(context->EvalSub(ctxt_query[l], ptxt_key[l]));
+    return keyEquality(std::move(diffs));
+}
+
+std::vector<Ciphertext<DCRTPoly>> match(
+    const std::vector<EncryptedKey>& ctxt_db,
+    const EncryptedKey& ctxt_query) {
 
     std::vector<Ciphertext<DCRTPoly>> result;
     result.reserve(ctxt_db.size());
 
     for (const auto& ctxt_db_i : ctxt_db) {
-        auto diff = context->EvalSub(ctxt_db_i, ctxt_query);
-        auto match = equalityCheck(diff);
+        auto match = matchKey(ctxt_db_i, ctxt_query);
         result.push_back(match);
     }
 
     return result;
 }
+
+std::vector<Ciphertext<DCRTPoly>> matchPlain(
+    const std::vector<std::vector<Plaintext>>& ptxt_db,
+    const EncryptedKey& ctxt_query) {
+
+    std::vector<Ciphertext<DCRTPoly>> result;
+    result.reserve(ptxt_db.size());
+
+    for (const auto& ptxt_db_i : ptxt_db)
+        result.push_back(matchKeyPlain(ptxt_db_i, ctxt_query));
+
+    return result;
+}
+
+Ciphertext<DCRTPoly> matchKey(const EncryptedKey& ctxt_key, const std::vector<EncryptedKey>& ctxt_queries) {
+    auto context = ctxt_queries[0][0]->GetCryptoContext();
+
+    std::vector<std::vector<Ciphertext<DCRTPoly>>> diffs;
+    for (const auto& ctxt_query : ctxt_queries) {
+        diffs.emplace_back();
+        for (size_t l = 0; l < ctxt_query.size(); l++)
+            diffs.back().push_back(context->EvalSub(ctxt_key[l], ctxt_query[l]));
+    }
+    return keyIn(std::move(diffs));
+}
+
+Ciphertext<DCRTPoly> matchKeyPlain(const std::vector<Plaintext>& ptxt_key, const std::vector<EncryptedKey>& ctxt_queries) {
+    auto context = ctxt_queries[0][0]->GetCryptoContext();
+
+    std::vector<std::vector<Ciphertext<DCRTPoly>>> diffs;
+    for (const auto& ctxt_query : ctxt_queries) {
+        diffs.emplace_back();
+        for (size_t l = 0; l < ctxt_query.size(); l++)
+            diffs.back().push_back(context->EvalSub(ctxt_query[l], ptxt_key[l]));
+    }
+    return keyIn(std::move(diffs));
+}
+
+std::vector<Ciphertext<DCRTPoly>> match(
+    const std::vector<EncryptedKey>& ctxt_db,
+    const std::vector<EncryptedKey>& ctxt_queries) {
+
+    std::vector<Ciphertext<DCRTPoly>> result;
+    result.reserve(ctxt_db.size());
+
+    for (const auto& ctxt_db_i : ctxt_db)
+        result.push_back(matchKey(ctxt_db_i, ctxt_queries));
+
+    return result;
+}
+
+std::vector<Ciphertext<DCRTPoly>> matchPlain(
+    const std::vector<std::vector<Plaintext>>& ptxt_db,
+    const std::vector<EncryptedKey>& ctxt_queries) {
+
+    std::vector<Ciphertext<DCRTPoly>> result;
+    result.reserve(ptxt_db.size());
+
+    for (const auto& ptxt_db_i : ptxt_db)
+        result.push_back(matchKeyPlain(ptxt_db_i, ctxt_queries));
+
+    return result;
+}
@@ -0,0 +1,51 @@
+#include "noise.h"
+#include <algorithm>
+#include <climits>
+
+using namespace lbcrypto;
+
+// For BFV, c0 + c1*s + c2*s^2 = Δm + v (mod Q) with Δ = floor(Q/p). Multiplying by p
+// cancels the message up to (Q mod p)*m, which leaves p*v as the centered residue;
+// the budget is how many bits it is short of Q/2.
+int noiseBudget(const PrivateKey<DCRTPoly>& sk, const Ciphertext<DCRTPoly>& ct) {
+    const auto& elems = ct->GetElements();
+    size_t towers = elems[0].GetNumOfElements();
+
+    DCRTPoly s = sk->GetPrivateElement().Clone();
+    s.DropLastElements(s.GetNumOfElements() - towers);
+
+    DCRTPoly phase = elems[0];
+    DCRTPoly s_pow = s;
+    for (size_t i = 1; i < elems.size(); i++) {
+        phase += elems[i] * s_pow;
+        if (i + 1 < elems.size()) s_pow *= s;
+    }
+    phase.SetFormat(Format::COEFFICIENT);
+
+    Poly big = phase.CRTInterpolate();
+    const BigInteger& Q = big.GetModulus();
+    BigInteger half = Q >> 1;
+    BigInteger p(ct->GetCryptoParameters()->GetPlaintextModulus());
+
+    uint32_t noise_bits = 0;
+    for (uint32_t i = 0; i < big.GetLength(); i++) {
+        BigInteger v = big[i].ModMul(p, Q);
+        BigInteger centered = v > half ? Q - v : v;
+        noise_bits = std::max(noise_bits, centered.GetMSB());
+    }
+
+    return static_cast<int>(Q.GetMSB()) - static_cast<int>(noise_bits) - 1;
+}
+
+int minNoiseBudget(const PrivateKey<DCRTPoly>& sk, const std::vector<Ciphertext<DCRTPoly>>& ctxts) {
+    int budget = INT_MAX;
+    for (const auto& ct : ctxts) budget = std::min(budget, noiseBudget(sk, ct));
+    return budget;
+}
+
+double bitsPerTower(const Ciphertext<DCRTPoly>& ct) {
+    const auto& towers = ct->GetElements()[0].GetAllElements();
+    double bits = 0;
+    for (const auto& tower : towers) bits += tower.GetModulus().GetMSB();
+    return bits / towers.size();
+}
@@ -1,200 +1,229 @@
 #include "param.h"
 #include "global.h"
 
-void param_PDQ_16384_8() {
+void param_PDQ_16384_8(PDQParams& P) {
     // PDQ parameters
-    num_records = 16384;
-    num_matching = 8;
+    P.num_records = 16384;
+    P.num_matching = 8;
 
     // Main context parameters (128-bit security)
-    ptxt_modulus = 65537;
-    degree = 32768;
-    MultiplicativeDepth = 18;
-    ScalingModSize = 60;
-    NumLargeDigits = 4;
+    P.ptxt_modulus = 65537;
+    P.degree = 32768;
+    P.MultiplicativeDepth = 18;
+    P.ScalingModSize = 60;
+    P.NumLargeDigits = 4;
 
     // Trace context parameters (128-bit security)
-    degree_trace = 8192;
-    MultiplicativeDepth_trace = 1;
-    NumLargeDigits_trace = 2;
+    P.degree_trace = 8192;
+    P.MultiplicativeDepth_trace = 1;
+    P.NumLargeDigits_trace = 2;
 }
 
-void param_PDQ_16384_16() {
+void param_PDQ_16384_16(PDQParams& P) {
     // PDQ parameters
-    num_records = 16384;
-    num_matching = 16;
+    P.num_records = 16384;
+    P.num_matching = 16;
 
     // Main context parameters (128-bit security)
-    ptxt_modulus = 65537;
-    degree = 32768;
-    MultiplicativeDepth = 18;
-    ScalingModSize = 60;
-    NumLargeDigits = 4;
+    P.ptxt_modulus = 65537;
+    P.degree = 32768;
+    P.MultiplicativeDepth = 18;
+    P.ScalingModSize = 60;
+    P.NumLargeDigits = 4;
 
     // Trace context parameters (128-bit security)
-    degree_trace = 8192;
-    MultiplicativeDepth_trace = 1;
-    NumLargeDigits_trace = 2;
+    P.degree_trace = 8192;
+    P.MultiplicativeDepth_trace = 1;
+    P.NumLargeDigits_trace = 2;
 }
 
-void param_PDQ_16384_32() {
+void param_PDQ_16384_32(PDQParams& P) {
     // PDQ parameters
-    num_records = 16384;
-    num_matching = 32;
+    P.num_records = 16384;
+    P.num_matching = 32;
 
     // Main context parameters (128-bit security)
-    ptxt_modulus = 65537;
-    degree = 32768;
-    MultiplicativeDepth = 18;
-    ScalingModSize = 60;
-    NumLargeDigits = 4;
+    P.ptxt_modulus = 65537;
+    P.degree = 32768;
+    P.MultiplicativeDepth = 18;
+    P.ScalingModSize = 60;
+    P.NumLargeDigits = 4;
 
     // Trace context parameters (128-bit security)
-    degree_trace = 8192;
-    MultiplicativeDepth_trace = 1;
-    NumLargeDigits_trace = 2;
+    P.degree_trace = 8192;
+    P.MultiplicativeDepth_trace = 1;
+    P.NumLargeDigits_trace = 2;
 }
 
-void param_PDQ_16384_64() {
+void param_PDQ_16384_64(PDQParams& P) {
     // PDQ parameters
-    num_records = 16384;
-    num_matching = 64;
+    P.num_records = 16384;
+    P.num_matching = 64;
 
     // Main context parameters (128-bit security)
-    ptxt_modulus = 65537;
-    degree = 32768;
-    MultiplicativeDepth = 18;
-    ScalingModSize = 60;
-    NumLargeDigits = 4;
+    P.ptxt_modulus = 65537;
+    P.degree = 32768;
+    P.MultiplicativeDepth = 18;
+    P.ScalingModSize = 60;
+    P.NumLargeDigits = 4;
 
     // Trace context parameters (128-bit security)
-    degree_trace = 8192;
-    MultiplicativeDepth_trace = 1;
-    NumLargeDigits_trace = 2;
+    P.degree_trace = 8192;
+    P.MultiplicativeDepth_trace = 1;
+    P.NumLargeDigits_trace = 2;
 }
 
-void param_PDQ_16384_128() {
+void param_PDQ_16384_128(PDQParams& P) {
     // PDQ parameters
-    num_records = 16384;
-    num_matching = 128;
+    P.num_records = 16384;
+    P.num_matching = 128;
 
     // Main context parameters (128-bit security)
-    ptxt_modulus = 65537;
-    degree = 32768;
-    MultiplicativeDepth = 18;
-    ScalingModSize = 60;
-    NumLargeDigits = 4;
+    P.ptxt_modulus = 65537;
+    P.degree = 32768;
+    P.MultiplicativeDepth = 18;
+    P.ScalingModSize = 60;
+    P.NumLargeDigits = 4;
 
     // Trace context parameters (128-bit security)
-    degree_trace = 8192;
-    MultiplicativeDepth_trace = 1;
-    NumLargeDigits_trace = 2;
+    P.degree_trace = 8192;
+    P.MultiplicativeDepth_trace = 1;
+    P.NumLargeDigits_trace = 2;
 }
 
-void param_PDQ_8192_16() {
+void param_PDQ_8192_16(PDQParams& P) {
     // PDQ parameters
-    num_records = 8192;
-    num_matching = 16;
+    P.num_records = 8192;
+    P.num_matching = 16;
 
     // Main context parameters (128-bit security)
-    ptxt_modulus = 65537;
-    degree = 32768;
-    MultiplicativeDepth = 18;
-    ScalingModSize = 60;
-    NumLargeDigits = 4;
+    P.ptxt_modulus = 65537;
+    P.degree = 32768;
+    P.MultiplicativeDepth = 18;
+    P.ScalingModSize = 60;
+    P.NumLargeDigits = 4;
 
     // Trace context parameters (128-bit security)
-    degree_trace = 8192;
-    MultiplicativeDepth_trace = 1;
-    NumLargeDigits_trace = 2;
+    P.degree_trace = 8192;
+    P.MultiplicativeDepth_trace = 1;
+    P.NumLargeDigits_trace = 2;
 }
 
-void param_PDQ_32768_16() {
+void param_PDQ_32768_16(PDQParams& P) {
     // PDQ parameters
-    num_records = 32768;
-    num_matching = 16;
+    P.num_records = 32768;
+    P.num_matching = 16;
 
     // Main context parameters (128-bit security)
-    ptxt_modulus = 65537;
-    degree = 32768;
-    MultiplicativeDepth = 18;
-    ScalingModSize = 60;
-    NumLargeDigits = 4;
+    P.ptxt_modulus = 65537;
+    P.degree = 32768;
+    P.MultiplicativeDepth = 18;
+    P.ScalingModSize = 60;
+    P.NumLargeDigits = 4;
 
     // Trace context parameters (128-bit security)
-    degree_trace = 8192;
-    MultiplicativeDepth_trace = 1;
-    NumLargeDigits_trace = 2;
+    P.degree_trace = 8192;
+    P.MultiplicativeDepth_trace = 1;
+    P.NumLargeDigits_trace = 2;
 }
 
-void param_PDQ_65536_16() {
+void param_PDQ_65536_16(PDQParams& P) {
     // PDQ parameters
-    num_records = 65536;
-    num_matching = 16;
+    P.num_records = 65536;
+    P.num_matching = 16;
 
     // Main context parameters (128-bit security)
-    ptxt_modulus = 65537;
-    degree = 32768;
-    MultiplicativeDepth = 18;
-    ScalingModSize = 60;
-    NumLargeDigits = 4;
+    P.ptxt_modulus = 65537;
+    P.degree = 32768;
+    P.MultiplicativeDepth = 18;
+    P.ScalingModSize = 60;
+    P.NumLargeDigits = 4;
 
     // Trace context parameters (128-bit security)
-    degree_trace = 8192;
-    MultiplicativeDepth_trace = 1;
-    NumLargeDigits_trace = 2;
+    P.degree_trace = 8192;
+    P.MultiplicativeDepth_trace = 1;
+    P.NumLargeDigits_trace = 2;
 }
 
-void param_PDQ_131072_16() {
+void param_PDQ_131072_16(PDQParams& P) {
     // PDQ parameters
-    num_records = 131072;
-    num_matching = 16;
+    P.num_records = 131072;
+    P.num_matching = 16;
 
     // Main context parameters
-    ptxt_modulus = 786433;
-    degree = 65536;
-    MultiplicativeDepth = 22;
-    ScalingModSize = 60;
-    NumLargeDigits = 2;
+    P.ptxt_modulus = 786433;
+    P.degree = 65536;
+    P.MultiplicativeDepth = 22;
+    P.ScalingModSize = 60;
+    P.NumLargeDigits = 2;
 
     // Trace context parameters
-    degree_trace = 16384;
-    MultiplicativeDepth_trace = 3;
-    NumLargeDigits_trace = 1;
+    P.degree_trace = 16384;
+    P.MultiplicativeDepth_trace = 3;
+    P.NumLargeDigits_trace = 1;
 }
 
-void param_PDQ_262144_16() {
+void param_PDQ_262144_16(PDQParams& P) {
     // PDQ parameters
-    num_records = 262144;
-    num_matching = 16;
+    P.num_records = 262144;
+    P.num_matching = 16;
 
     // Main context parameters
-    ptxt_modulus = 786433;
-    degree = 65536;
-    MultiplicativeDepth = 22;
-    ScalingModSize = 60;
-    NumLargeDigits = 2;
+    P.ptxt_modulus = 786433;
+    P.degree = 65536;
+    P.MultiplicativeDepth = 22;
+    P.ScalingModSize = 60;
+    P.NumLargeDigits = 2;
 
     // Trace context parameters
-    degree_trace = 16384;
-    MultiplicativeDepth_trace = 3;
-    NumLargeDigits_trace = 1;
+    P.degree_trace = 16384;
+    P.MultiplicativeDepth_trace = 3;
+    P.NumLargeDigits_trace = 1;
 }
 
-void param_PDQ_524288_16() {
+void param_PDQ_524288_16(PDQParams& P) {
     // PDQ parameters
-    num_records = 524288;
-    num_matching = 16;
+    P.num_records = 524288;
+    P.num_matching = 16;
 
     // Main context parameters
-    ptxt_modulus = 786433;
-    degree = 65536;
-    MultiplicativeDepth = 22;
-    ScalingModSize = 60;
-    NumLargeDigits = 2;
+    P.ptxt_modulus = 786433;
+    P.degree = 65536;
+    P.MultiplicativeDepth = 22;
+    P.ScalingModSize = 60;
+    P.NumLargeDigits = 2;
 
     // Trace context parameters
-    degree_trace = 16384;
-    MultiplicativeDepth_trace = 3;
-    NumLargeDigits_trace = 1;
+    P.degree_trace = 16384;
+    P.MultiplicativeDepth_trace = 3;
+    P.NumLargeDigits_trace = 1;
+}
+
+bool selectParams(PDQParams& P, int N, int s) {
+    if (N == 16384) {
+        switch (s) {
+            case 8:   param_PDQ_16384_8(P);   return true;
+            case 16:  param_PDQ_16384_16(P);  return true;
+            case 32:  param_PDQ_16384_32(P);  return true;
+            case 64:  param_PDQ_16384_64(P);  return true;
+            case 128: param_PDQ_16384_128(P); return true;
+        }
+    } else if (s == 16) {
+        switch (N) {
+            case 8192:   param_PDQ_8192_16(P);   return true;
+            case 32768:  param_PDQ_32768_16(P);  return true;
+            case 65536:  param_PDQ_65536_16(P);  return true;
+            case 131072: param_PDQ_131072_16(P); return true;
+            case 262144: param_PDQ_262144_16(P); return true;
+            case 524288: param_PDQ_524288_16(P); return true;
+        }
+    }
+    return false;
+}
+
+std::vector<std::pair<int, int>> availableParams() {
+    return {
+        {16384, 8}, {16384, 16}, {16384, 32}, {16384, 64}, {16384, 128},
+        {8192, 16}, {32768, 16}, {65536, 16}, {131072, 16}, {262144, 16}, {524288, 16},
+    };
 }
@@ -0,0 +1,88 @@
+#include "partition.h"
+#include <algorithm>
+#include <stdexcept>
+
+using namespace lbcrypto;
+
+namespace {
+
+// Indices of the main ciphertexts with records in one of the named partitions
+std::vector<size_t> selectedCtxts(
+    const std::vector<CtxtRecords>& records,
+    const std::vector<Partition>& partitions,
+    const std::vector<std::string>& names) {
+
+    std::vector<const Partition*> selected;
+    for (const auto& name : names) {
+        auto it = std::find_if(partitions.begin(), partitions.end(),
+                               [&](const Partition& p) { return p.name == name; });
+        if (it == partitions.end()) throw std::invalid_argument("selectPartitions: unknown partition " + name);
+        selected.push_back(&*it);
+    }
+
+    std::vector<size_t> ctxts;
+    for (size_t c = 0; c < records.size(); c++) {
+        const auto& r = records[c];
+        for (const auto* p : selected) {
+            if (r.first < p->first_record + p->num_records && p->first_record < r.first + r.count) {
+                ctxts.push_back(c);
+                break;
+            }
+        }
+    }
+    if (ctxts.empty()) throw std::invalid_argument("selectPartitions: no records selected");
+    return ctxts;
+}
+
+}  // namespace
+
+std::vector<Partition> equalPartitions(const PDQParams& P, int count) {
+    if (count < 1 || count > P.num_records)
+        throw std::invalid_argument("equalPartitions: need 1 to num_records partitions");
+
+    int64_t size = (P.num_records + count - 1) / count;
+    std::vector<Partition> partitions;
+    for (int64_t first = 0; first < P.num_records; first += size)
+        partitions.push_back({"p" + std::to_string(partitions.size()), first,
+                              std::min<int64_t>(size, P.num_records - first)});
+    return partitions;
+}
+
+std::vector<CtxtRecords> partitionedLayout(const PDQParams& P, const std::vector<Partition>& partitions) {
+    std::vector<CtxtRecords> layout;
+    for (const auto& p : partitions)
+        for (int64_t i = 0; i < p.num_records; i += P.block_size)
+            layout.push_back({p.first_record + i, std::min<int64_t>(P.block_size, p.num_records - i)});
+    return layout;
+}
+
+EncryptedDB selectPartitions(
+    const EncryptedDB& db,
+    const std::vector<Partition>& partitions,
+    const std::vector<std::string>& names) {
+
+    EncryptedDB selection;
+    size_t dim_trace = db.values.empty() ? 0 : db.values_trace.size() / db.values.size();
+    for (size_t c : selectedCtxts(db.records, partitions, names)) {
+        selection.keys.push_back(db.keys[c]);
+        selection.values.push_back(db.values[c]);
+        selection.records.push_back(db.records[c]);
+        selection.values_trace.insert(selection.values_trace.end(), db.values_trace.begin() + c * dim_trace,
+                                      db.values_trace.begin() + (c + 1) * dim_trace);
+    }
+    return selection;
+}
+
+PlainDB selectPartitions(
+    const PlainDB& db,
+    const std::vector<Partition>& partitions,
+    const std::vector<std::string>& names) {
+
+    PlainDB selection;
+    for (size_t c : selectedCtxts(db.records, partitions, names)) {
+        selection.keys.push_back(db.keys[c]);
+        selection.values.push_back(db.values[c]);
+        selection.records.push_back(db.records[c]);
+    }
+    return selection;
+}
@@ -1,4 +1,6 @@
 #include "pdq.h"
+#include "aggregate.h"
+#include "bitmap.h"
 #include "global.h"
 #include "setup.h"
 #include "match.h"
@@ -6,6 +8,13 @@
 #include "ringswitch.h"
 #include "compress.h"
 #include "decompress.h"
+#include "keyseed.h"
+#include "store.h"
+#include "instrument.h"
+#include "noise.h"
+#include "partition.h"
+#include "stream.h"
+#include "wire.h"
 #include "ciphertext-ser.h"
 #include "scheme/bfvrns/bfvrns-ser.h"
 #include "cryptocontext-ser.h"
@@ -16,6 +25,11 @@
 #include <vector>
 #include <set>
 #include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
 
 using namespace lbcrypto;
 
@@ -25,101 +39,355 @@ double getFileSizeKB(const std::string& path) {
     return static_cast<double>(std::filesystem::file_size(path)) / 1024.0;
 }
 
+void writeWireFile(const std::string& path, const std::vector<Ciphertext<DCRTPoly>>& cts) {
+    WireBatch batch;
+    for (const auto& ct : cts) batch.add(ct);
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) throw std::runtime_error("cannot open " + path);
+    writeAll(fd, batch.iovecs());
+    ::close(fd);
+}
+
+double polyMB(const DCRTPoly& poly) {
+    return static_cast<double>(poly.GetNumOfElements()) * poly.GetRingDimension() * sizeof(uint64_t)
+        / (1024.0 * 1024.0);
+}
+
+void printBudget(const char* phase, int bits) {
+    std::cout << "  Noise budget after " << phase << ": " << bits << " bits" << std::endl;
+}
+
+// Re-run ring-switch and compress with fewer trace towers until the digest
+// would fall below the margin; returns the smallest safe towers_bsgs
+int searchBsgsTowers(
+    const PDQParams& P,
+    const KeyPair<DCRTPoly>& keypair_trace,
+    const CryptoContext<DCRTPoly>& context_trace,
+    const EvalKey<DCRTPoly>& switch_key,
+    const EvalKey<DCRTPoly>& relin_switch_key,
+    const RingSwitchChain& chain,
+    const std::vector<CtxtRecords>& records,
+    const std::vector<Ciphertext<DCRTPoly>>& ctxt_masked,
+    const std::vector<Ciphertext<DCRTPoly>>& ctxt_index) {
+
+    const std::string keyTag = keypair_trace.publicKey->GetKeyTag();
+    int all = static_cast<int>(context_trace->GetCryptoParameters()->GetElementParams()->GetParams().size());
+
+    // Trial parameters share P's twiddle cache, which is keyed by tower count
+    PDQParams trial = P;
+    int best = all;
+    for (int towers = all - 1; towers >= 1; towers--) {
+        trial.towers_bsgs = towers;
+        auto masked_trace = ringswitch(trial, context_trace, keyTag, switch_key, ctxt_masked, relin_switch_key, chain);
+        auto index_trace = ringswitch(trial, context_trace, keyTag, switch_key, ctxt_index, nullptr, chain);
+        Ciphertext<DCRTPoly> digest_full;
+        auto digest = compress(trial, records, masked_trace, index_trace, &digest_full);
+        int budget = std::min(noiseBudget(keypair_trace.secretKey, digest_full),
+                              noiseBudget(keypair_trace.secretKey, digest));
+        std::cout << "  towers_bsgs=" << towers << ": digest budget " << budget << " bits" << std::endl;
+        if (budget < noise_margin_bits) break;
+        best = towers;
+    }
+
+    return best;
+}
+
 }  // namespace
 
-void pdq() {
+void pdq(const PDQParams& P, const PDQOptions& options) {
+    bool measure_noise = options.measure_noise && !options.stream;
+
     using Clock = std::chrono::high_resolution_clock;
     Clock::time_point t_start, t_end;
 
-    updateGlobal();
-    injectCompatibleRoot();
+    // Uniform halves of all evaluation keys are expanded from this seed
+    auto key_seed = generateKeySeed();
 
-    // Create main context
-    CCParams<CryptoContextBFVRNS> params;
-    initBFVParams(params);
-    auto context = GenCryptoContext(params);
-    enableFeatures(context);
+    // Contexts and keys
+    auto setup = setupPDQ(P, key_seed);
+    auto& context = setup.context;
+    auto& context_trace = setup.context_trace;
+    auto& keypair = setup.keypair;
+    auto& keypair_trace = setup.keypair_trace;
+    auto& switch_key_client = setup.switch_key;
+    auto& relin_switch_key_client = setup.relin_switch_key;
 
-    // Generate main keys
-    auto keypair = context->KeyGen();
-    context->EvalMultKeyGen(keypair.secretKey);
+    // Create data directory if it doesn't exist
+    std::filesystem::create_directories("data");
 
-    // Create trace context with matching moduli from main context
-    CCParams<CryptoContextBFVRNS> params_trace;
-    initBFVParams_trace(params_trace);
-    auto context_trace = GenCryptoContextWithModuliFrom(params_trace, context);
-    enableFeatures(context_trace);
+    // Key upload: the client sends seed-compressed keys and the server
+    // regenerates their uniform halves (about half the upload; the keys the
+    // server holds in memory are full size, its saved state is seeded too)
+    {
+        std::ofstream os("data/evalkey_seeded.bin", std::ios::binary);
+        serializeSeededEvalMultKey(os, keypair.secretKey->GetKeyTag(), key_seed);
+    }
+    {
+        std::ofstream os("data/rotkey_seeded.bin", std::ios::binary);
+        serializeSeededRotKeys(os, keypair_trace.secretKey->GetKeyTag(), key_seed);
+    }
+    {
+        std::ofstream os("data/swkey_seeded.bin", std::ios::binary);
+        serializeSeededSwitchKey(os, switch_key_client, key_seed);
+    }
+    {
+        std::ofstream os("data/relinswkey_seeded.bin", std::ios::binary);
+        serializeSeededRelinSwitchKey(os, relin_switch_key_client, key_seed);
+    }
+    if (!setup.chain.switch_keys.empty()) {
+        std::ofstream os("data/chainswkey_seeded.bin", std::ios::binary);
+        for (const auto& key : setup.chain.switch_keys) serializeSeededSwitchKey(os, key, key_seed);
+    }
+    {
+        std::ifstream is("data/evalkey_seeded.bin", std::ios::binary);
+        deserializeSeededEvalMultKey(is, context);
+    }
+    {
+        std::ifstream is("data/rotkey_seeded.bin", std::ios::binary);
+        deserializeSeededRotKeys(is, context_trace);
+    }
+    EvalKey<DCRTPoly> switch_key;
+    {
+        std::ifstream is("data/swkey_seeded.bin", std::ios::binary);
+        switch_key = deserializeSeededSwitchKey(is, context);
+    }
+    EvalKey<DCRTPoly> relin_switch_key;
+    {
+        std::ifstream is("data/relinswkey_seeded.bin", std::ios::binary);
+        relin_switch_key = deserializeSeededRelinSwitchKey(is, context);
+    }
+    // Intermediate ring-switch contexts are public (derived from the parameters)
+    RingSwitchChain chain{setup.chain.contexts, setup.chain.keyTags, {}};
+    if (!chain.contexts.empty()) {
+        std::ifstream is("data/chainswkey_seeded.bin", std::ios::binary);
+        for (size_t k = 0; k < chain.contexts.size(); k++)
+            chain.switch_keys.push_back(deserializeSeededSwitchKey(is, chain.contexts[k], k + 1));
+    }
 
-    // TODO: Investigate why this is needed. Without this dummy MakePackedPlaintext
-    // call on the main context, packed encoding fails silently after ring-switch.
-    (void)context->MakePackedPlaintext(std::vector<int64_t>(degree, 0));
+    // Generate and encrypt test data
+    auto testData = generateTestData(P);
+    // Partition pruning: the query covers the records of the first partition
+    std::vector<Partition> partitions;
+    std::vector<CtxtRecords> layout;
+    int64_t scope_end = P.num_records;
+    if (options.partitions > 0) {
+        partitions = equalPartitions(P, options.partitions);
+        layout = partitionedLayout(P, partitions);
+        scope_end = partitions[0].first_record + partitions[0].num_records;
+    }
+    EncryptedDB encryptedDB;
+    PlainDB plainDB;
+    double db_mb = 0;
+    if (options.plain_db) {
+        // One polynomial per key limb and one for the values, per main ciphertext
+        plainDB = encodeDB(P, context, testData, layout);
+        for (const auto& value : plainDB.values) db_mb += (P.key_limbs + 1) * polyMB(value);
+    } else {
+        encryptedDB = encryptDB(P, context, keypair.publicKey, testData, layout);
+        if (options.trace_mask) {
+            // Offline: the values never change, so they are ring-switched once
+            t_start = Clock::now();
+            ringswitchValues(P, encryptedDB, context_trace, keypair_trace.publicKey->GetKeyTag(), switch_key, chain);
+            t_end = Clock::now();
+            double trace_mb = 0;
+            for (const auto& ctxt : encryptedDB.values_trace)
+                for (const auto& poly : ctxt->GetElements()) trace_mb += polyMB(poly);
+            std::cout << "Offline value ring switch: " << std::chrono::duration<double>(t_end - t_start).count()
+                      << "sec, " << trace_mb << " MB" << std::endl;
+        }
+        auto ctxtMB = [](const Ciphertext<DCRTPoly>& ctxt) {
+            double mb = 0;
+            for (const auto& poly : ctxt->GetElements()) mb += polyMB(poly);
+            return mb;
+        };
+        for (size_t c = 0; c < encryptedDB.keys.size(); c++) {
+            for (const auto& limb : encryptedDB.keys[c]) db_mb += ctxtMB(limb);
+            db_mb += ctxtMB(encryptedDB.values[c]);
+        }
+    }
+    std::cout << "DB size (" << (options.plain_db ? "plaintext" : "encrypted") << "): "
+              << db_mb << " MB" << std::endl;
+    std::cout << "Ring switch:";
+    for (int ring : ringSwitchChain(P)) std::cout << (ring == P.degree ? " " : " -> ") << ring;
+    std::cout << std::endl;
+    std::cout << "Key width: " << std::min(64, P.key_limbs * P.limb_bits) << " bits ("
+              << P.key_limbs << " x " << P.limb_bits << "-bit limbs)" << std::endl;
+    // Replicated layout: one key per slot block, the planted query value first,
+    // then keys of records spread over the DB
+    std::vector<uint64_t> block_keys{testData.query_value};
+    for (int r = 1; r < P.replicas; r++) block_keys.push_back(testData.keys[r * (P.num_records / P.replicas)]);
+    auto ctxt_query = P.replicas > 1 ? encryptKeys(P, context, keypair.publicKey, block_keys)
+                                     : encryptKey(P, context, keypair.publicKey, testData.query_value);
+    if (P.replicas > 1)
+        std::cout << "Replicated layout: " << P.replicas << " keys per query ciphertext" << std::endl;
+    // IN-list query: every candidate key, the first being ctxt_query
+    std::vector<EncryptedKey> ctxt_queries{ctxt_query};
+    for (size_t j = 1; j < testData.query_values.size(); j++)
+        ctxt_queries.push_back(encryptKey(P, context, keypair.publicKey, testData.query_values[j]));
+    if (ctxt_queries.size() > 1)
+        std::cout << "IN-list query: " << ctxt_queries.size() << " candidate keys" << std::endl;
+    if (!partitions.empty()) {
+        size_t total = options.plain_db ? plainDB.keys.size() : encryptedDB.keys.size();
+        if (options.plain_db) plainDB = selectPartitions(plainDB, partitions, {partitions[0].name});
+        else encryptedDB = selectPartitions(encryptedDB, partitions, {partitions[0].name});
+        size_t queried = options.plain_db ? plainDB.keys.size() : encryptedDB.keys.size();
+        std::cout << "Partitions: " << partitions.size() << ", querying " << partitions[0].name << " ("
+                  << queried << " of " << total << " main ciphertexts)" << std::endl;
+    }
+    const auto& records = options.plain_db ? plainDB.records : encryptedDB.records;
 
-    // Generate trace keys
-    auto keypair_trace = context_trace->KeyGen();
-    context_trace->EvalMultKeyGen(keypair_trace.secretKey);
-    auto rotIndices = computeRotationIndices();
-    if (!rotIndices.empty()) {
-        context_trace->EvalRotateKeyGen(keypair_trace.secretKey, rotIndices);
+    // Bitmap index over the queried ciphertexts, and the client's selection of
+    // the query keys
+    EncryptedBitmapIndex encryptedIndex;
+    PlainBitmapIndex plainIndex;
+    std::vector<Ciphertext<DCRTPoly>> ctxt_selection;
+    if (options.bitmap) {
+        auto dictionary = keyDictionary(testData);
+        double index_mb = 0;
+        if (options.plain_db) {
+            plainIndex = encodeBitmapIndex(P, context, testData, dictionary, records);
+            for (const auto& bitmaps : plainIndex.bitmaps)
+                for (const auto& bitmap : bitmaps) index_mb += polyMB(bitmap);
+        } else {
+            encryptedIndex = encryptBitmapIndex(P, context, keypair.publicKey, testData, dictionary, records);
+            for (const auto& bitmaps : encryptedIndex.bitmaps)
+                for (const auto& bitmap : bitmaps)
+                    for (const auto& poly : bitmap->GetElements()) index_mb += polyMB(poly);
+        }
+        ctxt_selection = encryptSelection(P, context, keypair.publicKey, dictionary, testData.query_values);
+        std::cout << "Bitmap index: " << dictionary.size() << " distinct keys, " << index_mb << " MB" << std::endl;
     }
 
-    // Generate switch target keypair in MAIN context and lift it
-    auto keypair_switch_target = context->KeyGen();
-    liftSecretKey(keypair_switch_target, keypair_trace);
+    std::cout << "Setup complete. Starting benchmark...\n" << std::endl;
 
-    // Create switch key: main key -> lifted key (both in main context)
-    auto switch_key = context->GetScheme()->KeySwitchGen(
-        keypair.secretKey, keypair_switch_target.secretKey);
+    std::vector<Ciphertext<DCRTPoly>> ctxt_index, ctxt_masked;
+    Ciphertext<DCRTPoly> ctxt_digest;
+    int budget_match = 0, budget_mask = 0, budget_ringswitch = 0, budget_compress = 0;
 
-    // Generate and encrypt test data
-    auto testData = generateTestData();
-    auto encryptedDB = encryptDB(context, keypair.publicKey, testData);
-    auto ctxt_query = context->Encrypt(keypair.publicKey,
-        context->MakePackedPlaintext(std::vector<int64_t>(degree, testData.query_value)));
+    if (options.stream) {
+        // =====================================================================
+        // Stream (match -> mask -> ringswitch -> compress per main ciphertext)
+        // =====================================================================
+        t_start = Clock::now();
+        {
+            PhaseScope phase("stream");
+            if (options.plain_db)
+                ctxt_digest = streamQuery(P, plainDB, ctxt_query,
+                    context_trace, keypair_trace.publicKey->GetKeyTag(), switch_key, chain);
+            else
+                ctxt_digest = streamQuery(P, encryptedDB, ctxt_query,
+                    context_trace, keypair_trace.publicKey->GetKeyTag(), switch_key, relin_switch_key, chain);
+        }
+        t_end = Clock::now();
+        double time_stream = std::chrono::duration<double>(t_end - t_start).count();
+        std::cout << "Stream time: " << time_stream << "sec" << std::endl;
+    } else {
+        // =====================================================================
+        // Match
+        // =====================================================================
+        t_start = Clock::now();
+        {
+            PhaseScope phase("match");
+            if (options.bitmap)
+                ctxt_index = options.plain_db ? matchBitmapPlain(plainIndex, ctxt_selection)
+                                              : matchBitmap(encryptedIndex, ctxt_selection);
+            else
+                ctxt_index = options.plain_db ? matchPlain(plainDB.keys, ctxt_queries)
+                                              : match(encryptedDB.keys, ctxt_queries);
+        }
+        t_end = Clock::now();
+        double time_match = std::chrono::duration<double>(t_end - t_start).count();
+        std::cout << "Match time: " << time_match << "sec" << std::endl;
+        if (measure_noise) printBudget("match", budget_match = minNoiseBudget(keypair.secretKey, ctxt_index));
 
-    std::cout << "Setup complete. Starting benchmark...\n" << std::endl;
+        // =====================================================================
+        // Mask (main ring; trace-ring masking multiplies after the ring switch)
+        // =====================================================================
+        if (!options.trace_mask) {
+            t_start = Clock::now();
+            {
+                PhaseScope phase("mask");
+                // Encrypted values: left unrelinearized; ringswitch() relinearizes during
+                // its key switch. Plaintext values: a plaintext multiply, nothing to relinearize.
+                ctxt_masked = options.plain_db ? maskPlain(plainDB.values, ctxt_index)
+                                               : maskNoRelin(encryptedDB.values, ctxt_index);
+            }
+            t_end = Clock::now();
+            double time_mask = std::chrono::duration<double>(t_end - t_start).count();
+            std::cout << "Mask time: " << time_mask << "sec" << std::endl;
+            if (measure_noise) printBudget("mask", budget_mask = minNoiseBudget(keypair.secretKey, ctxt_masked));
+        }
 
-    // =========================================================================
-    // Match
-    // =========================================================================
-    t_start = Clock::now();
-    auto ctxt_index = match(encryptedDB.keys, ctxt_query);
-    t_end = Clock::now();
-    double time_match = std::chrono::duration<double>(t_end - t_start).count();
-    std::cout << "Match time: " << time_match << "sec" << std::endl;
+        // =====================================================================
+        // Ring-switch
+        // =====================================================================
+        std::vector<Ciphertext<DCRTPoly>> ctxt_index_trace, ctxt_masked_trace;
+        t_start = Clock::now();
+        {
+            PhaseScope phase("ringswitch");
+            if (options.trace_mask) {
+                // Indicators only, at all trace towers for the multiply
+                ctxt_index_trace = ringswitch(allTraceTowers(P), context_trace, keypair_trace.publicKey->GetKeyTag(),
+                                              switch_key, ctxt_index, nullptr, chain);
+            } else {
+                ctxt_index_trace = ringswitch(P, context_trace, keypair_trace.publicKey->GetKeyTag(), switch_key,
+                                              ctxt_index, nullptr, chain);
+                ctxt_masked_trace = ringswitch(P, context_trace, keypair_trace.publicKey->GetKeyTag(), switch_key,
+                                               ctxt_masked, relin_switch_key, chain);
+            }
+        }
+        t_end = Clock::now();
+        double time_ringswitch = std::chrono::duration<double>(t_end - t_start).count();
+        std::cout << "RingSwitch time: " << time_ringswitch << "sec" << std::endl;
+        if (measure_noise) {
+            budget_ringswitch = std::min(minNoiseBudget(keypair_trace.secretKey, ctxt_index_trace),
+                                         minNoiseBudget(keypair_trace.secretKey, ctxt_masked_trace));
+            printBudget("ringswitch", budget_ringswitch);
+        }
 
-    // =========================================================================
-    // Mask
-    // =========================================================================
-    t_start = Clock::now();
-    auto ctxt_masked = mask(encryptedDB.values, ctxt_index);
-    t_end = Clock::now();
-    double time_mask = std::chrono::duration<double>(t_end - t_start).count();
-    std::cout << "Mask time: " << time_mask << "sec" << std::endl;
+        if (options.trace_mask) {
+            // =================================================================
+            // Mask (trace ring, values ring-switched offline)
+            // =================================================================
+            t_start = Clock::now();
+            {
+                PhaseScope phase("mask");
+                ctxt_masked_trace = maskTrace(P, encryptedDB.values_trace, ctxt_index_trace);
+            }
+            t_end = Clock::now();
+            double time_mask = std::chrono::duration<double>(t_end - t_start).count();
+            std::cout << "Mask (trace ring) time: " << time_mask << "sec" << std::endl;
+        }
 
-    // =========================================================================
-    // Ring-switch
-    // =========================================================================
-    t_start = Clock::now();
-    auto ctxt_index_trace = ringswitch(context_trace, keypair_trace.publicKey->GetKeyTag(), switch_key, ctxt_index);
-    auto ctxt_masked_trace = ringswitch(context_trace, keypair_trace.publicKey->GetKeyTag(), switch_key, ctxt_masked);
-    t_end = Clock::now();
-    double time_ringswitch = std::chrono::duration<double>(t_end - t_start).count();
-    std::cout << "RingSwitch time: " << time_ringswitch << "sec" << std::endl;
-
-    // =========================================================================
-    // Compress
-    // =========================================================================
-    t_start = Clock::now();
-    auto ctxt_digest = compress(ctxt_masked_trace, ctxt_index_trace);
-    t_end = Clock::now();
-    double time_compress = std::chrono::duration<double>(t_end - t_start).count();
-    std::cout << "Compress time: " << time_compress << "sec" << std::endl;
+        // =====================================================================
+        // Compress
+        // =====================================================================
+        t_start = Clock::now();
+        Ciphertext<DCRTPoly> ctxt_digest_full;
+        {
+            PhaseScope phase("compress");
+            ctxt_digest = compress(P, records, ctxt_masked_trace, ctxt_index_trace,
+                measure_noise ? &ctxt_digest_full : nullptr);
+        }
+        t_end = Clock::now();
+        double time_compress = std::chrono::duration<double>(t_end - t_start).count();
+        std::cout << "Compress time: " << time_compress << "sec" << std::endl;
+        if (measure_noise) {
+            printBudget("compress (before final Compress)",
+                        budget_compress = noiseBudget(keypair_trace.secretKey, ctxt_digest_full));
+            printBudget("compress", noiseBudget(keypair_trace.secretKey, ctxt_digest));
+        }
+    }
 
     // =========================================================================
     // Decompress (client-side)
     // =========================================================================
     t_start = Clock::now();
-    auto recovered = recover(keypair_trace.secretKey, ctxt_digest);
+    std::vector<std::vector<std::pair<int64_t, int64_t>>> recovered;
+    {
+        PhaseScope phase("decompress");
+        recovered = recoverBlocks(P, keypair_trace.secretKey, ctxt_digest, P.replicas);
+    }
     t_end = Clock::now();
     double time_decompress = std::chrono::duration<double, std::milli>(t_end - t_start).count();
     std::cout << "Decompress time: " << time_decompress << "ms" << std::endl;
@@ -127,25 +395,112 @@ void pdq() {
     // =========================================================================
     // Verification
     // =========================================================================
-    std::set<int64_t> true_indices_set(testData.matching_indices.begin(), testData.matching_indices.end());
-    bool correct = checkResult(recovered, testData.values, true_indices_set);
+    // Records outside the queried partition are not expected
+    std::set<int64_t> true_indices_set;
+    for (int i : testData.matching_indices)
+        if (i < scope_end) true_indices_set.insert(i);
+    bool correct = checkResult(recovered[0], testData.values, true_indices_set);
+    for (int r = 1; r < P.replicas; r++) {
+        std::set<int64_t> truth;
+        for (int i = 0; i < scope_end; i++)
+            if (testData.keys[i] == block_keys[r]) truth.insert(i);
+        correct = checkResult(recovered[r], testData.values, truth) && correct;
+    }
     std::cout << "\nVerification: " << (correct ? "PASSED" : "FAILED") << std::endl;
 
+    // =========================================================================
+    // Aggregates (match and mask, then one ring switch of the slot sums)
+    // =========================================================================
+    Ciphertext<DCRTPoly> ctxt_aggregate;
+    if (options.aggregate) {
+        std::cout << "\n[Aggregates]" << std::endl;
+        // Aggregates are over the first key only
+        int64_t true_count = 0, true_sum = 0;
+        for (int i = 0; i < scope_end; i++) {
+            if (testData.keys[i] != testData.query_value) continue;
+            true_count++;
+            true_sum = (true_sum + testData.values[i]) % P.ptxt_modulus;
+        }
+
+        for (QueryKind kind : {QueryKind::Count, QueryKind::Sum}) {
+            const char* name = kind == QueryKind::Count ? "count" : "sum";
+            t_start = Clock::now();
+            {
+                PhaseScope phase(name);
+                ctxt_aggregate = options.plain_db
+                    ? aggregateQuery(P, kind, plainDB, ctxt_query,
+                        context_trace, keypair_trace.publicKey->GetKeyTag(), switch_key, chain)
+                    : aggregateQuery(P, kind, encryptedDB.keys, encryptedDB.values, ctxt_query,
+                        context_trace, keypair_trace.publicKey->GetKeyTag(), switch_key, relin_switch_key, chain);
+            }
+            t_end = Clock::now();
+            double time_server = std::chrono::duration<double>(t_end - t_start).count();
+
+            t_start = Clock::now();
+            int64_t result = recoverAggregate(keypair_trace.secretKey, ctxt_aggregate);
+            t_end = Clock::now();
+            double time_client = std::chrono::duration<double, std::milli>(t_end - t_start).count();
+
+            int64_t expected = kind == QueryKind::Count ? true_count : true_sum;
+            std::cout << (kind == QueryKind::Count ? "COUNT: " : "SUM: ") << result
+                      << " (expected " << expected << ", " << (result == expected ? "PASSED" : "FAILED") << "), "
+                      << "server " << time_server << "sec, client " << time_client << "ms" << std::endl;
+        }
+    }
+
+    // Per-phase operation counts, timings and memory
+    std::ofstream metrics_file("data/metrics.json");
+    writeMetricsJSON(metrics_file, P);
+    metrics_file.close();
+    std::cout << "Metrics written to data/metrics.json" << std::endl;
+
+    // =========================================================================
+    // Noise budget (testing only: uses the secret keys)
+    // =========================================================================
+    if (measure_noise) {
+        std::cout << "\n[Noise]" << std::endl;
+        std::cout << "Consumed: mask " << budget_match - budget_mask << " bits, "
+                  << "ringswitch " << budget_mask - budget_ringswitch << " bits, "
+                  << "compress " << budget_ringswitch - budget_compress << " bits" << std::endl;
+
+        // Main-context noise carries over to the digest relative to Q, so the
+        // digest's surplus over the margin is what the main context can shed
+        double bits_main = bitsPerTower(ctxt_masked[0]);
+        int spare_levels = static_cast<int>(std::floor((budget_compress - noise_margin_bits) / bits_main));
+        std::cout << "Recommended MultiplicativeDepth: "
+                  << std::max(1, P.MultiplicativeDepth - std::max(0, spare_levels))
+                  << " (currently " << P.MultiplicativeDepth << ")" << std::endl;
+
+        std::cout << "Searching towers_bsgs (margin " << noise_margin_bits << " bits):" << std::endl;
+        int best = searchBsgsTowers(P, keypair_trace, context_trace, switch_key, relin_switch_key, chain, records,
+                                    ctxt_masked, ctxt_index);
+        std::cout << "Recommended towers_bsgs: " << best << " (currently " << bsgsTowers(P, context_trace)
+                  << ", noise bound " << minBsgsTowers(P) << ")" << std::endl;
+        std::cout << "Apply one recommendation at a time and re-run with --noise." << std::endl;
+    }
+
     // =========================================================================
     // Communication cost measurement
     // =========================================================================
     std::cout << "\n[Communication]" << std::endl;
 
-    // Create data directory if it doesn't exist
-    std::filesystem::create_directories("data");
-
-    // Per-query: digest (server -> client)
-    Serial::SerializeToFile("data/digest.bin", ctxt_digest, SerType::BINARY);
+    // Per-query: digest (server -> client), in the raw wire format of pdq_server
+    writeWireFile("data/digest.bin", {ctxt_digest});
     std::cout << "Digest size: " << getFileSizeKB("data/digest.bin") << " KB" << std::endl;
+    if (ctxt_aggregate) {
+        writeWireFile("data/aggregate_digest.bin", {ctxt_aggregate});
+        std::cout << "Aggregate digest size: " << getFileSizeKB("data/aggregate_digest.bin") << " KB" << std::endl;
+    }
 
-    // Per-query: query ciphertext (client -> server)
-    Serial::SerializeToFile("data/query.bin", ctxt_query, SerType::BINARY);
+    // Per-query: query ciphertexts (client -> server)
+    std::vector<Ciphertext<DCRTPoly>> query_wire;
+    for (const auto& key : ctxt_queries) query_wire.insert(query_wire.end(), key.begin(), key.end());
+    writeWireFile("data/query.bin", query_wire);
     std::cout << "Query size: " << getFileSizeKB("data/query.bin") << " KB" << std::endl;
+    if (!ctxt_selection.empty()) {
+        writeWireFile("data/selection.bin", ctxt_selection);
+        std::cout << "Bitmap selection size: " << getFileSizeKB("data/selection.bin") << " KB" << std::endl;
+    }
 
     // One-time setup: eval mult key (main context)
     std::ofstream evalkey_file("data/evalkey.bin", std::ios::binary);
@@ -162,4 +517,31 @@ void pdq() {
     // One-time setup: switch key
     Serial::SerializeToFile("data/swkey.bin", switch_key, SerType::BINARY);
     std::cout << "SwitchKey size: " << getFileSizeKB("data/swkey.bin") << " KB" << std::endl;
+    Serial::SerializeToFile("data/relinswkey.bin", relin_switch_key, SerType::BINARY);
+    std::cout << "RelinSwitchKey size: " << getFileSizeKB("data/relinswkey.bin") << " KB" << std::endl;
+
+    // One-time setup: seed-compressed keys (as uploaded above)
+    std::cout << "EvalKey (seeded) size: " << getFileSizeKB("data/evalkey_seeded.bin") << " KB" << std::endl;
+    std::cout << "RotKey (seeded) size: " << getFileSizeKB("data/rotkey_seeded.bin") << " KB" << std::endl;
+    std::cout << "SwitchKey (seeded) size: " << getFileSizeKB("data/swkey_seeded.bin") << " KB" << std::endl;
+    std::cout << "RelinSwitchKey (seeded) size: " << getFileSizeKB("data/relinswkey_seeded.bin") << " KB" << std::endl;
+    if (!chain.contexts.empty())
+        std::cout << "ChainSwitchKeys (seeded) size: " << getFileSizeKB("data/chainswkey_seeded.bin") << " KB" << std::endl;
+
+    // =========================================================================
+    // Server state persistence
+    // =========================================================================
+    std::cout << "\n[Server state]" << std::endl;
+
+    ServerState server_state{P, context, context_trace,
+        keypair.secretKey->GetKeyTag(), keypair_trace.secretKey->GetKeyTag(), switch_key, relin_switch_key, chain,
+        key_seed};
+    saveServerState("data/server.bin", server_state);
+    std::cout << "ServerState size: " << getFileSizeKB("data/server.bin") << " KB" << std::endl;
+
+    t_start = Clock::now();
+    auto restored_state = loadServerState("data/server.bin");
+    t_end = Clock::now();
+    double time_restore = std::chrono::duration<double>(t_end - t_start).count();
+    std::cout << "Restore time: " << time_restore << "sec" << std::endl;
 }
@@ -1,5 +1,11 @@
 #include "ringswitch.h"
+#include "arena.h"
 #include "global.h"
+#include "instrument.h"
+#include "kernels.h"
+#include "modp.h"
+#include "setup.h"
+#include <stdexcept>
 
 using namespace lbcrypto;
 
@@ -17,60 +23,117 @@ int64_t modpow(int64_t base, int64_t exp, int64_t mod) {
     return result;
 }
 
+// to[k] = from[d * k + chunk] for k < n'. With d a compile-time constant the
+// strided gather unrolls; n' is a power of two, so blocks of 8 need no tail.
+template <class Dim>
+void extractChunk(Dim d, uint64_t* to, const uint64_t* from, int ring_to, int chunk) {
+    const int dim = d;
+    from += chunk;
+    for (int k = 0; k < ring_to; k += 8) {
+        for (int u = 0; u < 8; u++) to[k + u] = from[dim * (k + u)];
+    }
+}
+
+// ζ^e mod p for e = 0..m-1
+template <class Mod>
+std::vector<uint64_t> powerTable(const Mod& mod, uint64_t zeta, int64_t m) {
+    std::vector<uint64_t> table(m);
+    table[0] = 1;
+    for (int64_t e = 1; e < m; e++) table[e] = mod.mul(table[e-1], zeta);
+    return table;
+}
+
+}  // namespace
+
+// The second component is switched with switch_key. An unrelinearized third
+// component is switched with relin_switch_key (s^2 -> lifted key) in the same
+// step, so the relinearization runs at the trimmed tower count instead of as a
+// separate full-tower key switch in the main ring.
+void switchToTrace(
+    Ciphertext<DCRTPoly>& ctxt,
+    const EvalKey<DCRTPoly>& switch_key,
+    const EvalKey<DCRTPoly>& relin_switch_key) {
+
+    auto scheme = ctxt->GetCryptoContext()->GetScheme();
+    auto& cv = ctxt->GetElements();
+
+    if (cv.size() == 2) {
+        scheme->KeySwitchInPlace(ctxt, switch_key);
+        countOp(Op::KeySwitch);
+        return;
+    }
+    if (cv.size() != 3 || !relin_switch_key)
+        throw std::runtime_error("switchToTrace: unrelinearized input needs relin_switch_key");
+
+    auto ba1 = scheme->KeySwitchCore(cv[1], switch_key);
+    auto ba2 = scheme->KeySwitchCore(cv[2], relin_switch_key);
+    cv[0] += (*ba1)[0];
+    cv[0] += (*ba2)[0];
+    (*ba1)[1] += (*ba2)[1];
+    cv[1] = std::move((*ba1)[1]);
+    cv.pop_back();
+    countOp(Op::Relin);
+    countOp(Op::KeySwitch, 2);
+}
+
 // Precompute twiddle factors applied during coefficient extraction.
 // twiddles[r][k-1] for r=0..d-1, k=1..d-1
 // Slot j' of twiddle (r,k):
 //   First half:  (ζ^{τ^r · 5^{j'} mod m})^k
 //   Second half: (ζ^{-(τ^r · 5^{j'} mod m)})^k
-// where τ = 5^{n'/2} mod m, m = 2n.
+// where τ = 5^{n'/2} mod m, m = 2n, for a switch from ring n to ring n' = n/d.
+// ζ is the packed-encoding root of ring n registered by injectCompatibleRoot() or loadServerState().
+// Twiddles are kept over the first `towers` towers of context_trace (ring n').
 std::vector<std::vector<DCRTPoly>> precomputeTwiddles(
-    const CryptoContext<DCRTPoly>& context_trace) {
+    const PDQParams& P,
+    const CryptoContext<DCRTPoly>& context_trace,
+    size_t towers,
+    int ring_from) {
 
-    int64_t p = ptxt_modulus;
-    int64_t m = 2 * degree;
+    int64_t m = 2 * ring_from;
+    int ring_to = context_trace->GetRingDimension();
+    int ring_to_half = ring_to / 2;
+    int dim = ring_from / ring_to;
 
-    // Compute ζ (primitive m-th root of unity mod p)
-    NativeInteger zeta_ni = RootOfUnity<NativeInteger>(m, NativeInteger(p));
-    int64_t zeta = static_cast<int64_t>(zeta_ni.ConvertToInt());
+    // ζ (primitive m-th root of unity mod p)
+    uint64_t zeta = plainRootOfUnity(P.ptxt_modulus, m);
 
     // τ = 5^{n'/2} mod m
-    int64_t tau = modpow(5, degree_trace_half, m);
+    int64_t tau = modpow(5, ring_to_half, m);
 
     // τ^r mod m for r = 0..d-1
-    std::vector<int64_t> tau_r(dim_trace);
+    std::vector<int64_t> tau_r(dim);
     tau_r[0] = 1;
-    for (int r = 1; r < dim_trace; r++)
+    for (int r = 1; r < dim; r++)
         tau_r[r] = tau_r[r-1] * tau % m;
 
-    std::vector<std::vector<DCRTPoly>> twiddles(dim_trace,
-        std::vector<DCRTPoly>(dim_trace - 1));
+    std::vector<std::vector<DCRTPoly>> twiddles(dim,
+        std::vector<DCRTPoly>(dim - 1));
+
+    // m is a power of two: exponents are reduced with a mask and looked up
+    auto zeta_pow = withPlainModulus(P.ptxt_modulus, [&](const auto& mod) { return powerTable(mod, zeta, m); });
+    const int64_t m_mask = m - 1;
 
-    for (int r = 0; r < dim_trace; r++) {
-        for (int k = 1; k < dim_trace; k++) {
+    for (int r = 0; r < dim; r++) {
+        for (int k = 1; k < dim; k++) {
             // Build slot vector
-            std::vector<int64_t> slot_vec(degree_trace);
+            std::vector<int64_t> slot_vec(ring_to);
 
             int64_t pow5 = 1;
-            for (int jp = 0; jp < degree_trace_half; jp++) {
-                int64_t base_exp = tau_r[r] * pow5 % m;
+            for (int jp = 0; jp < ring_to_half; jp++) {
+                int64_t exp = (k * ((tau_r[r] * pow5) & m_mask)) & m_mask;
 
                 // First half: ζ^{k · base_exp mod m} mod p
-                slot_vec[jp] = modpow(zeta, k * base_exp % m, p);
+                slot_vec[jp] = static_cast<int64_t>(zeta_pow[exp]);
 
                 // Second half: ζ^{m - (k · base_exp mod m)} mod p
-                int64_t neg_exp = (m - k * base_exp % m) % m;
-                slot_vec[degree_trace_half + jp] = modpow(zeta, neg_exp, p);
+                slot_vec[ring_to_half + jp] = static_cast<int64_t>(zeta_pow[(m - exp) & m_mask]);
 
-                pow5 = pow5 * 5 % m;
+                pow5 = (pow5 * 5) & m_mask;
             }
 
             // Encode slot vector → DCRTPoly via packed encoding
-            auto pt = context_trace->MakePackedPlaintext(slot_vec);
-            DCRTPoly tw = pt->GetElement<DCRTPoly>();
-            if (tw.GetFormat() != Format::EVALUATION)
-                tw.SwitchFormat();
-
-            twiddles[r][k-1] = std::move(tw);
+            twiddles[r][k-1] = encodeEval(context_trace, slot_vec, towers);
         }
     }
 
@@ -85,87 +148,156 @@ void ringswitchCore(
     std::vector<Ciphertext<DCRTPoly>>& result) {
 
     size_t numLimbs = ciphertext->GetElements()[0].GetNumOfElements();
+    int ring_to = context_trace->GetRingDimension();
+    int dim = ciphertext->GetElements()[0].GetRingDimension() / ring_to;
+
+    // All intermediate polynomials live in the worker's arena: scratch slots
+    // 0-1 hold the input in coefficient form, 2-3 the extracted chunk
+    auto& arena = QueryArena::local();
 
-    auto poly_main = ciphertext->GetElements();
+    DCRTPoly* poly_main[2];
     for (int i = 0; i < 2; i++) {
-        poly_main[i].SwitchFormat();
+        const auto& element = ciphertext->GetElements()[i];
+        poly_main[i] = &arena.scratch(i, element.GetParams(), element.GetFormat());
+        copyLimbs(*poly_main[i], element);
+        poly_main[i]->SwitchFormat();
     }
+    countOp(Op::PdqNTT, 2 * numLimbs);
 
-    auto traceParams = context_trace->GetCryptoParameters()->GetElementParams();
+    // Output keeps as many towers as the (possibly trimmed) input
+    auto traceParams = truncateParams(
+        context_trace->GetCryptoParameters()->GetElementParams(), numLimbs);
 
-    // acc[r][i]: accumulator for output ciphertext r, component i
-    std::vector<std::vector<DCRTPoly>> acc(dim_trace, std::vector<DCRTPoly>(2));
-    for (int r = 0; r < dim_trace; r++) {
-        for (int i = 0; i < 2; i++) {
-            acc[r][i] = DCRTPoly(traceParams, Format::EVALUATION, true);
-        }
-    }
+    // acc[r]: output ciphertext r, whose elements are the accumulators
+    std::vector<Ciphertext<DCRTPoly>> acc(dim);
+    for (int r = 0; r < dim; r++) acc[r] = arena.ciphertext(context_trace, traceParams, 2);
 
-    for (int chunk = 0; chunk < dim_trace; chunk++) {
-        // Extract coefficients at offset chunk with stride dim_trace
-        std::vector<DCRTPoly> poly_trace(2);
+    for (int chunk = 0; chunk < dim; chunk++) {
+        // Extract coefficients at offset chunk with stride dim
+        DCRTPoly* poly_trace[2];
         for (int i = 0; i < 2; i++) {
-            poly_trace[i] = DCRTPoly(traceParams, Format::COEFFICIENT, true);
+            poly_trace[i] = &arena.scratch(2 + i, traceParams, Format::COEFFICIENT);
+            const auto& towers_main = poly_main[i]->GetAllElements();
+            auto& towers_trace = poly_trace[i]->GetAllElements();
             for (size_t limb = 0; limb < numLimbs; limb++) {
-                auto limb_main = poly_main[i].GetElementAtIndex(limb);
-                auto limb_trace = poly_trace[i].GetElementAtIndex(limb);
-                for (int k = 0; k < degree_trace; k++) {
-                    limb_trace[k] = limb_main[dim_trace * k + chunk];
-                }
-                poly_trace[i].SetElementAtIndex(limb, limb_trace);
+                const auto* from = reinterpret_cast<const uint64_t*>(&towers_main[limb][0]);
+                auto* to = reinterpret_cast<uint64_t*>(&towers_trace[limb][0]);
+                withSwitchDim(dim, [&](auto d) { extractChunk(d, to, from, ring_to, chunk); });
             }
-            poly_trace[i].SwitchFormat();
+            poly_trace[i]->SwitchFormat();
         }
-
-        // Fused multiply-accumulate
-        if (chunk == 0) {
-            for (int r = 0; r < dim_trace; r++) {
-                for (int i = 0; i < 2; i++) {
-                    acc[r][i] += poly_trace[i];
-                }
-            }
-        } else {
-            for (int r = 0; r < dim_trace; r++) {
-                for (int i = 0; i < 2; i++) {
-                    acc[r][i] += twiddles[r][chunk-1] * poly_trace[i];
+        countOp(Op::PdqNTT, 2 * numLimbs);
+
+        // Fused multiply-accumulate; the first chunk initializes the accumulators
+        for (int r = 0; r < dim; r++) {
+            auto& elements = acc[r]->GetElements();
+            for (int i = 0; i < 2; i++) {
+                if (chunk == 0) {
+                    copyLimbs(elements[i], *poly_trace[i]);
+                } else {
+                    mulAddInPlace(elements[i], twiddles[r][chunk-1], *poly_trace[i]);
                 }
             }
         }
     }
 
-    // Construct d ciphertexts from accumulators
-    for (int r = 0; r < dim_trace; r++) {
-        auto ctxt_trace = std::make_shared<CiphertextImpl<DCRTPoly>>(context_trace);
-        ctxt_trace->SetElements({acc[r][0], acc[r][1]});
-        ctxt_trace->SetKeyTag(keyTag);
-        ctxt_trace->SetEncodingType(PACKED_ENCODING);
-        result.push_back(std::move(ctxt_trace));
+    for (int r = 0; r < dim; r++) {
+        acc[r]->SetKeyTag(keyTag);
+        acc[r]->SetEncodingType(PACKED_ENCODING);
+        result.push_back(std::move(acc[r]));
     }
 }
 
+namespace {
+
+// Twiddles of one level, computed once per (ring, tower count) of a database:
+// they otherwise depend only on the target context and P. The cache lives in
+// P.caches, so it is shared by concurrent queries of the database and starts
+// over when its parameters are derived again.
+const std::vector<std::vector<DCRTPoly>>& cachedTwiddles(
+    const PDQParams& P,
+    const CryptoContext<DCRTPoly>& context_to,
+    size_t towers,
+    int ring_from) {
+
+    if (!P.caches) throw std::invalid_argument("ringswitch: parameters not derived (PDQParams::derive)");
+    auto& caches = *P.caches;
+
+    std::lock_guard<std::mutex> lock(caches.twiddle_mutex);
+    auto key = std::make_pair(ring_from, towers);
+    auto it = caches.twiddles.find(key);
+    if (it == caches.twiddles.end())
+        it = caches.twiddles.emplace(key, precomputeTwiddles(P, context_to, towers, ring_from)).first;
+    return it->second;
+}
+
 }  // namespace
 
 std::vector<Ciphertext<DCRTPoly>> ringswitch(
+    const PDQParams& P,
     const CryptoContext<DCRTPoly>& context_trace,
     const std::string& keyTag,
     const EvalKey<DCRTPoly>& switch_key,
-    const std::vector<Ciphertext<DCRTPoly>>& ctxts) {
+    const std::vector<Ciphertext<DCRTPoly>>& ctxts,
+    const EvalKey<DCRTPoly>& relin_switch_key,
+    const RingSwitchChain& chain) {
 
     auto context_main = ctxts[0]->GetCryptoContext();
-    size_t towers = context_trace->GetCryptoParameters()
-                        ->GetElementParams()->GetParams().size();
 
-    // Precompute twiddles once (depends only on context_trace and globals)
-    static auto twiddles = precomputeTwiddles(context_trace);
+    // Drop to the towers compress needs before key switching, so that the key
+    // switch, the extraction NTTs and everything downstream skip unused towers
+    size_t towers = bsgsTowers(P, context_trace);
+
+    // Target ring of each level: the intermediate rings, then the trace ring
+    std::vector<CryptoContext<DCRTPoly>> contexts_to(chain.contexts);
+    std::vector<std::string> keyTags_to(chain.keyTags);
+    contexts_to.push_back(context_trace);
+    keyTags_to.push_back(keyTag);
 
     std::vector<Ciphertext<DCRTPoly>> result;
-    result.reserve(ctxts.size() * dim_trace);
+    result.reserve(ctxts.size() * P.dim_trace);
+
+    // Every level's outputs of one input (values or indices) can be pooled
+    QueryArena::local().reservePool(4 * static_cast<size_t>(P.dim_trace) + 8);
 
     for (const auto& ctxt : ctxts) {
         auto ctxt_switched = context_main->Compress(ctxt, towers);
-        context_main->GetScheme()->KeySwitchInPlace(ctxt_switched, switch_key);
-        ringswitchCore(ctxt_switched, context_trace, keyTag, twiddles, result);
+        switchToTrace(ctxt_switched, switch_key, relin_switch_key);
+
+        // Level by level; output r of a level expands into outputs
+        // r * d' .. r * d' + d' - 1 of the next, so the final order is the one
+        // a single switch by dim_trace would produce
+        std::vector<Ciphertext<DCRTPoly>> level{ctxt_switched};
+        for (size_t k = 0; k < contexts_to.size(); k++) {
+            int ring_from = level[0]->GetElements()[0].GetRingDimension();
+            const auto& twiddles = cachedTwiddles(P, contexts_to[k], towers, ring_from);
+
+            std::vector<Ciphertext<DCRTPoly>> next;
+            for (auto& ct : level) {
+                if (k > 0) switchToTrace(ct, chain.switch_keys[k - 1], nullptr);
+                ringswitchCore(ct, contexts_to[k], keyTags_to[k], twiddles, next);
+            }
+            level = std::move(next);
+        }
+        for (auto& ct : level) result.push_back(std::move(ct));
     }
 
     return result;
 }
+
+PDQParams allTraceTowers(const PDQParams& P) {
+    PDQParams all = P;  // shares P's twiddle cache, which is keyed by tower count
+    all.towers_bsgs = 0;
+    return all;
+}
+
+void ringswitchValues(
+    const PDQParams& P,
+    EncryptedDB& db,
+    const CryptoContext<DCRTPoly>& context_trace,
+    const std::string& keyTag,
+    const EvalKey<DCRTPoly>& switch_key,
+    const RingSwitchChain& chain) {
+
+    db.values_trace = ringswitch(allTraceTowers(P), context_trace, keyTag, switch_key, db.values, nullptr, chain);
+}
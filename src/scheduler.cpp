@@ -0,0 +1,88 @@
+#include "scheduler.h"
+
+namespace {
+
+// Pool and worker index of the calling thread (current_pool is null outside any pool)
+thread_local const void* current_pool = nullptr;
+thread_local size_t current_worker = 0;
+
+}  // namespace
+
+WorkStealingPool::WorkStealingPool(size_t num_threads) {
+    if (num_threads == 0) num_threads = 1;
+    for (size_t i = 0; i < num_threads; i++) queues.push_back(std::make_unique<TaskQueue>());
+    for (size_t i = 0; i < num_threads; i++) threads.emplace_back(&WorkStealingPool::run, this, i);
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& t : threads) t.join();
+}
+
+void WorkStealingPool::submit(std::function<void()> task) {
+    auto& target = current_pool == this
+        ? shared
+        : *queues[next_queue.fetch_add(1, std::memory_order_relaxed) % queues.size()];
+    {
+        std::lock_guard<std::mutex> lock(target.mutex);
+        target.tasks.push_back(std::move(task));
+    }
+    {
+        // Taking wake_mutex orders the increment with a worker's check-then-wait
+        std::lock_guard<std::mutex> lock(wake_mutex);
+        num_pending.fetch_add(1, std::memory_order_relaxed);
+    }
+    wake.notify_one();
+}
+
+bool WorkStealingPool::tryPop(size_t self, std::function<void()>& task) {
+    {
+        auto& own = *queues[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(shared.mutex);
+        if (!shared.tasks.empty()) {
+            task = std::move(shared.tasks.front());
+            shared.tasks.pop_front();
+            return true;
+        }
+    }
+    for (size_t k = 1; k < queues.size(); k++) {
+        auto& victim = *queues[(self + k) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingPool::run(size_t self) {
+    current_pool = this;
+    current_worker = self;
+
+    std::function<void()> task;
+    while (true) {
+        if (tryPop(self, task)) {
+            num_pending.fetch_sub(1, std::memory_order_relaxed);
+            task();
+            task = nullptr;
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(wake_mutex);
+        wake.wait(lock, [&] { return stopping || num_pending.load(std::memory_order_relaxed) > 0; });
+        if (stopping && num_pending.load(std::memory_order_relaxed) == 0) return;
+    }
+}
@@ -0,0 +1,182 @@
+#include "selfcheck.h"
+#include "kernels.h"
+#include "modp.h"
+#include "scheduler.h"
+#include <algorithm>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace {
+
+uint64_t mulMod(uint64_t a, uint64_t b, uint64_t q) {
+    return static_cast<uint64_t>(static_cast<unsigned __int128>(a) * b % q);
+}
+
+uint64_t powMod(uint64_t x, uint64_t e, uint64_t q) {
+    uint64_t r = 1;
+    for (; e; e >>= 1, x = mulMod(x, x, q))
+        if (e & 1) r = mulMod(r, x, q);
+    return r;
+}
+
+// Miller-Rabin with the first 12 prime bases, exact below 2^64
+bool isPrime(uint64_t n) {
+    if (n < 2) return false;
+    uint64_t d = n - 1;
+    int r = 0;
+    while ((d & 1) == 0) { d >>= 1; r++; }
+    for (uint64_t a : {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37}) {
+        if (n % a == 0) return n == a;
+        uint64_t x = powMod(a, d, n);
+        if (x == 1 || x == n - 1) continue;
+        bool composite = true;
+        for (int i = 1; i < r && composite; i++) {
+            x = mulMod(x, x, n);
+            if (x == n - 1) composite = false;
+        }
+        if (composite) return false;
+    }
+    return true;
+}
+
+// Largest prime q < 2^bits with q = 1 mod 2^17 (NTT-friendly up to n = 2^16)
+uint64_t nttPrimeBelow(int bits) {
+    const uint64_t step = uint64_t(1) << 17;
+    uint64_t q = ((uint64_t(1) << bits) - 1) / step * step + 1;
+    while (!isPrime(q)) q -= step;
+    return q;
+}
+
+}  // namespace
+
+bool checkSchedulerInterleaving() {
+    constexpr int tasks_per_chain = 16;
+
+    std::mutex mutex;
+    std::vector<int> order;   // chain of every task, in execution order
+    std::promise<void> done;
+    int finished = 0;
+
+    {
+        // Declared before the pool, so the pool joins before it is destroyed
+        std::function<void(int, int)> step;
+        WorkStealingPool pool(1);
+
+        // Hold the only worker until both chains are queued
+        std::promise<void> release;
+        auto gate = release.get_future().share();
+        pool.submit([gate] { gate.wait(); });
+
+        step = [&](int chain, int left) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                order.push_back(chain);
+                if (left == 1 && ++finished == 2) done.set_value();
+            }
+            if (left > 1) pool.submit([&step, chain, left] { step(chain, left - 1); });
+        };
+        pool.submit([&step] { step(0, tasks_per_chain); });
+        pool.submit([&step] { step(1, tasks_per_chain); });
+
+        release.set_value();
+        done.get_future().wait();
+    }
+
+    // While both chains have tasks left, no chain runs twice in a row
+    int left[2] = {tasks_per_chain, tasks_per_chain};
+    for (size_t i = 0; i < order.size(); i++) {
+        if (i > 0 && order[i] == order[i - 1] && left[0] > 0 && left[1] > 0) {
+            std::cout << "scheduler: chain " << order[i] << " ran twice in a row at task " << i << std::endl;
+            return false;
+        }
+        left[order[i]]--;
+    }
+    std::cout << "scheduler: " << order.size() << " tasks of 2 chains interleaved" << std::endl;
+    return true;
+}
+
+bool checkMulAddKernels(const std::vector<uint64_t>& moduli) {
+    std::vector<uint64_t> all = moduli;
+    for (int bits : {30, 50, 60, 61, 62}) all.push_back(nttPrimeBelow(bits));
+
+    constexpr size_t n = 1027;   // odd, so the vector kernels run their scalar tails
+    std::mt19937_64 rng(1);
+    const auto kernels = mulAddKernels();
+    for (uint64_t q : all) {
+        // All combinations of edge operands first, then random ones
+        const uint64_t edges[] = {0, 1, 2, q / 2, q - 2, q - 1};
+        std::vector<uint64_t> a(n), b(n), acc(n);
+        size_t k = 0;
+        for (uint64_t x : edges)
+            for (uint64_t y : edges)
+                for (uint64_t z : edges) {
+                    a[k] = x; b[k] = y; acc[k] = z;
+                    k++;
+                }
+        for (; k < n; k++) {
+            // Alternate uniform operands and ones just below q
+            bool high = k % 2;
+            a[k] = high ? q - 1 - rng() % 1024 : rng() % q;
+            b[k] = high ? q - 1 - rng() % 1024 : rng() % q;
+            acc[k] = rng() % q;
+        }
+
+        std::vector<uint64_t> expected(n);
+        for (k = 0; k < n; k++)
+            expected[k] = static_cast<uint64_t>((static_cast<unsigned __int128>(a[k]) * b[k] + acc[k]) % q);
+
+        for (const char* name : kernels) {
+            std::vector<uint64_t> result = acc;
+            mulAddModWith(name, result.data(), a.data(), b.data(), n, q);
+            for (k = 0; k < n; k++) {
+                if (result[k] != expected[k]) {
+                    std::cout << "mulAdd: " << name << " wrong for q = " << q << ": " << a[k] << " * " << b[k]
+                              << " + " << acc[k] << " gave " << result[k] << ", expected " << expected[k] << std::endl;
+                    return false;
+                }
+            }
+        }
+    }
+
+    std::cout << "mulAdd:";
+    for (const char* name : kernels) std::cout << " " << name;
+    std::cout << " exact on " << n * all.size() << " products over " << all.size() << " moduli" << std::endl;
+    return true;
+}
+
+bool checkConstModReduce() {
+    constexpr uint64_t limit = uint64_t(1) << 34;
+    const ConstMod<65537> mod;
+
+    // First mismatch of each thread's range (limit if none)
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<uint64_t> mismatch(threads, limit);
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; t++) {
+        workers.emplace_back([&, t] {
+            uint64_t begin = limit / threads * t;
+            uint64_t end = t + 1 == threads ? limit : limit / threads * (t + 1);
+            for (uint64_t x = begin; x < end; x++) {
+                if (mod.reduce(x) != x % 65537) {
+                    mismatch[t] = x;
+                    return;
+                }
+            }
+        });
+    }
+    for (auto& worker : workers) worker.join();
+
+    uint64_t x = *std::min_element(mismatch.begin(), mismatch.end());
+    if (x < limit) {
+        std::cout << "modp: ConstMod<65537>::reduce(" << x << ") = " << mod.reduce(x)
+                  << ", expected " << x % 65537 << std::endl;
+        return false;
+    }
+    std::cout << "modp: ConstMod<65537>::reduce exact for all x < 2^34" << std::endl;
+    return true;
+}
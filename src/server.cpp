@@ -0,0 +1,320 @@
+#include "server.h"
+#include "match.h"
+#include "stream.h"
+#include <algorithm>
+#include <future>
+#include <stdexcept>
+#include <thread>
+
+using namespace lbcrypto;
+
+namespace {
+
+double percentile(std::vector<double> samples, double q) {
+    if (samples.empty()) return 0.0;
+    size_t k = std::min(samples.size() - 1, static_cast<size_t>(q * samples.size()));
+    std::nth_element(samples.begin(), samples.begin() + k, samples.end());
+    return samples[k];
+}
+
+void pushWindow(std::deque<double>& window, double v, size_t limit) {
+    window.push_back(v);
+    if (window.size() > limit) window.pop_front();
+}
+
+}  // namespace
+
+struct QueryServer::Query {
+    EncryptedKey ctxt_query;
+    QueryKind kind;
+    std::function<void(QueryResult)> done;
+    Clock::time_point t_submit, t_admit;
+    size_t parallel = 1;          // tasks of this query in flight at most
+    size_t reservation = 0;       // bytes reserved at admission
+
+    std::atomic<size_t> next_ctxt{0};
+    std::atomic<size_t> remaining{0};
+    std::atomic<bool> error{false};
+
+    std::mutex mutex;             // guards the fields below
+    BSGSAccumulator acc_e, acc_w;     // Retrieve
+    AggregateAccumulator acc_agg;     // Count, Sum
+    std::string message;
+};
+
+QueryServer::QueryServer(
+    const PDQParams& params,
+    const CryptoContext<DCRTPoly>& context_trace,
+    const std::string& keyTag_trace,
+    const EvalKey<DCRTPoly>& switch_key,
+    const EvalKey<DCRTPoly>& relin_switch_key,
+    const RingSwitchChain& chain,
+    const EncryptedDB& db,
+    const ServerConfig& config)
+    : params(params), context_trace(context_trace), keyTag_trace(keyTag_trace), switch_key(switch_key),
+      relin_switch_key(relin_switch_key), chain(chain), db(db), config(config),
+      pool(config.threads ? config.threads : std::max(1u, std::thread::hardware_concurrency())) {
+
+    // Footprint model, in ciphertexts of either ring (2 polynomials each)
+    const PDQParams& P = params;
+    size_t main_bytes = 2 * P.degree * db.values[0]->GetElements()[0].GetNumOfElements() * sizeof(uint64_t);
+    size_t trace_bytes = 2 * P.degree_trace * bsgsTowers(P, context_trace) * sizeof(uint64_t);
+
+    // Query ciphertexts (one per key limb) and the two shared giant-step accumulators
+    retrieve_footprint.base_bytes = P.key_limbs * main_bytes + 2 * P.g_bsgs * trace_bytes;
+    // Match/mask temporaries, the ring-switched outputs, the baby-step rotations,
+    // one column of plaintexts and the task-local accumulators
+    retrieve_footprint.task_bytes = (3 + P.key_limbs) * main_bytes
+                                  + (2 * P.dim_trace + P.b_bsgs + 2 * P.g_bsgs) * trace_bytes
+                                  + P.g_bsgs * P.b_bsgs * trace_bytes / 2;
+    // Trace-ring masking holds the indicators and their products at all trace
+    // towers until the multiply (3 polynomials before relinearization)
+    if (!db.values_trace.empty()) {
+        size_t full_towers = db.values_trace[0]->GetElements()[0].GetNumOfElements();
+        retrieve_footprint.task_bytes += 5 * P.dim_trace * P.degree_trace * full_towers * sizeof(uint64_t);
+    }
+
+    // Aggregates: the query, the (unrelinearized) main-ring sum and the one
+    // ring switch of it; tasks only match and mask
+    aggregate_footprint.base_bytes = (P.key_limbs + 2) * main_bytes + P.dim_trace * trace_bytes;
+    aggregate_footprint.task_bytes = (3 + P.key_limbs) * main_bytes;
+
+    // The packed-encoding tables are built lazily and not safe to build
+    // concurrently; build them before any query runs
+    (void)encodeEval(context_trace, std::vector<int64_t>(P.degree_trace, 0), bsgsTowers(P, context_trace));
+}
+
+QueryServer::~QueryServer() {
+    std::deque<std::shared_ptr<Query>> dropped;
+    {
+        std::lock_guard<std::mutex> lock(state_mutex);
+        shutting_down = true;
+        dropped.swap(waiting);
+        rejected += dropped.size();
+    }
+    for (auto& query : dropped) query->done({QueryStatus::Rejected, nullptr, "server shutting down"});
+}
+
+void QueryServer::submit(const EncryptedKey& ctxt_query, QueryKind kind, std::function<void(QueryResult)> done) {
+    if (ctxt_query.size() != static_cast<size_t>(params.key_limbs)) {
+        {
+            std::lock_guard<std::mutex> lock(state_mutex);
+            failed++;
+        }
+        done({QueryStatus::Failed, nullptr, "query has " + std::to_string(ctxt_query.size()) +
+              " key limbs, expected " + std::to_string(params.key_limbs)});
+        return;
+    }
+
+    if (kind != QueryKind::Retrieve && !params.aggregates) {
+        {
+            std::lock_guard<std::mutex> lock(state_mutex);
+            failed++;
+        }
+        done({QueryStatus::Failed, nullptr, "database was set up without aggregate keys"});
+        return;
+    }
+
+    auto query = std::make_shared<Query>();
+    query->ctxt_query = ctxt_query;
+    query->kind = kind;
+    query->done = std::move(done);
+    query->t_submit = Clock::now();
+    query->remaining = db.keys.size();
+
+    const auto& footprint = kind == QueryKind::Retrieve ? retrieve_footprint : aggregate_footprint;
+    size_t limit = config.query_memory_mb << 20;
+    size_t parallel = limit > footprint.base_bytes ? (limit - footprint.base_bytes) / footprint.task_bytes : 0;
+    query->parallel = std::min(parallel, db.keys.size());
+    query->reservation = footprint.base_bytes + query->parallel * footprint.task_bytes;
+
+    std::string reject;
+    {
+        std::lock_guard<std::mutex> lock(state_mutex);
+        if (shutting_down) {
+            reject = "server shutting down";
+        } else if (query->parallel == 0 || query->reservation > (config.memory_budget_mb << 20)) {
+            reject = "query does not fit the memory limits";
+        } else if (waiting.empty() && reserved_bytes + query->reservation <= (config.memory_budget_mb << 20)) {
+            reserved_bytes += query->reservation;
+            running++;
+        } else if (waiting.size() < config.max_queued) {
+            waiting.push_back(query);
+            return;
+        } else {
+            reject = "admission queue full";
+        }
+        if (!reject.empty()) rejected++;
+    }
+
+    if (!reject.empty()) {
+        query->done({QueryStatus::Rejected, nullptr, reject});
+        return;
+    }
+    start(query);
+}
+
+QueryResult QueryServer::run(const EncryptedKey& ctxt_query, QueryKind kind) {
+    std::promise<QueryResult> promise;
+    auto future = promise.get_future();
+    submit(ctxt_query, kind, [&promise](QueryResult result) { promise.set_value(std::move(result)); });
+    return future.get();
+}
+
+void QueryServer::start(const std::shared_ptr<Query>& query) {
+    query->t_admit = Clock::now();
+    for (size_t k = 0; k < query->parallel; k++)
+        pool.submit([this, query] { runTask(query); });
+}
+
+// Process one main ciphertext, then requeue behind other queries' tasks so
+// that concurrent queries interleave instead of running back to back
+void QueryServer::runTask(const std::shared_ptr<Query>& query) {
+    size_t num = db.keys.size();
+    size_t c = query->next_ctxt.fetch_add(1);
+    if (c >= num) return;
+
+    if (!query->error.load()) {
+        try {
+            if (query->kind == QueryKind::Retrieve) {
+                BSGSAccumulator acc_e, acc_w;
+                if (!db.values_trace.empty()) {
+                    streamTraceCiphertext(params, db, c, matchKey(db.keys[c], query->ctxt_query), context_trace,
+                                          keyTag_trace, switch_key, chain, acc_e, acc_w);
+                } else {
+                    auto mm = matchMask(db.keys[c], db.values[c], query->ctxt_query);
+                    streamCiphertext(params, db.records[c], mm, context_trace, keyTag_trace,
+                                     switch_key, relin_switch_key, chain, acc_e, acc_w);
+                }
+
+                std::lock_guard<std::mutex> lock(query->mutex);
+                mergeBSGS(query->acc_e, acc_e);
+                mergeBSGS(query->acc_w, acc_w);
+            } else {
+                // Ring-switched once for the whole query, in finish()
+                auto term = aggregateTerm(query->kind, db.keys[c], db.values[c], query->ctxt_query);
+
+                std::lock_guard<std::mutex> lock(query->mutex);
+                accumulateAggregate(query->acc_agg, term);
+            }
+        } catch (const std::exception& e) {
+            std::lock_guard<std::mutex> lock(query->mutex);
+            if (!query->error.exchange(true)) query->message = e.what();
+        }
+    }
+
+    if (query->remaining.fetch_sub(1) == 1) {
+        finish(query);
+    } else if (query->next_ctxt.load() < num) {
+        pool.submit([this, query] { runTask(query); });
+    }
+}
+
+void QueryServer::finish(const std::shared_ptr<Query>& query) {
+    QueryResult result{QueryStatus::OK, nullptr, ""};
+    if (!query->error.load()) {
+        try {
+            if (query->kind == QueryKind::Retrieve)
+                result.digest = combineDigests(params, finishBSGS(params, query->acc_e), finishBSGS(params, query->acc_w));
+            else
+                result.digest = finishAggregate(params, query->acc_agg, context_trace, keyTag_trace,
+                                                switch_key, relin_switch_key, chain);
+        } catch (const std::exception& e) {
+            query->error = true;
+            query->message = e.what();
+        }
+    }
+    if (query->error.load()) result = {QueryStatus::Failed, nullptr, query->message};
+    query->acc_e = {};
+    query->acc_w = {};
+    query->acc_agg = {};
+
+    auto t_done = Clock::now();
+    std::vector<std::shared_ptr<Query>> admitted;
+    {
+        std::lock_guard<std::mutex> lock(state_mutex);
+        running--;
+        reserved_bytes -= query->reservation;
+        (result.status == QueryStatus::OK ? completed : failed)++;
+        pushWindow(latencies_ms,
+            std::chrono::duration<double, std::milli>(t_done - query->t_submit).count(), config.latency_window);
+        pushWindow(waits_ms,
+            std::chrono::duration<double, std::milli>(query->t_admit - query->t_submit).count(), config.latency_window);
+
+        // FIFO admission: a large query at the head is not overtaken
+        while (!shutting_down && !waiting.empty() &&
+               reserved_bytes + waiting.front()->reservation <= (config.memory_budget_mb << 20)) {
+            reserved_bytes += waiting.front()->reservation;
+            running++;
+            admitted.push_back(std::move(waiting.front()));
+            waiting.pop_front();
+        }
+    }
+
+    query->done(std::move(result));
+    for (auto& next : admitted) start(next);
+}
+
+ServerMetrics QueryServer::metrics() const {
+    std::lock_guard<std::mutex> lock(state_mutex);
+    std::vector<double> lat(latencies_ms.begin(), latencies_ms.end());
+    std::vector<double> wait(waits_ms.begin(), waits_ms.end());
+
+    ServerMetrics m;
+    m.queued = waiting.size();
+    m.running = running;
+    m.pending_tasks = pool.pending();
+    m.reserved_mb = reserved_bytes >> 20;
+    m.completed = completed;
+    m.rejected = rejected;
+    m.failed = failed;
+    m.latency_p50_ms = percentile(lat, 0.50);
+    m.latency_p95_ms = percentile(lat, 0.95);
+    m.latency_p99_ms = percentile(lat, 0.99);
+    m.latency_max_ms = lat.empty() ? 0.0 : *std::max_element(lat.begin(), lat.end());
+    m.wait_p50_ms = percentile(wait, 0.50);
+    m.wait_p99_ms = percentile(wait, 0.99);
+    return m;
+}
+
+std::string QueryServer::statsJSON() const {
+    std::ostringstream os;
+    writeServerMetricsJSON(os, metrics());
+    return os.str();
+}
+
+void DatabaseRouter::add(const std::string& keyTag, QueryBackend& backend) {
+    if (!backends.emplace(keyTag, &backend).second)
+        throw std::invalid_argument("database with key tag " + keyTag + " added twice");
+}
+
+QueryResult DatabaseRouter::run(const EncryptedKey& ctxt_query, QueryKind kind) {
+    auto it = ctxt_query.empty() ? backends.end() : backends.find(ctxt_query[0]->GetKeyTag());
+    if (it == backends.end()) return {QueryStatus::Failed, nullptr, "query key matches no database"};
+    return it->second->run(ctxt_query, kind);
+}
+
+std::string DatabaseRouter::statsJSON() const {
+    std::ostringstream os;
+    os << "{\"databases\": {";
+    bool first = true;
+    for (const auto& [keyTag, backend] : backends) {
+        os << (first ? "" : ", ") << "\"" << keyTag << "\": " << backend->statsJSON();
+        first = false;
+    }
+    os << "}}";
+    return os.str();
+}
+
+void writeServerMetricsJSON(std::ostream& os, const ServerMetrics& m) {
+    os << "{\"queued\": " << m.queued
+       << ", \"running\": " << m.running
+       << ", \"pending_tasks\": " << m.pending_tasks
+       << ", \"reserved_mb\": " << m.reserved_mb
+       << ", \"completed\": " << m.completed
+       << ", \"rejected\": " << m.rejected
+       << ", \"failed\": " << m.failed
+       << ", \"latency_ms\": {\"p50\": " << m.latency_p50_ms << ", \"p95\": " << m.latency_p95_ms
+       << ", \"p99\": " << m.latency_p99_ms << ", \"max\": " << m.latency_max_ms << "}"
+       << ", \"wait_ms\": {\"p50\": " << m.wait_p50_ms << ", \"p99\": " << m.wait_p99_ms << "}}";
+}
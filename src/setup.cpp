@@ -1,17 +1,22 @@
 #include "setup.h"
 #include "global.h"
+#include "instrument.h"
+#include "kernels.h"
+#include "modp.h"
+#include "noise.h"
 #include "encoding/encodingparams.h"
 #include <random>
 #include <algorithm>
 #include <cmath>
+#include <stdexcept>
 
 using namespace lbcrypto;
 
 // =============================================================================
-// Global initialization
+// Parameters
 // =============================================================================
 
-void updateGlobal() {
+void PDQParams::derive() {
     degree_half = degree / 2;
     degree_trace_half = degree_trace / 2;
     dim_trace = degree / degree_trace;
@@ -19,34 +24,68 @@ void updateGlobal() {
     numrow_po2 = 1;
     while (numrow_po2 < num_matching) numrow_po2 *= 2;
 
+    // Replicated layout: R copies of the DB in one main ciphertext, so a query
+    // ciphertext can carry R keys. Each copy gets its own window of numrow_po2
+    // digest rows, and the windows of e and w must fit in a trace row.
+    block_size = degree / replicas;
+    digest_rows = replicas * numrow_po2;
+    if (replicas > 1 && (replicas & (replicas - 1)) != 0)
+        throw std::invalid_argument("replicas must be a power of 2");
+    if (replicas > 1 && num_records > block_size)
+        throw std::invalid_argument("replicas: " + std::to_string(replicas) + " copies of " +
+                                    std::to_string(num_records) + " records exceed " + std::to_string(degree) + " slots");
+    if (2 * digest_rows > degree_trace_half)
+        throw std::invalid_argument("replicas: digest windows exceed the trace slots");
+    if (ringswitch_ratio > 1 && (ringswitch_ratio & (ringswitch_ratio - 1)) != 0)
+        throw std::invalid_argument("ringswitch_ratio must be a power of 2");
+
     // BSGS split: minimize total rotations = numctxt*(b-1) + (g-1)
-    // Baby rotations are per-ciphertext, so optimal b = sqrt(numrow_po2 / numctxt)
+    // Baby rotations are per-ciphertext, so optimal b = sqrt(digest_rows / numctxt)
     int numctxt_total = num_ctxts * dim_trace;
     b_bsgs = std::max(1, static_cast<int>(std::round(
-        std::sqrt(static_cast<double>(numrow_po2) / numctxt_total))));
-    g_bsgs = static_cast<int>(std::ceil(static_cast<double>(numrow_po2) / b_bsgs));
+        std::sqrt(static_cast<double>(digest_rows) / numctxt_total))));
+    g_bsgs = static_cast<int>(std::ceil(static_cast<double>(digest_rows) / b_bsgs));
+
+    // Limbs are stored as limb + 1 in [1, 2^limb_bits], so 2^limb_bits < p
+    limb_bits = 0;
+    while ((int64_t(2) << limb_bits) < ptxt_modulus) limb_bits++;
+    limb_depth = 0;
+    while ((1 << limb_depth) < key_limbs) limb_depth++;
+    in_depth = 0;
+    while ((1 << in_depth) < in_keys) in_depth++;
+
+    // Low-cardinality test data needs a key besides the query keys, and every
+    // key must fit the key limbs
+    if (distinct_keys != 0 &&
+        (distinct_keys <= in_keys || uint64_t(distinct_keys - 1) > keyMax(*this)))
+        throw std::invalid_argument("distinct_keys must exceed in_keys and fit the key width");
+
+    // Anything cached so far was computed from the previous values
+    caches = std::make_shared<PDQCaches>();
 }
 
 // =============================================================================
 // Context setup
 // =============================================================================
 
-void initBFVParams(CCParams<CryptoContextBFVRNS>& params) {
-    params.SetPlaintextModulus(ptxt_modulus);
-    params.SetRingDim(degree);
-    params.SetMultiplicativeDepth(MultiplicativeDepth);
-    params.SetScalingModSize(ScalingModSize);
-    params.SetNumLargeDigits(NumLargeDigits);
+void initBFVParams(const PDQParams& P, CCParams<CryptoContextBFVRNS>& params) {
+    params.SetPlaintextModulus(P.ptxt_modulus);
+    params.SetRingDim(P.degree);
+    // MultiplicativeDepth covers single-limb, single-key queries; the limb and
+    // IN-list candidate product trees add limb_depth and in_depth
+    params.SetMultiplicativeDepth(P.MultiplicativeDepth + P.limb_depth + P.in_depth);
+    params.SetScalingModSize(P.ScalingModSize);
+    params.SetNumLargeDigits(P.NumLargeDigits);
     params.SetKeySwitchTechnique(HYBRID);
     params.SetSecurityLevel(HEStd_128_classic);
 }
 
-void initBFVParams_trace(CCParams<CryptoContextBFVRNS>& params) {
-    params.SetPlaintextModulus(ptxt_modulus);
-    params.SetRingDim(degree_trace);
-    params.SetMultiplicativeDepth(MultiplicativeDepth_trace);
-    params.SetScalingModSize(ScalingModSize);
-    params.SetNumLargeDigits(NumLargeDigits_trace);
+void initBFVParams_trace(const PDQParams& P, CCParams<CryptoContextBFVRNS>& params, int ring_dim) {
+    params.SetPlaintextModulus(P.ptxt_modulus);
+    params.SetRingDim(ring_dim ? ring_dim : P.degree_trace);
+    params.SetMultiplicativeDepth(P.MultiplicativeDepth_trace);
+    params.SetScalingModSize(P.ScalingModSize);
+    params.SetNumLargeDigits(P.NumLargeDigits_trace);
     params.SetKeySwitchTechnique(HYBRID);
     params.SetSecurityLevel(HEStd_128_classic);
 }
@@ -55,51 +94,181 @@ void enableFeatures(CryptoContext<DCRTPoly>& context) {
     context->Enable(PKE);
     context->Enable(KEYSWITCH);
     context->Enable(LEVELEDSHE);
+    // Seeded rotation keys are generated through the multiparty API
+    context->Enable(MULTIPARTY);
 }
 
-std::vector<int32_t> computeRotationIndices() {
+std::vector<int32_t> computeRotationIndices(const PDQParams& P) {
     std::vector<int32_t> rots;
 
     // Baby step: only rotation by 1 is used (applied iteratively)
     rots.push_back(1);
 
     // Giant step: only rotation by b_bsgs is used (applied iteratively)
-    if (b_bsgs > 1) {
-        rots.push_back(b_bsgs);
+    if (P.b_bsgs > 1) {
+        rots.push_back(P.b_bsgs);
     }
 
     // Power-of-2 aggregation rotations
-    for (int j = 1; j < degree_trace_half / numrow_po2; j *= 2) {
-        rots.push_back(numrow_po2 * j);
+    for (int j = 1; j < P.degree_trace_half / P.digest_rows; j *= 2) {
+        rots.push_back(P.digest_rows * j);
+    }
+
+    // Aggregate folding: every power-of-2 stride within a row, only if
+    // aggregates are served
+    if (P.aggregates) {
+        for (int j = 2; j < P.degree_trace_half; j *= 2) {
+            if (std::find(rots.begin(), rots.end(), j) == rots.end()) rots.push_back(j);
+        }
     }
 
     // Half rotation for combining both halves
-    rots.push_back(degree_trace_half);
+    rots.push_back(P.degree_trace_half);
 
     return rots;
 }
 
+std::vector<int> ringSwitchChain(const PDQParams& P) {
+    std::vector<int> rings{P.degree};
+    if (P.ringswitch_ratio > 1) {
+        while (rings.back() / P.ringswitch_ratio > P.degree_trace) rings.push_back(rings.back() / P.ringswitch_ratio);
+    }
+    if (P.degree_trace < P.degree) rings.push_back(P.degree_trace);
+
+    for (size_t k = 1; k < rings.size(); k++) {
+        if (rings[k - 1] % rings[k] != 0)
+            throw std::invalid_argument("ring-switch chain: each ring dimension must divide the previous one");
+    }
+    return rings;
+}
+
+// GenCryptoContext rejects a ring dimension too small for the security level
+// of the trace moduli. The trace context later takes the main context's first
+// towers instead, which have the same ScalingModSize.
+int smallestTraceRing(const PDQParams& P) {
+    for (int ring = 4 * P.digest_rows; ring < P.degree; ring *= 2) {
+        CCParams<CryptoContextBFVRNS> params;
+        initBFVParams_trace(P, params, ring);
+        try {
+            (void)GenCryptoContext(params);
+            return ring;
+        } catch (const std::exception&) {
+        }
+    }
+    throw std::invalid_argument("no trace ring below " + std::to_string(P.degree) +
+                                " fits the digest windows at 128-bit security");
+}
+
 // =============================================================================
-// Ring-switch setup
+// RNS tower helpers
 // =============================================================================
 
-void injectCompatibleRoot() {
-    uint32_t mMain = 2 * degree;
-    uint32_t mTrace = 2 * degree_trace;
-    NativeInteger p(ptxt_modulus);
+std::shared_ptr<ILDCRTParams<BigInteger>> truncateParams(
+    const std::shared_ptr<ILDCRTParams<BigInteger>>& params,
+    size_t towers) {
 
-    NativeInteger zetaMain = RootOfUnity<NativeInteger>(mMain, p);
-    NativeInteger zetaTrace = zetaMain.ModExp(dim_trace, p);
+    if (towers >= params->GetParams().size()) return params;
 
-    PackedEncoding::Destroy();
+    std::vector<NativeInteger> moduli(towers);
+    std::vector<NativeInteger> roots(towers);
+    for (size_t i = 0; i < towers; i++) {
+        moduli[i] = params->GetParams()[i]->GetModulus();
+        roots[i] = params->GetParams()[i]->GetRootOfUnity();
+    }
+    return std::make_shared<ILDCRTParams<BigInteger>>(params->GetCyclotomicOrder(), moduli, roots);
+}
 
-    auto mainParams = std::make_shared<EncodingParamsImpl>(ptxt_modulus);
-    mainParams->SetPlaintextRootOfUnity(zetaMain);
-    PackedEncoding::SetParams(mMain, mainParams);
+// ringswitch() compresses in the main ring n, and on the masked path the
+// ciphertext still has three components, so rounding leaves up to about n^2
+// (ternary secret, s^2 term), 2 log2 n + 1 bits. Every key switch adds about as
+// much again: the switch to n', one per intermediate ring of the chain. Each
+// BSGS product with a packed plaintext (n' coefficients below p) scales that
+// by up to n' * p, digest_rows products per trace ciphertext are summed, and
+// the combineDigests mask multiplies by n' * p once more. Decryption needs the
+// result below Q' / 2p. Main-ring noise carries over relative to Q, whatever
+// Q' is, so it bounds MultiplicativeDepth but not the towers. This bound is not
+// the default; ./test --noise prints it next to the measured minimum.
+int minBsgsTowers(const PDQParams& P) {
+    auto log2ceil = [](int64_t x) { int bits = 0; while ((int64_t(1) << bits) < x) bits++; return bits; };
+    int bits_N = log2ceil(P.degree);
+    int bits_n = log2ceil(P.degree_trace);
+    int bits_p = log2ceil(P.ptxt_modulus);
+    int key_switches = static_cast<int>(ringSwitchChain(P).size());
+    int bits_round = (2 * bits_N + 1) + log2ceil(key_switches + 1);
+    int bits_terms = log2ceil(int64_t(P.digest_rows) * P.num_ctxts * P.dim_trace);
+    int bits = (bits_p + 1) + bits_round + 2 * (bits_n + bits_p) + bits_terms + noise_margin_bits;
+    return (bits + P.ScalingModSize - 1) / P.ScalingModSize;
+}
 
-    auto traceParams = std::make_shared<EncodingParamsImpl>(ptxt_modulus);
-    traceParams->SetPlaintextRootOfUnity(zetaTrace);
-    PackedEncoding::SetParams(mTrace, traceParams);
+size_t bsgsTowers(const PDQParams& P, const CryptoContext<DCRTPoly>& context_trace) {
+    size_t towers = context_trace->GetCryptoParameters()->GetElementParams()->GetParams().size();
+    int keep = P.towers_bsgs < 0 ? minBsgsTowers(P) : P.towers_bsgs;
+    if (keep > 0 && static_cast<size_t>(keep) < towers) towers = keep;
+    return towers;
+}
+
+DCRTPoly encodeEval(
+    const CryptoContext<DCRTPoly>& context,
+    const std::vector<int64_t>& slots,
+    size_t towers) {
+
+    auto pt = context->MakePackedPlaintext(slots);
+    countOp(Op::Encode);
+
+    DCRTPoly poly = pt->GetElement<DCRTPoly>();
+    if (poly.GetNumOfElements() > towers)
+        poly.DropLastElements(poly.GetNumOfElements() - towers);
+    if (poly.GetFormat() != Format::EVALUATION) {
+        poly.SwitchFormat();
+        countOp(Op::PdqNTT, poly.GetNumOfElements());
+    }
+    return poly;
+}
+
+// Plaintext-ciphertext multiply on the raw polynomials. pt is in EVALUATION
+// form over the same towers as ct, which may be fewer than the context's.
+Ciphertext<DCRTPoly> multPlain(const Ciphertext<DCRTPoly>& ct, const DCRTPoly& pt) {
+    auto result = ct->Clone();
+    for (auto& c : result->GetElements()) c *= pt;
+    countOp(Op::EvalMultPlain);
+    return result;
+}
+
+void multAccPlain(Ciphertext<DCRTPoly>& acc, const Ciphertext<DCRTPoly>& ct, const DCRTPoly& pt) {
+    auto& acc_elems = acc->GetElements();
+    const auto& elems = ct->GetElements();
+    for (size_t i = 0; i < elems.size(); i++) mulAddInPlace(acc_elems[i], elems[i], pt);
+    countOp(Op::EvalMultPlain);
+}
+
+// =============================================================================
+// Ring-switch setup
+// =============================================================================
+
+// With x the smallest quadratic non-residue, x^((p-1)/m) has order exactly m
+uint64_t plainRootOfUnity(int64_t p, uint32_t m) {
+    if (m == 0 || (m & (m - 1)) != 0 || (p - 1) % m != 0)
+        throw std::invalid_argument("no primitive " + std::to_string(m) + "-th root of unity mod " + std::to_string(p));
+
+    RuntimeMod mod{static_cast<uint64_t>(p)};
+    uint64_t x = 2;
+    while (powMod(mod, x, (p - 1) / 2) != mod.p - 1) x++;
+    return powMod(mod, x, (p - 1) / m);
+}
+
+// Only the (p, m) entries of P's rings are set: entries of other databases
+// stay in place, and a database sharing (p, m) sets the same root again.
+void injectCompatibleRoot(const PDQParams& P) {
+    for (int ring : ringSwitchChain(P)) {
+        auto ringParams = std::make_shared<EncodingParamsImpl>(P.ptxt_modulus);
+        ringParams->SetPlaintextRootOfUnity(NativeInteger(plainRootOfUnity(P.ptxt_modulus, 2 * ring)));
+        PackedEncoding::SetParams(2 * ring, ringParams);
+    }
+}
+
+void setContextRoot(const PDQParams& P, const CryptoContext<DCRTPoly>& context) {
+    uint32_t ring = context->GetRingDimension();
+    context->GetEncodingParams()->SetPlaintextRootOfUnity(NativeInteger(plainRootOfUnity(P.ptxt_modulus, 2 * ring)));
 }
 
 CryptoContext<DCRTPoly> GenCryptoContextWithModuliFrom(
@@ -107,6 +276,8 @@ CryptoContext<DCRTPoly> GenCryptoContextWithModuliFrom(
     const CryptoContext<DCRTPoly>& sourceContext) {
 
     auto cc = GenCryptoContext(params);
+    uint32_t ring_dim = params.GetRingDim();
+    uint32_t source_ring_dim = sourceContext->GetRingDimension();
 
     auto sourceElemParams = sourceContext->GetCryptoParameters()->GetElementParams();
     auto targetElemParams = cc->GetCryptoParameters()->GetElementParams();
@@ -119,11 +290,11 @@ CryptoContext<DCRTPoly> GenCryptoContextWithModuliFrom(
     for (size_t i = 0; i < numTowers; i++) {
         moduli[i] = sourceElemParams->GetParams()[i]->GetModulus();
         auto sourceRoot = sourceElemParams->GetParams()[i]->GetRootOfUnity();
-        roots[i] = sourceRoot.ModExp(NativeInteger(dim_trace), moduli[i]);
+        roots[i] = sourceRoot.ModExp(NativeInteger(source_ring_dim / ring_dim), moduli[i]);
     }
 
     auto elementParams = std::make_shared<ILDCRTParams<BigInteger>>(
-        2 * degree_trace, moduli, roots);
+        2 * ring_dim, moduli, roots);
 
     auto cryptoParams = std::dynamic_pointer_cast<CryptoParametersBFVRNS>(
         std::const_pointer_cast<CryptoParametersBase<DCRTPoly>>(cc->GetCryptoParameters()));
@@ -140,6 +311,22 @@ CryptoContext<DCRTPoly> GenCryptoContextWithModuliFrom(
     return cc;
 }
 
+std::vector<CryptoContext<DCRTPoly>> genChainContexts(
+    const PDQParams& P,
+    const CryptoContext<DCRTPoly>& context) {
+
+    std::vector<CryptoContext<DCRTPoly>> contexts;
+    auto rings = ringSwitchChain(P);
+    for (size_t k = 1; k + 1 < rings.size(); k++) {
+        CCParams<CryptoContextBFVRNS> params_mid;
+        initBFVParams_trace(P, params_mid, rings[k]);
+        contexts.push_back(GenCryptoContextWithModuliFrom(params_mid, context));
+        enableFeatures(contexts.back());
+        setContextRoot(P, contexts.back());
+    }
+    return contexts;
+}
+
 void liftSecretKey(KeyPair<DCRTPoly>& keyPair_main,
                    const KeyPair<DCRTPoly>& keyPair_trace) {
     auto sk_main = keyPair_main.secretKey->GetPrivateElement();
@@ -148,6 +335,11 @@ void liftSecretKey(KeyPair<DCRTPoly>& keyPair_main,
     sk_main.SwitchFormat();
     sk_trace.SwitchFormat();
 
+    // Any pair of rings of the ring-switch chain
+    uint32_t ring_main = sk_main.GetRingDimension();
+    uint32_t ring_trace = sk_trace.GetRingDimension();
+    uint32_t ratio = ring_main / ring_trace;
+
     // Use first limb of trace key (ternary values are same across all limbs)
     auto limb_trace = sk_trace.GetElementAtIndex(0);
 
@@ -155,11 +347,11 @@ void liftSecretKey(KeyPair<DCRTPoly>& keyPair_main,
         auto limb_main = sk_main.GetElementAtIndex(i);
         auto mod = limb_main.GetModulus();
 
-        for (int j = 0; j < degree; j++) limb_main[j] = 0;
-        for (int j = 0; j < degree_trace; j++) {
+        for (uint32_t j = 0; j < ring_main; j++) limb_main[j] = 0;
+        for (uint32_t j = 0; j < ring_trace; j++) {
             auto val = limb_trace[j];
-            if (val == 1) limb_main[j * dim_trace] = 1;
-            else if (val != 0) limb_main[j * dim_trace] = mod - 1;
+            if (val == 1) limb_main[j * ratio] = 1;
+            else if (val != 0) limb_main[j * ratio] = mod - 1;
         }
         sk_main.SetElementAtIndex(i, limb_main);
     }
@@ -168,30 +360,161 @@ void liftSecretKey(KeyPair<DCRTPoly>& keyPair_main,
     keyPair_main.secretKey->SetPrivateElement(sk_main);
 }
 
+// =============================================================================
+// Full setup
+// =============================================================================
+
+PDQSetup setupPDQ(const PDQParams& P, const KeySeed& key_seed) {
+    if (!P.caches) throw std::invalid_argument("setupPDQ: parameters not derived (PDQParams::derive)");
+
+    PDQSetup setup;
+    setup.key_seed = key_seed;
+
+    injectCompatibleRoot(P);
+
+    // Create main context
+    CCParams<CryptoContextBFVRNS> params;
+    initBFVParams(P, params);
+    setup.context = GenCryptoContext(params);
+    enableFeatures(setup.context);
+    setContextRoot(P, setup.context);
+
+    // Generate main keys
+    setup.keypair = setup.context->KeyGen();
+    seededEvalMultKeyGen(setup.keypair.secretKey, key_seed);
+
+    // Create trace context with matching moduli from main context
+    CCParams<CryptoContextBFVRNS> params_trace;
+    initBFVParams_trace(P, params_trace);
+    setup.context_trace = GenCryptoContextWithModuliFrom(params_trace, setup.context);
+    enableFeatures(setup.context_trace);
+    setContextRoot(P, setup.context_trace);
+
+    // TODO: Investigate why this is needed. Without this dummy MakePackedPlaintext
+    // call on the main context, packed encoding fails silently after ring-switch.
+    (void)setup.context->MakePackedPlaintext(std::vector<int64_t>(P.degree, 0));
+
+    // Generate trace keys
+    setup.keypair_trace = setup.context_trace->KeyGen();
+    seededEvalMultKeyGen(setup.keypair_trace.secretKey, key_seed, 1);
+    auto rotIndices = computeRotationIndices(P);
+    if (!rotIndices.empty()) {
+        seededEvalRotateKeyGen(setup.keypair_trace.secretKey, rotIndices, key_seed);
+    }
+
+    // Intermediate rings of a multi-level ring switch, each with its own key
+    setup.chain.contexts = genChainContexts(P, setup.context);
+    std::vector<KeyPair<DCRTPoly>> keypairs_mid;
+    for (auto& context_mid : setup.chain.contexts) {
+        keypairs_mid.push_back(context_mid->KeyGen());
+        setup.chain.keyTags.push_back(keypairs_mid.back().secretKey->GetKeyTag());
+    }
+
+    // Generate switch target keypair in MAIN context and lift it
+    const auto& keypair_next = keypairs_mid.empty() ? setup.keypair_trace : keypairs_mid[0];
+    auto keypair_switch_target = setup.context->KeyGen();
+    liftSecretKey(keypair_switch_target, keypair_next);
+
+    // Create switch key: main key -> lifted key (both in main context)
+    setup.switch_key = seededKeySwitchGen(
+        setup.keypair.secretKey, keypair_switch_target.secretKey, key_seed);
+    setup.relin_switch_key = seededRelinSwitchKeyGen(
+        setup.keypair.secretKey, keypair_switch_target.secretKey, key_seed);
+
+    // Each intermediate ring switches to the lifted key of the next one
+    for (size_t k = 0; k < keypairs_mid.size(); k++) {
+        const auto& next = k + 1 < keypairs_mid.size() ? keypairs_mid[k + 1] : setup.keypair_trace;
+        auto target = setup.chain.contexts[k]->KeyGen();
+        liftSecretKey(target, next);
+        setup.chain.switch_keys.push_back(seededKeySwitchGen(
+            keypairs_mid[k].secretKey, target.secretKey, key_seed, k + 1));
+    }
+
+    return setup;
+}
+
 // =============================================================================
 // Test data
 // =============================================================================
 
-TestData generateTestData(int seed) {
+uint64_t keyMax(const PDQParams& P) {
+    int bits = std::min(64, P.key_limbs * P.limb_bits);
+    return bits == 64 ? ~uint64_t(0) : (uint64_t(1) << bits) - 1;
+}
+
+int64_t keyLimb(const PDQParams& P, uint64_t key, int l) {
+    int shift = l * P.limb_bits;
+    uint64_t limb = shift < 64 ? (key >> shift) & ((uint64_t(1) << P.limb_bits) - 1) : 0;
+    return static_cast<int64_t>(limb) + 1;
+}
+
+EncryptedKey encryptKey(
+    const PDQParams& P,
+    const CryptoContext<DCRTPoly>& context,
+    const PublicKey<DCRTPoly>& publicKey,
+    uint64_t key) {
+
+    EncryptedKey result;
+    for (int l = 0; l < P.key_limbs; l++)
+        result.push_back(context->Encrypt(publicKey,
+            context->MakePackedPlaintext(std::vector<int64_t>(P.degree, keyLimb(P, key, l)))));
+    return result;
+}
+
+EncryptedKey encryptKeys(
+    const PDQParams& P,
+    const CryptoContext<DCRTPoly>& context,
+    const PublicKey<DCRTPoly>& publicKey,
+    const std::vector<uint64_t>& keys) {
+
+    if (keys.size() > static_cast<size_t>(P.replicas))
+        throw std::invalid_argument("encryptKeys: " + std::to_string(keys.size()) + " keys for " +
+                                    std::to_string(P.replicas) + " slot blocks");
+
+    // Blocks without a key keep limb 0: it only matches padding slots, which
+    // have no digest rows
+    EncryptedKey result;
+    for (int l = 0; l < P.key_limbs; l++) {
+        std::vector<int64_t> limbs(P.degree, 0);
+        for (size_t r = 0; r < keys.size(); r++)
+            std::fill_n(limbs.begin() + r * P.block_size, P.block_size, keyLimb(P, keys[r], l));
+        result.push_back(context->Encrypt(publicKey, context->MakePackedPlaintext(limbs)));
+    }
+    return result;
+}
+
+TestData generateTestData(const PDQParams& P, int seed) {
     std::mt19937_64 gen(seed);
-    std::uniform_int_distribution<int64_t> val_dist(1, ptxt_modulus - 1);
-    std::uniform_int_distribution<int> idx_dist(0, num_records - 1);
+    std::uniform_int_distribution<int64_t> val_dist(1, P.ptxt_modulus - 1);
+    std::uniform_int_distribution<uint64_t> key_dist(
+        0, P.distinct_keys > 0 ? uint64_t(P.distinct_keys - 1) : keyMax(P));
+    std::uniform_int_distribution<int> idx_dist(0, P.num_records - 1);
 
     TestData data;
-    data.query_value = val_dist(gen);
-
-    data.keys.resize(num_records);
-    data.values.resize(num_records);
-    for (int i = 0; i < num_records; i++) {
-        do { data.keys[i] = val_dist(gen); } while (data.keys[i] == data.query_value);
+    data.query_value = key_dist(gen);
+    data.query_values = {data.query_value};
+    while (static_cast<int>(data.query_values.size()) < P.in_keys) {
+        uint64_t key = key_dist(gen);
+        if (std::find(data.query_values.begin(), data.query_values.end(), key) == data.query_values.end())
+            data.query_values.push_back(key);
+    }
+    auto isQuery = [&](uint64_t key) {
+        return std::find(data.query_values.begin(), data.query_values.end(), key) != data.query_values.end();
+    };
+
+    data.keys.resize(P.num_records);
+    data.values.resize(P.num_records);
+    for (int i = 0; i < P.num_records; i++) {
+        do { data.keys[i] = key_dist(gen); } while (isQuery(data.keys[i]));
         data.values[i] = val_dist(gen);
     }
 
-    while (static_cast<int>(data.matching_indices.size()) < num_matching) {
+    // The matches are spread over the IN-list candidates
+    while (static_cast<int>(data.matching_indices.size()) < P.num_matching) {
         int idx = idx_dist(gen);
         if (std::find(data.matching_indices.begin(), data.matching_indices.end(), idx) == data.matching_indices.end()) {
+            data.keys[idx] = data.query_values[data.matching_indices.size() % data.query_values.size()];
             data.matching_indices.push_back(idx);
-            data.keys[idx] = data.query_value;
         }
     }
     std::sort(data.matching_indices.begin(), data.matching_indices.end());
@@ -199,22 +522,87 @@ TestData generateTestData(int seed) {
     return data;
 }
 
+namespace {
+
+// Slot vectors of main ciphertext c: record c * block_size + i in slot i of
+// every slot block (one block unless P.replicas > 1)
+void dbBatches(const PDQParams& P, const TestData& data, const CtxtRecords& records,
+               std::vector<std::vector<int64_t>>& key_batch, std::vector<int64_t>& val_batch) {
+    key_batch.assign(P.key_limbs, std::vector<int64_t>(P.degree, 0));
+    val_batch.assign(P.degree, 0);
+    for (int64_t i = 0; i < records.count; i++) {
+        int64_t rec = records.first + i;
+        for (int r = 0; r < P.replicas; r++) {
+            int64_t slot = r * P.block_size + i;
+            for (int l = 0; l < P.key_limbs; l++) key_batch[l][slot] = keyLimb(P, data.keys[rec], l);
+            val_batch[slot] = data.values[rec];
+        }
+    }
+}
+
+// Check that a layout fits the slots and only names records of the DB
+std::vector<CtxtRecords> checkLayout(const PDQParams& P, const std::vector<CtxtRecords>& layout) {
+    if (layout.empty()) return contiguousLayout(P);
+    for (const auto& records : layout)
+        if (records.first < 0 || records.count < 0 || records.count > P.block_size ||
+            records.first + records.count > P.num_records)
+            throw std::invalid_argument("DB layout: records out of range");
+    return layout;
+}
+
+}  // namespace
+
+CtxtRecords contiguousRecords(const PDQParams& P, int c) {
+    int64_t first = int64_t(c) * P.block_size;
+    return {first, std::max<int64_t>(0, std::min<int64_t>(P.block_size, P.num_records - first))};
+}
+
+std::vector<CtxtRecords> contiguousLayout(const PDQParams& P) {
+    std::vector<CtxtRecords> layout;
+    for (int c = 0; c < P.num_ctxts; c++) layout.push_back(contiguousRecords(P, c));
+    return layout;
+}
+
 EncryptedDB encryptDB(
+    const PDQParams& P,
     const CryptoContext<DCRTPoly>& context,
     const PublicKey<DCRTPoly>& publicKey,
-    const TestData& data) {
+    const TestData& data,
+    const std::vector<CtxtRecords>& layout) {
 
     EncryptedDB db;
-    for (int c = 0; c < num_ctxts; c++) {
-        std::vector<int64_t> key_batch(degree, 0);
-        std::vector<int64_t> val_batch(degree, 0);
-        int start = c * degree;
-        for (int i = 0; i < degree && start + i < num_records; i++) {
-            key_batch[i] = data.keys[start + i];
-            val_batch[i] = data.values[start + i];
-        }
-        db.keys.push_back(context->Encrypt(publicKey, context->MakePackedPlaintext(key_batch)));
+    db.records = checkLayout(P, layout);
+    for (const auto& records : db.records) {
+        std::vector<std::vector<int64_t>> key_batch;
+        std::vector<int64_t> val_batch;
+        dbBatches(P, data, records, key_batch, val_batch);
+        EncryptedKey key;
+        for (const auto& limb_batch : key_batch)
+            key.push_back(context->Encrypt(publicKey, context->MakePackedPlaintext(limb_batch)));
+        db.keys.push_back(std::move(key));
         db.values.push_back(context->Encrypt(publicKey, context->MakePackedPlaintext(val_batch)));
     }
     return db;
 }
+
+PlainDB encodeDB(
+    const PDQParams& P,
+    const CryptoContext<DCRTPoly>& context,
+    const TestData& data,
+    const std::vector<CtxtRecords>& layout) {
+
+    size_t towers = context->GetCryptoParameters()->GetElementParams()->GetParams().size();
+
+    PlainDB db;
+    db.records = checkLayout(P, layout);
+    for (const auto& records : db.records) {
+        std::vector<std::vector<int64_t>> key_batch;
+        std::vector<int64_t> val_batch;
+        dbBatches(P, data, records, key_batch, val_batch);
+        std::vector<Plaintext> key;
+        for (const auto& limb_batch : key_batch) key.push_back(context->MakePackedPlaintext(limb_batch));
+        db.keys.push_back(std::move(key));
+        db.values.push_back(encodeEval(context, val_batch, towers));
+    }
+    return db;
+}
@@ -0,0 +1,77 @@
+#include "shard.h"
+#include "global.h"
+#include "frontend.h"
+#include <sstream>
+#include <stdexcept>
+#include <unistd.h>
+
+using namespace lbcrypto;
+
+namespace {
+
+// Closes the worker connections of one query
+struct Connections {
+    std::vector<int> fds;
+    ~Connections() { for (int fd : fds) ::close(fd); }
+};
+
+}  // namespace
+
+std::pair<size_t, size_t> shardRange(const PDQParams& P, size_t i, size_t num_shards) {
+    size_t per_shard = P.num_ctxts / num_shards;
+    size_t extra = P.num_ctxts % num_shards;
+    size_t begin = i * per_shard + std::min(i, extra);
+    return {begin, begin + per_shard + (i < extra ? 1 : 0)};
+}
+
+ShardCoordinator::ShardCoordinator(const std::vector<std::string>& worker_sockets)
+    : worker_sockets(worker_sockets) {}
+
+QueryResult ShardCoordinator::run(const EncryptedKey& ctxt_query, QueryKind kind) {
+    QueryResult result{QueryStatus::OK, nullptr, ""};
+
+    try {
+        // Send to all workers first so the shards are evaluated in parallel
+        Connections conns;
+        std::vector<QueryResult> partials(worker_sockets.size());
+        for (const auto& path : worker_sockets) conns.fds.push_back(connectUnixSocket(path));
+        for (size_t i = 0; i < conns.fds.size(); i++) sendQuery(conns.fds[i], ctxt_query, kind);
+        for (size_t i = 0; i < conns.fds.size(); i++) partials[i] = receiveResult(conns.fds[i]);
+
+        for (size_t i = 0; i < partials.size() && result.status == QueryStatus::OK; i++) {
+            if (partials[i].status != QueryStatus::OK) {
+                result = {partials[i].status, nullptr, "shard " + std::to_string(i) + ": " + partials[i].error};
+            } else if (!result.digest) {
+                result.digest = partials[i].digest;
+            } else {
+                result.digest->GetCryptoContext()->EvalAddInPlace(result.digest, partials[i].digest);
+            }
+        }
+    } catch (const std::exception& e) {
+        result = {QueryStatus::Failed, nullptr, e.what()};
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    (result.status == QueryStatus::OK ? completed : failed)++;
+    return result;
+}
+
+std::string ShardCoordinator::statsJSON() const {
+    std::ostringstream os;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        os << "{\"completed\": " << completed << ", \"failed\": " << failed << ", \"workers\": [";
+    }
+    for (size_t i = 0; i < worker_sockets.size(); i++) {
+        os << (i ? ", " : "");
+        try {
+            Connections conns;
+            conns.fds.push_back(connectUnixSocket(worker_sockets[i]));
+            os << remoteStats(conns.fds[0]);
+        } catch (const std::exception&) {
+            os << "null";
+        }
+    }
+    os << "]}";
+    return os.str();
+}
@@ -0,0 +1,158 @@
+#include "store.h"
+#include "setup.h"
+#include "binio.h"
+#include "ciphertext-ser.h"
+#include "scheme/bfvrns/bfvrns-ser.h"
+#include "cryptocontext-ser.h"
+#include "key/key-ser.h"
+#include "encoding/encodingparams.h"
+#include <fstream>
+#include <stdexcept>
+
+using namespace lbcrypto;
+
+namespace {
+
+constexpr uint32_t STORE_MAGIC = 0x53514450;  // "PDQS"
+constexpr uint32_t STORE_VERSION = 10;
+constexpr uint32_t SHARD_MAGIC = 0x44514450;  // "PDQD"
+constexpr uint32_t SHARD_VERSION = 3;
+
+// Parameters that determine the server state (derived ones are recomputed)
+int PDQParams::* const storedParams[] = {
+    &PDQParams::num_records, &PDQParams::num_matching, &PDQParams::key_limbs, &PDQParams::in_keys,
+    &PDQParams::replicas, &PDQParams::aggregates,
+    &PDQParams::ptxt_modulus, &PDQParams::degree, &PDQParams::MultiplicativeDepth,
+    &PDQParams::ScalingModSize, &PDQParams::NumLargeDigits,
+    &PDQParams::degree_trace, &PDQParams::MultiplicativeDepth_trace, &PDQParams::NumLargeDigits_trace,
+    &PDQParams::towers_bsgs, &PDQParams::ringswitch_ratio,
+};
+
+// Contexts of every ring of ringSwitchChain(P), largest first: main,
+// intermediate, trace
+std::vector<CryptoContext<DCRTPoly>> ringContexts(const ServerState& state) {
+    std::vector<CryptoContext<DCRTPoly>> contexts{state.context};
+    contexts.insert(contexts.end(), state.chain.contexts.begin(), state.chain.contexts.end());
+    contexts.push_back(state.context_trace);
+    return contexts;
+}
+
+}  // namespace
+
+void saveServerState(const std::string& path, const ServerState& state) {
+    std::ofstream os(path, std::ios::binary);
+    if (!os) throw std::runtime_error("cannot open " + path);
+
+    writeU32(os, STORE_MAGIC);
+    writeU32(os, STORE_VERSION);
+    for (auto param : storedParams) writeU32(os, static_cast<uint32_t>(state.params.*param));
+    writeString(os, state.keyTag);
+    writeString(os, state.keyTag_trace);
+    os.write(reinterpret_cast<const char*>(state.key_seed.data()), state.key_seed.size());
+
+    // Every context as it is, with the main context's moduli in the smaller
+    // rings; setupPDQ() gave each the packed-encoding root of its ring
+    // (setContextRoot()), so that loading registers the same roots
+    for (const auto& context : ringContexts(state)) Serial::Serialize(context, os, SerType::BINARY);
+
+    // Evaluation keys seed-compressed, with the indices setupPDQ() generated them at
+    serializeSeededEvalMultKey(os, state.keyTag, state.key_seed);
+    serializeSeededEvalMultKey(os, state.keyTag_trace, state.key_seed);
+    serializeSeededRotKeys(os, state.keyTag_trace, state.key_seed);
+    serializeSeededSwitchKey(os, state.switch_key, state.key_seed);
+    serializeSeededRelinSwitchKey(os, state.relin_switch_key, state.key_seed);
+    for (size_t k = 0; k < state.chain.switch_keys.size(); k++) {
+        writeString(os, state.chain.keyTags[k]);
+        serializeSeededSwitchKey(os, state.chain.switch_keys[k], state.key_seed);
+    }
+}
+
+ServerState loadServerState(const std::string& path) {
+    std::ifstream is(path, std::ios::binary);
+    if (!is) throw std::runtime_error("cannot open " + path);
+
+    if (readU32(is) != STORE_MAGIC || readU32(is) != STORE_VERSION)
+        throw std::runtime_error(path + ": not a PDQ server state");
+    ServerState state;
+    const PDQParams& P = state.params;
+    for (auto param : storedParams) state.params.*param = static_cast<int>(readU32(is));
+    state.params.derive();
+
+    state.keyTag = readString(is);
+    state.keyTag_trace = readString(is);
+    is.read(reinterpret_cast<char*>(state.key_seed.data()), state.key_seed.size());
+
+    // Contexts of the chain's rings in the order saved; each registers the
+    // packed-encoding root stored with it
+    auto rings = ringSwitchChain(P);
+    std::vector<CryptoContext<DCRTPoly>> contexts(rings.size());
+    for (size_t k = 0; k < rings.size(); k++) {
+        Serial::Deserialize(contexts[k], is, SerType::BINARY);
+        if (contexts[k]->GetRingDimension() != static_cast<uint32_t>(rings[k]))
+            throw std::runtime_error(path + ": context rings differ from the parameters");
+        PackedEncoding::SetParams(2 * rings[k], contexts[k]->GetEncodingParams());
+        enableFeatures(contexts[k]);
+    }
+    state.context = contexts.front();
+    state.context_trace = contexts.back();
+    state.chain.contexts.assign(contexts.begin() + 1, contexts.end() - 1);
+
+    // The dummy encoding of setupPDQ() (see the TODO there) is still needed:
+    // registering the stored roots does not replace it, and without it packed
+    // encoding fails silently after a ring switch
+    (void)state.context->MakePackedPlaintext(std::vector<int64_t>(P.degree, 0));
+
+    // Full keys are rebuilt in memory; the seed is kept for saving them again
+    deserializeSeededEvalMultKey(is, state.context, 0);
+    deserializeSeededEvalMultKey(is, state.context_trace, 1);
+    deserializeSeededRotKeys(is, state.context_trace);
+    state.switch_key = deserializeSeededSwitchKey(is, state.context, 0);
+    state.relin_switch_key = deserializeSeededRelinSwitchKey(is, state.context);
+
+    for (size_t k = 0; k < state.chain.contexts.size(); k++) {
+        state.chain.keyTags.push_back(readString(is));
+        state.chain.switch_keys.push_back(deserializeSeededSwitchKey(is, state.chain.contexts[k], k + 1));
+    }
+    if (!is) throw std::runtime_error(path + ": cannot read evaluation keys");
+
+    return state;
+}
+
+void saveDBShard(const PDQParams& P, const std::string& path, const EncryptedDB& db, size_t begin, size_t end) {
+    std::ofstream os(path, std::ios::binary);
+    if (!os) throw std::runtime_error("cannot open " + path);
+
+    writeU32(os, SHARD_MAGIC);
+    writeU32(os, SHARD_VERSION);
+    writeU32(os, static_cast<uint32_t>(end - begin));
+    writeU32(os, static_cast<uint32_t>(P.key_limbs));
+    for (size_t c = begin; c < end; c++) {
+        writeU32(os, static_cast<uint32_t>(db.records[c].first));
+        writeU32(os, static_cast<uint32_t>(db.records[c].count));
+        for (const auto& limb : db.keys[c]) Serial::Serialize(limb, os, SerType::BINARY);
+        Serial::Serialize(db.values[c], os, SerType::BINARY);
+    }
+}
+
+EncryptedDB loadDBShard(const PDQParams& P, const std::string& path) {
+    std::ifstream is(path, std::ios::binary);
+    if (!is) throw std::runtime_error("cannot open " + path);
+
+    if (readU32(is) != SHARD_MAGIC || readU32(is) != SHARD_VERSION)
+        throw std::runtime_error(path + ": not a PDQ DB shard");
+
+    EncryptedDB db;
+    size_t count = readU32(is);
+    if (readU32(is) != static_cast<uint32_t>(P.key_limbs))
+        throw std::runtime_error(path + ": key limbs differ from the server state");
+    db.keys.assign(count, EncryptedKey(P.key_limbs));
+    db.values.resize(count);
+    db.records.resize(count);
+    for (size_t c = 0; c < count; c++) {
+        db.records[c].first = readU32(is);
+        db.records[c].count = readU32(is);
+        for (auto& limb : db.keys[c]) Serial::Deserialize(limb, is, SerType::BINARY);
+        Serial::Deserialize(db.values[c], is, SerType::BINARY);
+    }
+    return db;
+}
@@ -0,0 +1,103 @@
+#include "stream.h"
+#include "global.h"
+#include "setup.h"
+#include "match.h"
+#include "ringswitch.h"
+
+using namespace lbcrypto;
+
+void streamCiphertext(
+    const PDQParams& P,
+    const CtxtRecords& records,
+    const MatchMask& mm,
+    const CryptoContext<DCRTPoly>& context_trace,
+    const std::string& keyTag_trace,
+    const EvalKey<DCRTPoly>& switch_key,
+    const EvalKey<DCRTPoly>& relin_switch_key,
+    const RingSwitchChain& chain,
+    BSGSAccumulator& acc_e,
+    BSGSAccumulator& acc_w) {
+
+    size_t towers = bsgsTowers(P, context_trace);
+
+    auto index_trace = ringswitch(P, context_trace, keyTag_trace, switch_key, {mm.index}, nullptr, chain);
+    // An unrelinearized masked value is relinearized by its ring-switch key switch
+    auto masked_trace = ringswitch(P, context_trace, keyTag_trace, switch_key, {mm.masked}, relin_switch_key, chain);
+
+    // Plaintexts are encoded per trace ciphertext rather than up front, so
+    // they do not grow with N either
+    for (int r = 0; r < P.dim_trace; r++) {
+        auto column = precomputeBSGSColumn(P, context_trace, towers, records, r);
+        accumulateBSGS(P, acc_e, masked_trace[r], column);
+        accumulateBSGS(P, acc_w, index_trace[r], column);
+    }
+}
+
+void streamTraceCiphertext(
+    const PDQParams& P,
+    const EncryptedDB& db,
+    size_t c,
+    const Ciphertext<DCRTPoly>& index,
+    const CryptoContext<DCRTPoly>& context_trace,
+    const std::string& keyTag_trace,
+    const EvalKey<DCRTPoly>& switch_key,
+    const RingSwitchChain& chain,
+    BSGSAccumulator& acc_e,
+    BSGSAccumulator& acc_w) {
+
+    size_t towers = bsgsTowers(P, context_trace);
+
+    // All trace towers until the multiply; maskTrace drops both to towers
+    auto index_trace = ringswitch(allTraceTowers(P), context_trace, keyTag_trace, switch_key, {index}, nullptr, chain);
+    std::vector<Ciphertext<DCRTPoly>> values_trace(db.values_trace.begin() + c * P.dim_trace,
+                                                   db.values_trace.begin() + (c + 1) * P.dim_trace);
+    auto masked_trace = maskTrace(P, values_trace, index_trace);
+
+    for (int r = 0; r < P.dim_trace; r++) {
+        auto column = precomputeBSGSColumn(P, context_trace, towers, db.records[c], r);
+        accumulateBSGS(P, acc_e, masked_trace[r], column);
+        accumulateBSGS(P, acc_w, index_trace[r], column);
+    }
+}
+
+Ciphertext<DCRTPoly> streamQuery(
+    const PDQParams& P,
+    const EncryptedDB& db,
+    const EncryptedKey& ctxt_query,
+    const CryptoContext<DCRTPoly>& context_trace,
+    const std::string& keyTag_trace,
+    const EvalKey<DCRTPoly>& switch_key,
+    const EvalKey<DCRTPoly>& relin_switch_key,
+    const RingSwitchChain& chain) {
+
+    BSGSAccumulator acc_e, acc_w;
+    for (size_t c = 0; c < db.keys.size(); c++) {
+        if (!db.values_trace.empty()) {
+            streamTraceCiphertext(P, db, c, matchKey(db.keys[c], ctxt_query), context_trace, keyTag_trace,
+                                  switch_key, chain, acc_e, acc_w);
+            continue;
+        }
+        auto mm = matchMask(db.keys[c], db.values[c], ctxt_query);
+        streamCiphertext(P, db.records[c], mm, context_trace, keyTag_trace, switch_key, relin_switch_key, chain, acc_e, acc_w);
+    }
+
+    return combineDigests(P, finishBSGS(P, acc_e), finishBSGS(P, acc_w));
+}
+
+Ciphertext<DCRTPoly> streamQuery(
+    const PDQParams& P,
+    const PlainDB& db,
+    const EncryptedKey& ctxt_query,
+    const CryptoContext<DCRTPoly>& context_trace,
+    const std::string& keyTag_trace,
+    const EvalKey<DCRTPoly>& switch_key,
+    const RingSwitchChain& chain) {
+
+    BSGSAccumulator acc_e, acc_w;
+    for (size_t c = 0; c < db.keys.size(); c++) {
+        auto mm = matchMaskPlain(db.keys[c], db.values[c], ctxt_query);
+        streamCiphertext(P, db.records[c], mm, context_trace, keyTag_trace, switch_key, nullptr, chain, acc_e, acc_w);
+    }
+
+    return combineDigests(P, finishBSGS(P, acc_e), finishBSGS(P, acc_w));
+}
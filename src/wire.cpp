@@ -0,0 +1,145 @@
+#include "wire.h"
+#include "setup.h"
+#include <cerrno>
+#include <climits>
+#include <mutex>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace lbcrypto;
+
+namespace {
+
+static_assert(sizeof(WireHeader) == 40, "WireHeader must have no padding");
+static_assert(sizeof(NativeInteger) == sizeof(uint64_t), "limbs are written as raw 64-bit words");
+
+// OpenFHE's context registry is not synchronized
+std::mutex registry_mutex;
+
+uint64_t fnv1a(uint64_t hash, uint64_t word) {
+    for (int i = 0; i < 8; i++) {
+        hash ^= (word >> (8 * i)) & 0xff;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+CryptoContext<DCRTPoly> findContext(uint64_t fingerprint) {
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    for (const auto& context : CryptoContextFactory<DCRTPoly>::GetAllContexts())
+        if (paramFingerprint(context) == fingerprint) return context;
+    return nullptr;
+}
+
+}  // namespace
+
+uint64_t paramFingerprint(const CryptoContext<DCRTPoly>& context) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    hash = fnv1a(hash, context->GetRingDimension());
+    hash = fnv1a(hash, context->GetCryptoParameters()->GetPlaintextModulus());
+    for (const auto& tower : context->GetElementParams()->GetParams())
+        hash = fnv1a(hash, tower->GetModulus().ConvertToInt());
+    return hash;
+}
+
+void WireBatch::addBytes(const void* data, size_t len) {
+    owned.emplace_back(static_cast<const char*>(data), len);
+    iov.push_back({&owned.back()[0], len});
+    total += len;
+}
+
+void WireBatch::add(const Ciphertext<DCRTPoly>& ct) {
+    const auto& elements = ct->GetElements();
+    std::string tag = ct->GetKeyTag();
+
+    WireHeader header{};
+    header.magic = WIRE_MAGIC;
+    header.ring_dim = elements[0].GetRingDimension();
+    header.fingerprint = paramFingerprint(ct->GetCryptoContext());
+    header.elements = static_cast<uint32_t>(elements.size());
+    header.towers = static_cast<uint32_t>(elements[0].GetNumOfElements());
+    header.format = elements[0].GetFormat() == Format::EVALUATION ? 1 : 0;
+    header.level = static_cast<uint32_t>(ct->GetLevel());
+    header.noise_scale_deg = static_cast<uint32_t>(ct->GetNoiseScaleDeg());
+    header.tag_bytes = static_cast<uint32_t>(tag.size());
+
+    std::string head(reinterpret_cast<const char*>(&header), sizeof(header));
+    head += tag;
+    addBytes(head.data(), head.size());
+
+    for (const auto& poly : elements) {
+        for (const auto& limb : poly.GetAllElements()) {
+            size_t len = limb.GetLength() * sizeof(uint64_t);
+            iov.push_back({const_cast<NativeInteger*>(&limb[0]), len});
+            total += len;
+        }
+    }
+    held.push_back(ct);
+}
+
+void writeAll(int fd, std::vector<iovec> iov) {
+    size_t first = 0;
+    while (first < iov.size()) {
+        int count = static_cast<int>(std::min<size_t>(iov.size() - first, IOV_MAX));
+
+        // sendmsg is writev for sockets, without SIGPIPE on a closed peer
+        msghdr msg{};
+        msg.msg_iov = &iov[first];
+        msg.msg_iovlen = count;
+        ssize_t n = ::sendmsg(fd, &msg, MSG_NOSIGNAL);
+        if (n < 0 && errno == ENOTSOCK) n = ::writev(fd, &iov[first], count);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) throw std::runtime_error("connection closed");
+
+        size_t done = static_cast<size_t>(n);
+        while (first < iov.size() && done >= iov[first].iov_len) done -= iov[first++].iov_len;
+        if (done > 0) {
+            iov[first].iov_base = static_cast<char*>(iov[first].iov_base) + done;
+            iov[first].iov_len -= done;
+        }
+    }
+}
+
+Ciphertext<DCRTPoly> readWireCiphertext(const std::function<void(char*, size_t)>& read) {
+    WireHeader header;
+    read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (header.magic != WIRE_MAGIC) throw std::runtime_error("not a PDQ wire ciphertext");
+
+    auto context = findContext(header.fingerprint);
+    if (!context) throw std::runtime_error("wire ciphertext: no context with matching parameters");
+    auto params = context->GetElementParams();
+    if (header.ring_dim != context->GetRingDimension() || header.elements == 0 || header.elements > 3 ||
+        header.towers == 0 || header.towers > params->GetParams().size() || header.tag_bytes > WIRE_MAX_TAG_BYTES)
+        throw std::runtime_error("wire ciphertext: malformed header");
+
+    std::string tag(header.tag_bytes, '\0');
+    if (!tag.empty()) read(&tag[0], tag.size());
+
+    params = truncateParams(params, header.towers);
+    Format format = header.format ? Format::EVALUATION : Format::COEFFICIENT;
+
+    std::vector<DCRTPoly> elements;
+    elements.reserve(header.elements);
+    for (uint32_t e = 0; e < header.elements; e++) {
+        elements.emplace_back(params, format, true);
+        auto& towers = elements.back().GetAllElements();
+        for (auto& limb : towers) {
+            auto* words = reinterpret_cast<uint64_t*>(&limb[0]);
+            read(reinterpret_cast<char*>(words), header.ring_dim * sizeof(uint64_t));
+
+            // Everything downstream assumes reduced coefficients
+            uint64_t q = limb.GetModulus().ConvertToInt();
+            for (uint32_t k = 0; k < header.ring_dim; k++)
+                if (words[k] >= q) throw std::runtime_error("wire ciphertext: coefficient out of range");
+        }
+    }
+
+    auto ct = std::make_shared<CiphertextImpl<DCRTPoly>>(context);
+    ct->SetElements(std::move(elements));
+    ct->SetKeyTag(tag);
+    ct->SetEncodingType(PACKED_ENCODING);
+    ct->SetLevel(header.level);
+    ct->SetNoiseScaleDeg(header.noise_scale_deg);
+    return ct;
+}